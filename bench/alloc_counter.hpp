@@ -0,0 +1,40 @@
+#ifndef BENCH_ALLOC_COUNTER_HPP
+#define BENCH_ALLOC_COUNTER_HPP
+
+#include <stdlib.h>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+
+/** Counts heap allocations, for benches that report them per operation, by
+ replacing the global operator new.  As the replacements are defined here,
+ include this from the one source file of a bench only.
+ */
+
+/** Allocations made through operator new so far
+ */
+static std::atomic<int64_t> g_n_allocs (0);
+
+void* operator new (size_t size)
+{
+  g_n_allocs.fetch_add(1, std::memory_order_relaxed);
+  void* ptr = malloc(size);
+  if (!ptr) {
+    throw std::bad_alloc();
+  }
+  return ptr;
+}
+
+void operator delete (void* ptr) noexcept
+{
+  free(ptr);
+}
+
+void operator delete (void* ptr, size_t /*size*/) noexcept
+{
+  free(ptr);
+}
+
+#endif
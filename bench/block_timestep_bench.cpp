@@ -0,0 +1,186 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+
+#include <string>
+#include <vector>
+#include <random>
+#include <algorithm>
+
+#include "common/result.hpp"
+#include "common/time_measures.hpp"
+#include "common/particle_store.hpp"
+#include "common/direct_gravity.hpp"
+#include "common/block_timestep_integrator.hpp"
+#include "common/symplectic_integrator.hpp"
+
+using namespace std;
+using namespace evo;
+using namespace std_results;
+
+/** Compares BlockTimestepIntegrator with a single global timestep on a
+ clustered scenario: a Plummer sphere in which a few percent of the bodies
+ are paired up into tight binaries, whose orbital periods are far shorter
+ than the cluster's crossing time.  A global timestep has to resolve the
+ binaries for everyone; block timesteps only for the binaries.
+
+ Forces come from DirectGravity, whose cost is proportional to the number of
+ bodies whose accelerations are requested, so the force evaluation counts
+ translate directly into run time.
+ */
+
+static const double kG = 1.0;
+static const float kSoftening = 1e-4f;
+static const size_t kBodies = 2000;
+static const size_t kBinaries = 20;
+static const float kBinarySeparation = 0.002f;
+static const float kTick = 1.0f / 16;
+static const int kTicks = 8;
+
+static void MakeCluster (unsigned seed, ParticleStore* things)
+{
+  mt19937 rng (seed);
+  uniform_real_distribution<double> uni (0.0, 1.0);
+  const float m = static_cast<float>(1.0 / kBodies);
+
+  things->Clear();
+  things->Reserve(kBodies);
+
+  auto random_direction = [&] (double len) {
+    double cos_t = 2.0 * uni(rng) - 1.0;
+    double sin_t = sqrt(1.0 - cos_t * cos_t);
+    double phi = 2.0 * M_PI * uni(rng);
+    return Coords3(len * sin_t * cos(phi), len * sin_t * sin(phi), len * cos_t);
+  };
+
+  for (size_t i = 0; i < kBodies - kBinaries; ++i)
+  {
+    double r = 1.0 / sqrt(pow(0.999 * uni(rng), -2.0 / 3.0) - 1.0);
+
+    // speed from the Plummer distribution function, by rejection (Aarseth,
+    // Henon & Wielen 1974)
+    double q, g;
+    do {
+      q = uni(rng);
+      g = 0.1 * uni(rng);
+    } while (g > q * q * pow(1.0 - q * q, 3.5));
+    double v = q * sqrt(2.0) * pow(1.0 + r * r, -0.25);
+
+    things->Add(m, 0.0f, random_direction(r), random_direction(v));
+  }
+
+  // turn the first kBinaries bodies into circular binaries
+  const float v_rel = static_cast<float>(sqrt(kG * 2 * m / kBinarySeparation));
+  for (size_t b = 0; b < kBinaries; ++b)
+  {
+    Coords3 pos = things->Get(b).pos();
+    Coords3 vel = things->Get(b).vel();
+    things->Add(m, 0.0f,
+                Coords3(pos.x + kBinarySeparation, pos.y, pos.z),
+                Coords3(vel.x, vel.y + v_rel / 2, vel.z));
+    things->Get(b).set_vel(Coords3(vel.x, vel.y - v_rel / 2, vel.z));
+  }
+}
+
+static double TotalEnergy (const ParticleStore& things)
+{
+  const size_t n = things.size();
+  const double eps2 = static_cast<double>(kSoftening) * kSoftening;
+  double kinetic = 0;
+  double potential = 0;
+
+  for (size_t i = 0; i < n; ++i)
+  {
+    const double vx = things.vx()[i];
+    const double vy = things.vy()[i];
+    const double vz = things.vz()[i];
+    kinetic += 0.5 * things.mass()[i] * (vx*vx + vy*vy + vz*vz);
+
+    for (size_t j = i + 1; j < n; ++j)
+    {
+      const double dx = static_cast<double>(things.x()[j]) - things.x()[i];
+      const double dy = static_cast<double>(things.y()[j]) - things.y()[i];
+      const double dz = static_cast<double>(things.z()[j]) - things.z()[i];
+      potential -= kG * things.mass()[i] * things.mass()[j] /
+                   sqrt(dx*dx + dy*dy + dz*dz + eps2);
+    }
+  }
+
+  return kinetic + potential;
+}
+
+/** Runs kTicks ticks, each split into \p substeps integrator steps, and
+ returns the wall time; \p rel_energy_error receives |dE/E|.
+ */
+static double Run (IIntegrator* integrator, int substeps,
+                   double* rel_energy_error)
+{
+  ParticleStore things;
+  MakeCluster(1234, &things);
+
+  DirectGravity gravity;
+  gravity.set_softening(kSoftening);
+
+  const double e0 = TotalEnergy(things);
+  const float dt = kTick / substeps;
+
+  TimePoint start = TimePoint::Now();
+  for (int t = 0; t < kTicks * substeps; ++t)
+  {
+    Result res = integrator->Step(dt, kG, &gravity, &things);
+    if (SUCCESS != res) {
+      printf("%s: step failed: %s\n", integrator->name().c_str(),
+             res.ToString().c_str());
+      break;
+    }
+  }
+  const double secs = (TimePoint::Now() - start).Seconds();
+
+  *rel_energy_error = fabs((TotalEnergy(things) - e0) / e0);
+  return secs;
+}
+
+int main ()
+{
+  printf("%zu bodies (%zu in binaries, separation %g), eps = %g,"
+         " %d ticks of %g\n", kBodies, 2 * kBinaries, kBinarySeparation,
+         kSoftening, kTicks, kTick);
+  printf("%-28s  %14s  %9s  %12s\n", "integrator", "force evals", "seconds",
+         "rel dE");
+
+  BlockTimestepIntegrator block;
+  block.set_max_level(12);
+  block.set_length_scale(kSoftening);
+
+  double block_err = 0;
+  double block_secs = Run(&block, 1, &block_err);
+  const uint64_t block_evals = block.force_evaluations();
+  printf("%-28s  %14llu  %9.2f  %12.3e\n", "block timesteps",
+         static_cast<unsigned long long>(block_evals), block_secs, block_err);
+
+  const int deepest = max(block.deepest_level(), 0);
+  printf("  deepest level %d; bodies per level in the last tick:", deepest);
+  for (int l = 0; l <= deepest; ++l) {
+    printf(" %zu", block.level_population(l));
+  }
+  printf("\n");
+
+  // a global timestep as short as the shortest block timestep, and some
+  // coarser ones, to find the global step with the same accuracy
+  for (int level = deepest; level >= 0 && level >= deepest - 6; level -= 2)
+  {
+    SymplecticIntegrator<VelocityVerlet> global;
+    const int substeps = 1 << level;
+    const uint64_t global_evals =
+        static_cast<uint64_t>(kTicks) * substeps * kBodies;
+    double global_err = 0;
+    double global_secs = Run(&global, substeps, &global_err);
+    char label [64];
+    snprintf(label, sizeof(label), "global, dt = tick/%d", substeps);
+    printf("%-28s  %14llu  %9.2f  %12.3e  (%.1fx the evaluations)\n", label,
+           static_cast<unsigned long long>(global_evals), global_secs,
+           global_err, static_cast<double>(global_evals) / block_evals);
+  }
+
+  return 0;
+}
@@ -0,0 +1,105 @@
+#include <stdio.h>
+
+#include <algorithm>
+#include <cctype>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "common/util.hpp"
+#include "common/time_measures.hpp"
+#include "bench/alloc_counter.hpp"
+
+using namespace std;
+using namespace evo;
+
+/** Measures building and querying a 100k-entry unordered_map keyed by
+ strings that ignore case, with CaseInsensitiveStringHash and
+ CaseInsensitiveStringComparer against the StrToLower()-based functors
+ they replaced.  Lookups use keys that differ from the inserted ones in
+ case only.  Heap allocations are counted by replacing the global
+ operator new (see alloc_counter.hpp).
+ */
+
+static const int kEntries = 100 * 1000;
+static const int kLookupPasses = 10;
+
+struct LowercasingStringHash {
+  size_t operator () (const string& str) const {
+    return hash<string>()(StrToLower(str));
+  }
+};
+
+struct LowercasingStringComparer {
+  bool operator () (const string &lhs, const string &rhs) const {
+    return StrToLower(rhs) == StrToLower(lhs);
+  }
+};
+
+template <typename Hash, typename Comparer>
+static void Time (const char* label, const vector<string>& keys,
+                  const vector<string>& lookup_keys)
+{
+  unordered_map<string, int, Hash, Comparer> map;
+
+  int64_t allocs_before = g_n_allocs.load();
+  FastClock::Ticks start = FastClock::Now();
+  for (int i = 0; i < kEntries; ++i) {
+    map[keys[i]] = i;
+  }
+  const Duration insert_elapsed =
+      FastClock::ToDuration(FastClock::Now() - start);
+  const int64_t insert_allocs = g_n_allocs.load() - allocs_before;
+
+  int64_t sum = 0;
+  allocs_before = g_n_allocs.load();
+  start = FastClock::Now();
+  for (int pass = 0; pass < kLookupPasses; ++pass) {
+    for (const string& key : lookup_keys) {
+      sum += map.find(key)->second;
+    }
+  }
+  const Duration lookup_elapsed =
+      FastClock::ToDuration(FastClock::Now() - start);
+  const int64_t lookup_allocs = g_n_allocs.load() - allocs_before;
+
+  const int n_lookups = kLookupPasses * kEntries;
+  printf("%-36s  %10.1f  %10.2f  %10.1f  %10.2f  (%lld)\n", label,
+         static_cast<double>(insert_elapsed.Nanoseconds()) / kEntries,
+         static_cast<double>(insert_allocs) / kEntries,
+         static_cast<double>(lookup_elapsed.Nanoseconds()) / n_lookups,
+         static_cast<double>(lookup_allocs) / n_lookups,
+         static_cast<long long>(sum));
+}
+
+int main ()
+{
+  mt19937 rng (42);
+  const char* kPrefixes[] = { "Body", "Particle", "Universe.Phase", "Thread" };
+
+  vector<string> keys;
+  vector<string> lookup_keys;
+  for (int i = 0; i < kEntries; ++i)
+  {
+    string key = string(kPrefixes[i % 4]) + "_" + to_string(i) + "_Mass";
+    string lookup_key = key;
+    for (char& ch : lookup_key) {
+      if (rng() % 2) {
+        ch = static_cast<char>(isupper(ch) ? tolower(ch) : toupper(ch));
+      }
+    }
+    keys.push_back(key);
+    lookup_keys.push_back(lookup_key);
+  }
+  shuffle(lookup_keys.begin(), lookup_keys.end(), rng);
+
+  printf("%-36s  %10s  %10s  %10s  %10s\n", "", "insert ns", "allocs",
+         "lookup ns", "allocs");
+  Time<LowercasingStringHash, LowercasingStringComparer>(
+      "StrToLower() functors", keys, lookup_keys);
+  Time<CaseInsensitiveStringHash, CaseInsensitiveStringComparer>(
+      "CaseInsensitiveString{Hash,Comparer}", keys, lookup_keys);
+
+  return 0;
+}
@@ -0,0 +1,114 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+
+#include <vector>
+#include <random>
+#include <algorithm>
+
+#include "common/result.hpp"
+#include "common/time_measures.hpp"
+#include "common/particle_store.hpp"
+#include "common/direct_gravity.hpp"
+
+using namespace std;
+using namespace evo;
+using namespace std_results;
+
+/** Runs every DirectGravity kernel the CPU supports and checks each against
+ the scalar kernel.  Exits non-zero if any kernel strays from the scalar
+ results by more than kTolerance (relative to the acceleration magnitude).
+ */
+
+static const double kG = 1.0;
+static const float kSoftening = 1e-2f;
+static const double kTolerance = 1e-4;
+
+static void MakeUniformCube (size_t n, unsigned seed, ParticleStore* things)
+{
+  mt19937 rng (seed);
+  uniform_real_distribution<float> uni (-1.0f, 1.0f);
+
+  things->Clear();
+  things->Reserve(n);
+  for (size_t i = 0; i < n; ++i) {
+    things->Add(1.0f / n, 0.0f, Coords3(uni(rng), uni(rng), uni(rng)));
+  }
+}
+
+static bool RunOne (size_t n)
+{
+  bool ok = true;
+
+  ParticleStore things;
+  MakeUniformCube(n, 42, &things);
+
+  DirectGravity direct;
+  direct.set_softening(kSoftening);
+
+  direct.set_isa(DirectGravity::Isa::kScalar);
+  direct.ComputeAccelerations(kG, &things);
+  vector<float> ref_x (things.ax(), things.ax() + n);
+  vector<float> ref_y (things.ay(), things.ay() + n);
+  vector<float> ref_z (things.az(), things.az() + n);
+
+  const DirectGravity::Isa isas [] = {
+    DirectGravity::Isa::kScalar, DirectGravity::Isa::kSse,
+    DirectGravity::Isa::kAvx2, DirectGravity::Isa::kAvx512 };
+
+  for (DirectGravity::Isa isa : isas)
+  {
+    if (SUCCESS != direct.set_isa(isa)) {
+      printf("%8zu  %-8s  (not supported by this CPU)\n", n,
+             DirectGravity::IsaToString(isa).c_str());
+      continue;
+    }
+
+    const int n_iters = max(1, static_cast<int>(2e9 / (double(n) * n)));
+    direct.ComputeAccelerations(kG, &things);
+    TimePoint start = TimePoint::Now();
+    for (int i = 0; i < n_iters; ++i) {
+      direct.ComputeAccelerations(kG, &things);
+    }
+    double secs = (TimePoint::Now() - start).Seconds() / n_iters;
+
+    double max_err = 0;
+    for (size_t i = 0; i < n; ++i)
+    {
+      double ex = things.ax()[i] - ref_x[i];
+      double ey = things.ay()[i] - ref_y[i];
+      double ez = things.az()[i] - ref_z[i];
+      double mag = sqrt(double(ref_x[i]) * ref_x[i] +
+                        double(ref_y[i]) * ref_y[i] +
+                        double(ref_z[i]) * ref_z[i]);
+      double err = sqrt(ex*ex + ey*ey + ez*ez) / (mag > 0 ? mag : 1);
+      max_err = max(max_err, err);
+    }
+
+    bool pass = (max_err <= kTolerance);
+    ok = ok && pass;
+
+    printf("%8zu  %-8s  %10.2f  %12.3f  %10.2e  %s\n", n,
+           DirectGravity::IsaToString(isa).c_str(), 1.0 / secs,
+           double(n) * n / secs / 1e9, max_err, (pass ? "ok" : "MISMATCH"));
+  }
+
+  return ok;
+}
+
+int main ()
+{
+  printf("DirectGravity kernels, detected ISA = %s\n",
+         DirectGravity::IsaToString(DirectGravity::DetectedIsa()).c_str());
+  printf("%8s  %-8s  %10s  %12s  %10s\n",
+         "N", "ISA", "ticks/s", "Gpairs/s", "max relerr");
+
+  // odd sizes exercise the remainder paths of the vector loops
+  const size_t sizes [] = { 1000, 4099, 20000 };
+  bool ok = true;
+  for (size_t n : sizes) {
+    ok = RunOne(n) && ok;
+  }
+
+  return (ok ? 0 : 1);
+}
@@ -0,0 +1,80 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+
+#include <chrono>
+#include <thread>
+
+#include "common/time_measures.hpp"
+#include "bench/keep_alive.hpp"
+
+using namespace std;
+using namespace evo;
+
+/** Measures the cost of one clock read for each of the timestamp sources in
+ time_measures and the raw clock_gettime() underneath the steady one, and
+ how closely FastClock's calibrated durations track CLOCK_MONOTONIC.
+ */
+
+static const int kReads = 20 * 1000 * 1000;
+
+/** Folds every reading into a sum, so that none can be optimized away
+ */
+template <typename ReadFunc>
+static double TimeReads (ReadFunc read)
+{
+  int64_t sum = 0;
+  const int64_t start = FastClock::MonotonicNanoseconds();
+  for (int i = 0; i < kReads; ++i) {
+    sum += read();
+  }
+  const int64_t elapsed = FastClock::MonotonicNanoseconds() - start;
+
+  KeepAlive(sum);
+  return static_cast<double>(elapsed) / kReads;
+}
+
+int main ()
+{
+  printf("FastClock source: %s, %.4f ticks/ns\n\n",
+         (FastClock::uses_tsc() ? "rdtsc" : "clock_gettime(CLOCK_MONOTONIC)"),
+         FastClock::ticks_per_ns());
+
+  printf("%-36s  %10s\n", "", "ns/read");
+  printf("%-36s  %10.2f\n", "TimePoint::Now()", TimeReads([] {
+    return TimePoint::Now().std_time_point().time_since_epoch().count();
+  }));
+  printf("%-36s  %10.2f\n", "SteadyTimePoint::Now()", TimeReads([] {
+    return SteadyTimePoint::Now().since_epoch().Nanoseconds();
+  }));
+  printf("%-36s  %10.2f\n", "clock_gettime(CLOCK_MONOTONIC)", TimeReads([] {
+    return FastClock::MonotonicNanoseconds();
+  }));
+  printf("%-36s  %10.2f\n", "FastClock::Now()", TimeReads([] {
+    return FastClock::Now();
+  }));
+  printf("%-36s  %10.2f\n", "FastClock::Now() + ToDuration()",
+         TimeReads([] {
+    return FastClock::ToDuration(FastClock::Now()).Nanoseconds();
+  }));
+
+  printf("\n%-12s  %14s  %14s  %10s\n", "interval", "monotonic", "FastClock",
+         "error");
+  for (int ms : { 1, 10, 100, 1000 })
+  {
+    const int64_t mono_start = FastClock::MonotonicNanoseconds();
+    const FastClock::Ticks fast_start = FastClock::Now();
+    this_thread::sleep_for(chrono::milliseconds(ms));
+    const FastClock::Ticks fast_end = FastClock::Now();
+    const int64_t mono_end = FastClock::MonotonicNanoseconds();
+
+    const Duration mono (mono_end - mono_start);
+    const Duration fast = FastClock::ToDuration(fast_end - fast_start);
+    printf("%-12s  %14s  %14s  %9.4f%%\n",
+           Duration::FromMilliseconds(ms).ToStringPretty().c_str(),
+           mono.ToStringPretty().c_str(), fast.ToStringPretty().c_str(),
+           100.0 * (fast - mono).Nanoseconds() / mono.Nanoseconds());
+  }
+
+  return 0;
+}
@@ -0,0 +1,229 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+
+#include <string>
+#include <vector>
+#include <random>
+#include <algorithm>
+
+#include "common/result.hpp"
+#include "common/time_measures.hpp"
+#include "common/particle_store.hpp"
+#include "common/barnes_hut.hpp"
+#include "common/particle_mesh.hpp"
+
+using namespace std;
+using namespace evo;
+using namespace std_results;
+
+/** Compares BarnesHutGravity against exact direct summation at a range of
+ population sizes.  Accuracy is measured on a random sample of bodies so
+ that the exact reference stays affordable at 1M bodies; direct summation
+ throughput at the larger sizes is extrapolated from the time taken for the
+ sample.
+
+ Also checks the P3M flavour of ParticleMeshGravity against Newtonian
+ gravity on isolated pairs of bodies (see CheckParticleMeshTwoBody()).
+ */
+
+static const double kG = 1.0;
+static const float kSoftening = 1e-3f;
+static const size_t kAccuracySampleSize = 1000;
+
+static void MakePlummerSphere (size_t n, unsigned seed, ParticleStore* things)
+{
+  mt19937 rng (seed);
+  uniform_real_distribution<double> uni (0.0, 1.0);
+
+  things->Clear();
+  things->Reserve(n);
+
+  for (size_t i = 0; i < n; ++i)
+  {
+    // radius drawn from the Plummer cumulative mass profile, truncated so
+    // that the occasional extreme outlier doesn't blow up the bounding cube
+    double m = 0.999 * uni(rng);
+    double r = 1.0 / sqrt(pow(m, -2.0 / 3.0) - 1.0);
+    double cos_t = 2.0 * uni(rng) - 1.0;
+    double sin_t = sqrt(1.0 - cos_t * cos_t);
+    double phi = 2.0 * M_PI * uni(rng);
+    things->Add(static_cast<float>(1.0 / n), 0.0f,
+                Coords3(r * sin_t * cos(phi), r * sin_t * sin(phi), r * cos_t));
+  }
+}
+
+static void DirectAccel (const ParticleStore& things, size_t i,
+                         double* ax, double* ay, double* az)
+{
+  const size_t n = things.size();
+  const float* x = things.x();
+  const float* y = things.y();
+  const float* z = things.z();
+  const float* m = things.mass();
+  const double eps2 = static_cast<double>(kSoftening) * kSoftening;
+
+  *ax = *ay = *az = 0;
+  for (size_t j = 0; j < n; ++j)
+  {
+    if (j == i) {
+      continue;
+    }
+    double dx = static_cast<double>(x[j]) - x[i];
+    double dy = static_cast<double>(y[j]) - y[i];
+    double dz = static_cast<double>(z[j]) - z[i];
+    double d2 = dx*dx + dy*dy + dz*dz + eps2;
+    double s = m[j] / (d2 * sqrt(d2));
+    *ax += dx * s;
+    *ay += dy * s;
+    *az += dz * s;
+  }
+  *ax *= kG;
+  *ay *= kG;
+  *az *= kG;
+}
+
+static void RunOne (size_t n, float theta)
+{
+  ParticleStore things;
+  MakePlummerSphere(n, 1234, &things);
+
+  BarnesHutGravity bh (theta);
+  bh.set_softening(kSoftening);
+
+  // warm-up call also yields the accelerations we check for accuracy
+  Result res = bh.ComputeAccelerations(kG, &things);
+  if (SUCCESS != res) {
+    printf("Barnes-Hut failed: %s\n", res.ToString().c_str());
+    return;
+  }
+
+  const int n_iters = (n <= 10000 ? 20 : (n <= 100000 ? 5 : 2));
+  TimePoint bh_start = TimePoint::Now();
+  for (int i = 0; i < n_iters; ++i) {
+    bh.ComputeAccelerations(kG, &things);
+  }
+  double bh_secs = (TimePoint::Now() - bh_start).Seconds() / n_iters;
+
+  // accuracy against the exact sum, on a sample of bodies
+  mt19937 rng (99);
+  size_t n_samples = min(n, kAccuracySampleSize);
+  vector<size_t> samples (n);
+  for (size_t i = 0; i < n; ++i) {
+    samples[i] = i;
+  }
+  shuffle(samples.begin(), samples.end(), rng);
+  samples.resize(n_samples);
+
+  vector<double> rel_errors;
+  rel_errors.reserve(n_samples);
+  TimePoint direct_start = TimePoint::Now();
+  for (size_t s = 0; s < n_samples; ++s)
+  {
+    size_t i = samples[s];
+    double ax, ay, az;
+    DirectAccel(things, i, &ax, &ay, &az);
+    double ex = things.ax()[i] - ax;
+    double ey = things.ay()[i] - ay;
+    double ez = things.az()[i] - az;
+    double mag = sqrt(ax*ax + ay*ay + az*az);
+    rel_errors.push_back(sqrt(ex*ex + ey*ey + ez*ez) / (mag > 0 ? mag : 1));
+  }
+  double direct_secs =
+      (TimePoint::Now() - direct_start).Seconds() * n / n_samples;
+
+  sort(rel_errors.begin(), rel_errors.end());
+  double median_err = rel_errors[rel_errors.size() / 2];
+  double p99_err = rel_errors[rel_errors.size() * 99 / 100];
+
+  printf("%8zu  %5.2f  %8zu  %12.2f  %12.4f%s  %10.2e  %10.2e\n",
+         n, theta, bh.node_count(),
+         1.0 / bh_secs, 1.0 / direct_secs,
+         (n_samples < n ? "*" : " "),
+         median_err, p99_err);
+}
+
+/** Puts a unit mass and a light test body a given number of grid cells apart,
+ at random orientations and sub-cell offsets near the middle of a periodic
+ box, and reports how far P3M's acceleration of the test body strays from
+ the unsoftened Newtonian one.  The error at the larger separations includes
+ the pull of the pair's periodic images, which the Newtonian value lacks.
+ */
+static void CheckParticleMeshTwoBody ()
+{
+  const int kGridSize = ParticleMeshGravity::kDefaultGridSize;
+  const float kBoxSize = kGridSize;
+  const int kOrientations = 16;
+  const double separations [] = { 0.5, 1, 2, 4, 8 };
+
+  ParticleMeshGravity pm (kGridSize, kBoxSize);
+  pm.set_short_range_correction(true);
+
+  printf("\nP3M two-body check, %d^3 grid, %d orientations per separation\n",
+         kGridSize, kOrientations);
+  printf("%8s  %10s  %10s\n", "cells", "max relerr", "mean relerr");
+
+  mt19937 rng (5678);
+  uniform_real_distribution<double> uni (0.0, 1.0);
+  for (double d : separations)
+  {
+    double max_err = 0;
+    double sum_err = 0;
+    for (int i = 0; i < kOrientations; ++i)
+    {
+      double cos_t = 2.0 * uni(rng) - 1.0;
+      double sin_t = sqrt(1.0 - cos_t * cos_t);
+      double phi = 2.0 * M_PI * uni(rng);
+      double ux = sin_t * cos(phi), uy = sin_t * sin(phi), uz = cos_t;
+      double x = 0.5 * kBoxSize + uni(rng);
+      double y = 0.5 * kBoxSize + uni(rng);
+      double z = 0.5 * kBoxSize + uni(rng);
+
+      ParticleStore things;
+      things.Add(1.0f, 0.0f, Coords3(x, y, z));
+      things.Add(1e-6f, 0.0f, Coords3(x + d * ux, y + d * uy, z + d * uz));
+
+      Result res = pm.ComputeAccelerations(kG, &things);
+      if (SUCCESS != res) {
+        printf("P3M failed: %s\n", res.ToString().c_str());
+        return;
+      }
+
+      // exact: kG / d^2 towards the unit mass
+      double mag = kG / (d * d);
+      double ex = things.ax()[1] + ux * mag;
+      double ey = things.ay()[1] + uy * mag;
+      double ez = things.az()[1] + uz * mag;
+      double err = sqrt(ex*ex + ey*ey + ez*ez) / mag;
+      max_err = max(max_err, err);
+      sum_err += err;
+    }
+    printf("%8.2f  %10.2e  %10.2e\n", d, max_err, sum_err / kOrientations);
+  }
+}
+
+int main (int argc, char** argv)
+{
+  float theta = BarnesHutGravity::kDefaultTheta;
+  if (argc > 1) {
+    theta = static_cast<float>(atof(argv[1]));
+  }
+
+  printf("Barnes-Hut vs. direct summation, Plummer sphere, G = %g, eps = %g\n",
+         kG, kSoftening);
+  printf("%8s  %5s  %8s  %12s  %13s  %10s  %10s\n",
+         "N", "theta", "nodes", "BH ticks/s", "direct tick/s",
+         "med relerr", "p99 relerr");
+
+  const size_t sizes [] = { 1000, 10000, 100000, 1000000 };
+  for (size_t n : sizes) {
+    RunOne(n, theta);
+  }
+
+  printf("* direct summation rate extrapolated from a %zu-body sample\n",
+         kAccuracySampleSize);
+
+  CheckParticleMeshTwoBody();
+
+  return 0;
+}
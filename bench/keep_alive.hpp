@@ -0,0 +1,14 @@
+#ifndef BENCH_KEEP_ALIVE_HPP
+#define BENCH_KEEP_ALIVE_HPP
+
+/** Makes \p value count as used, so that the work that produced it can't be
+ optimized away: an empty asm that takes the value as an input must have it
+ computed, yet costs no instructions and writes nothing to memory.
+ */
+template <typename T>
+inline void KeepAlive (const T& value)
+{
+  asm volatile ("" : : "g"(value));
+}
+
+#endif
@@ -0,0 +1,109 @@
+#include <stdlib.h>
+#include <stdio.h>
+
+#include <atomic>
+#include <string>
+#include <thread>
+
+#include "common/result.hpp"
+#include "common/time_measures.hpp"
+#include "common/thread.hpp"
+#include "common/task_pool.hpp"
+
+using namespace std;
+using namespace evo;
+using namespace std_results;
+
+/** Measures the cost of UThread::ProcState() in a loop that does nothing
+ else, i.e. the per-iteration overhead every UThread main loop pays, alone
+ and while another thread keeps taking the UThread's state lock (here via
+ ToString()), and the per-task overhead of TaskPool, whose workers call
+ ProcState() between tasks.
+ */
+
+static const int64_t kCycles = 20 * 1000 * 1000;
+
+static double TimeProcState (bool with_observer)
+{
+  atomic<bool> done (false);
+  double ns_per_call = 0;
+
+  UThread looper ("looper", [&] (UThread* uthread) {
+    int64_t i = 0;
+    TimePoint start = TimePoint::Now();
+    while (UThread::ProcStateResult::kContinue == uthread->ProcState()) {
+      if (++i == kCycles) {
+        break;
+      }
+    }
+    ns_per_call = (TimePoint::Now() - start).Seconds() * 1e9 / i;
+    done = true;
+    return SUCCESS;
+  });
+  looper.set_internal_logging_enabled(false);
+
+  thread observer;
+  if (with_observer) {
+    observer = thread([&] {
+      while (!done) {
+        looper.ToString();
+      }
+    });
+  }
+
+  Result res = looper.Start();
+  if (SUCCESS == res) {
+    res = looper.Run(opt::Blocking::kOff);
+  }
+  if (SUCCESS != res) {
+    printf("Couldn't start the looper: %s\n", res.ToString().c_str());
+    exit(1);
+  }
+
+  while (!done) {
+    this_thread::sleep_for(chrono::milliseconds(10));
+  }
+  if (observer.joinable()) {
+    observer.join();
+  }
+
+  return ns_per_call;
+}
+
+static double TimeTasks (TaskPool* pool)
+{
+  const size_t kTasksPerRound = 4096;
+  const int kRounds = 500;
+  atomic<size_t> n_run (0);
+
+  TimePoint start = TimePoint::Now();
+  for (int r = 0; r < kRounds; ++r) {
+    pool->ParallelForEach(kTasksPerRound, [&] (size_t) {
+      n_run.fetch_add(1, memory_order_relaxed);
+    });
+  }
+  const double secs = (TimePoint::Now() - start).Seconds();
+
+  if (n_run != kTasksPerRound * kRounds) {
+    printf("Ran %zu tasks instead of %zu\n", n_run.load(),
+           kTasksPerRound * kRounds);
+  }
+  return secs * 1e9 / (kTasksPerRound * kRounds);
+}
+
+int main ()
+{
+  printf("%-36s  %10s\n", "", "ns/call");
+  printf("%-36s  %10.2f\n", "ProcState(), uncontended",
+         TimeProcState(false));
+  printf("%-36s  %10.2f\n", "ProcState(), observer holding lock",
+         TimeProcState(true));
+
+  TaskPool pool;
+  printf("%-36s  %10.2f\n",
+         ("TaskPool empty task, " + to_string(pool.n_workers()) +
+          " workers").c_str(),
+         TimeTasks(&pool));
+
+  return 0;
+}
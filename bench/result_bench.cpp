@@ -0,0 +1,75 @@
+#include <stdio.h>
+
+#include <string>
+
+#include "common/result.hpp"
+#include "common/time_measures.hpp"
+#include "bench/alloc_counter.hpp"
+
+using namespace std;
+using namespace evo;
+using namespace std_results;
+
+/** Measures what Result costs on the paths the tick loop takes: returning
+ and checking SUCCESS, e.g. "SUCCESS != (res = tick_handler_func_(...))";
+ copying an error on its way up the stack; and building an error message
+ out of a few Prepend()s.  Heap allocations are counted by replacing the
+ global operator new.
+ */
+
+static const int kIterations = 10 * 1000 * 1000;
+
+__attribute__((noinline)) static Result Succeed (int /*i*/)
+{
+  return SUCCESS;
+}
+
+__attribute__((noinline)) static Result FailDeep (int depth)
+{
+  if (0 == depth) {
+    return INVALID_ARGUMENT.Prepend("Tick interval must be positive");
+  }
+  Result res = FailDeep(depth - 1);
+  return res.Prepend("Couldn't advance the universe");
+}
+
+template <typename Func>
+static void Time (const char* label, Func func)
+{
+  const int64_t allocs_before = g_n_allocs.load();
+  const FastClock::Ticks start = FastClock::Now();
+  int n_failed = 0;
+  for (int i = 0; i < kIterations; ++i) {
+    n_failed += func(i);
+  }
+  const Duration elapsed = FastClock::ToDuration(FastClock::Now() - start);
+  const int64_t allocs = g_n_allocs.load() - allocs_before;
+
+  printf("%-36s  %10.2f  %10.2f  (%d failed)\n", label,
+         static_cast<double>(elapsed.Nanoseconds()) / kIterations,
+         static_cast<double>(allocs) / kIterations, n_failed);
+}
+
+int main ()
+{
+  printf("%-36s  %10s  %10s\n", "", "ns/iter", "allocs/iter");
+
+  Time("SUCCESS != (res = f())", [] (int i) {
+    Result res;
+    return (SUCCESS != (res = Succeed(i)) ? 1 : 0);
+  });
+
+  const Result error = FailDeep(2);
+  Time("copy an error with a message", [&] (int /*i*/) {
+    Result copy (error);
+    return (copy.is_error() ? 1 : 0);
+  });
+
+  Time("three-level Prepend() chain", [] (int /*i*/) {
+    return (FailDeep(2).is_error() ? 1 : 0);
+  });
+
+  printf("\n%s\n", error.ToString().c_str());
+
+  return 0;
+}
@@ -0,0 +1,101 @@
+#include <stdlib.h>
+#include <stdio.h>
+
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "common/result.hpp"
+#include "common/time_measures.hpp"
+#include "common/thread.hpp"
+
+using namespace std;
+using namespace evo;
+using namespace std_results;
+
+/** Measures the latency of UThread::RequestStateMultiple(kGo) for groups of
+ idle UThreads, i.e. the time from the call until every target has assumed
+ kGo and the call returns.  Each round puts the group back into kIdle with
+ another RequestStateMultiple(), which is timed as well.
+ */
+
+static const int kRounds = 200;
+
+struct Latencies
+{
+  double go_us;
+  double idle_us;
+};
+
+static Latencies Measure (int n_threads)
+{
+  vector<unique_ptr<UThread>> uthreads;
+  vector<UThread*> targets;
+
+  for (int i = 0; i < n_threads; ++i)
+  {
+    unique_ptr<UThread> uthread (new UThread("target-" + to_string(i),
+        [] (UThread* self) {
+          while (UThread::ProcStateResult::kContinue == self->ProcState()) {
+            // nothing to do; the cycle wait keeps us from hogging the CPUs
+          }
+          return SUCCESS;
+        }));
+    uthread->set_internal_logging_enabled(false);
+    uthread->set_cycle_wait_period(Duration::FromMilliseconds(1));
+    Result res = uthread->Start();
+    if (SUCCESS != res) {
+      printf("Couldn't start a target: %s\n", res.ToString().c_str());
+      exit(1);
+    }
+    targets.push_back(uthread.get());
+    uthreads.push_back(std::move(uthread));
+  }
+
+  vector<double> go_us;
+  vector<double> idle_us;
+
+  for (int r = 0; r < kRounds; ++r)
+  {
+    TimePoint start = TimePoint::Now();
+    Result res = UThread::RequestStateMultiple(targets, UThread::State::kGo);
+    go_us.push_back((TimePoint::Now() - start).Seconds() * 1e6);
+    if (SUCCESS != res) {
+      printf("RequestStateMultiple(kGo) failed: %s\n", res.ToString().c_str());
+      exit(1);
+    }
+
+    start = TimePoint::Now();
+    res = UThread::RequestStateMultiple(targets, UThread::State::kIdle);
+    idle_us.push_back((TimePoint::Now() - start).Seconds() * 1e6);
+    if (SUCCESS != res) {
+      printf("RequestStateMultiple(kIdle) failed: %s\n",
+             res.ToString().c_str());
+      exit(1);
+    }
+  }
+
+  // medians
+  sort(go_us.begin(), go_us.end());
+  sort(idle_us.begin(), idle_us.end());
+  Latencies latencies;
+  latencies.go_us = go_us[go_us.size() / 2];
+  latencies.idle_us = idle_us[idle_us.size() / 2];
+  return latencies;
+}
+
+int main ()
+{
+  printf("median over %d rounds\n", kRounds);
+  printf("%8s  %12s  %12s\n", "threads", "kGo (us)", "kIdle (us)");
+
+  for (int n_threads : { 1, 4, 16, 64 })
+  {
+    Latencies latencies = Measure(n_threads);
+    printf("%8d  %12.1f  %12.1f\n", n_threads, latencies.go_us,
+           latencies.idle_us);
+  }
+
+  return 0;
+}
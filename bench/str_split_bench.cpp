@@ -0,0 +1,131 @@
+#include <stdlib.h>
+#include <stdio.h>
+
+#include <random>
+#include <string>
+#include <vector>
+
+#include "common/string.hpp"
+#include "common/time_measures.hpp"
+#include "bench/keep_alive.hpp"
+
+using namespace std;
+using namespace evo;
+
+/** Measures splitting plain CSV, i.e. rows of numbers separated by commas,
+ with the copying StrExplode() and the lazy StrSplitView(), and parsing it
+ with both flavours of StrExplodeNum(): the one that fills a vector from
+ strtod()s of copied tokens, and the one that parses views into a buffer.
+ */
+
+static const int kRows = 200 * 1000;
+static const int kColumns = 16;
+static const int kPasses = 5;
+
+/** Folds every result into a sum, so that none can be optimized away
+ */
+template <typename PassFunc>
+static void Time (const char* label, const string& csv, PassFunc pass)
+{
+  double sum = 0;
+  const FastClock::Ticks start = FastClock::Now();
+  for (int i = 0; i < kPasses; ++i) {
+    sum += pass();
+  }
+  const Duration elapsed = FastClock::ToDuration(FastClock::Now() - start);
+
+  KeepAlive(sum);
+
+  const double ns = static_cast<double>(elapsed.Nanoseconds()) / kPasses;
+  printf("%-36s  %10.3f  %10.2f\n", label, csv.size() / ns,
+         ns / (kRows * kColumns));
+}
+
+int main ()
+{
+  mt19937 rng (42);
+  uniform_real_distribution<double> dist (-1000.0, 1000.0);
+
+  string csv;
+  vector<boost::string_view> rows;
+  vector<string> row_copies;
+  for (int row = 0; row < kRows; ++row)
+  {
+    string line;
+    for (int column = 0; column < kColumns; ++column)
+    {
+      char buf [32];
+      snprintf(buf, sizeof(buf), "%s%.3f", (column > 0 ? "," : ""),
+               dist(rng));
+      line += buf;
+    }
+    row_copies.push_back(line);
+    csv += line;
+    csv += '\n';
+  }
+  // the rows as views into csv, without their newlines
+  for (boost::string_view line : StrSplitView(csv, '\n')) {
+    if (!line.empty()) {
+      rows.push_back(line);
+    }
+  }
+
+  printf("%d rows of %d values, %.1f MB\n\n", kRows, kColumns,
+         csv.size() / 1e6);
+  printf("%-36s  %10s  %10s\n", "", "GB/s", "ns/value");
+
+  Time("StrExplode() by row", csv, [&] {
+    size_t n_tokens = 0;
+    vector<string> tokens;
+    for (const string& line : row_copies) {
+      tokens.clear();
+      n_tokens += StrExplode(line, ',', &tokens).size();
+    }
+    return n_tokens;
+  });
+
+  Time("StrSplitView() by row", csv, [&] {
+    size_t n_tokens = 0;
+    for (boost::string_view line : rows) {
+      for (boost::string_view token : StrSplitView(line, ',')) {
+        n_tokens += token.size();
+      }
+    }
+    return n_tokens;
+  });
+
+  Time("StrSplitView() over the whole file", csv, [&] {
+    size_t n_tokens = 0;
+    for (boost::string_view token : StrSplitView(csv, ',')) {
+      n_tokens += token.size();
+    }
+    return n_tokens;
+  });
+
+  Time("StrExplodeNum() into a vector", csv, [&] {
+    double sum = 0;
+    vector<double> values;
+    for (const string& line : row_copies) {
+      values.clear();
+      for (double value : StrExplodeNum(line, ',', &values)) {
+        sum += value;
+      }
+    }
+    return sum;
+  });
+
+  Time("StrExplodeNum() into a buffer", csv, [&] {
+    double sum = 0;
+    double values [kColumns];
+    for (boost::string_view line : rows)
+    {
+      ResultOr<size_t> n_values = StrExplodeNum(line, ',', values, kColumns);
+      for (size_t i = 0; i < n_values.value_or(0); ++i) {
+        sum += values[i];
+      }
+    }
+    return sum;
+  });
+
+  return 0;
+}
@@ -0,0 +1,116 @@
+#include <stdlib.h>
+#include <stdio.h>
+
+#include <thread>
+
+#include "common/result.hpp"
+#include "common/time_measures.hpp"
+#include "common/PlanckTicker.hpp"
+
+using namespace std;
+using namespace evo;
+using namespace std_results;
+
+/** Measures PlanckTicker's wake-up jitter (how late each tick handler starts
+ relative to its deadline) for a few tick intervals, sleeping all the way to
+ each deadline and with the spin-then-sleep hybrid; then, with a handler that
+ overruns every tenth tick, how each OverloadPolicy keeps virtual time.
+ */
+
+static const Duration kRunTime = Duration::FromSeconds(2);
+
+static PlanckTicker::TickStats Measure (Duration tick_interval,
+                                        Duration spin_margin)
+{
+  PlanckTicker ticker (tick_interval, [] (int, Duration, Duration) {
+    return SUCCESS;
+  });
+  ticker.set_spin_margin(spin_margin);
+
+  Result res = ticker.Start();
+  if (SUCCESS != res) {
+    printf("Couldn't start the ticker: %s\n", res.ToString().c_str());
+    exit(1);
+  }
+  this_thread::sleep_for(kRunTime.std_duration());
+  ticker.Stop();
+
+  return ticker.tick_stats();
+}
+
+/** Runs a ticker whose handler takes 2.5 intervals every tenth tick, and
+ returns its stats along with virtual time / real time at the end
+ */
+static PlanckTicker::TickStats MeasureOverload (
+    PlanckTicker::OverloadPolicy policy, double* virt_per_real_out)
+{
+  const Duration tick_interval = Duration::FromMilliseconds(5);
+  Duration last_virt (0);
+  Duration last_real (0);
+
+  PlanckTicker ticker (tick_interval, [&] (int tick, Duration virt,
+                                           Duration real) {
+    last_virt = virt;
+    last_real = real;
+    if (9 == tick % 10) {
+      this_thread::sleep_for((tick_interval * 5 / 2).std_duration());
+    }
+    return SUCCESS;
+  });
+  ticker.set_overload_policy(policy);
+
+  Result res = ticker.Start();
+  if (SUCCESS != res) {
+    printf("Couldn't start the ticker: %s\n", res.ToString().c_str());
+    exit(1);
+  }
+  this_thread::sleep_for(kRunTime.std_duration());
+  ticker.Stop();
+
+  *virt_per_real_out = last_virt / last_real;
+  return ticker.tick_stats();
+}
+
+int main ()
+{
+  printf("%10s  %10s  %8s  %10s  %10s  %10s  %8s\n", "interval", "spin",
+         "ticks", "mean (us)", "stddev", "max", "dropped");
+
+  for (double interval_ms : { 10.0, 1.0, 0.2 })
+  {
+    for (double spin_us : { 0.0, 100.0 })
+    {
+      PlanckTicker::TickStats stats =
+          Measure(Duration::FromMilliseconds(interval_ms),
+                  Duration::FromMicroseconds(spin_us));
+      printf("%8.1fms  %8.0fus  %8lld  %10.1f  %10.1f  %10.1f  %8lld\n",
+             interval_ms, spin_us, static_cast<long long>(stats.n_ticks),
+             stats.jitter_mean.Microseconds(),
+             stats.jitter_stddev.Microseconds(),
+             stats.jitter_max.Microseconds(),
+             static_cast<long long>(stats.n_dropped));
+    }
+  }
+
+  printf("\n5 ms ticks, every tenth taking 12.5 ms\n");
+  printf("%10s  %8s  %8s  %8s  %10s  %12s  %10s\n", "policy", "ticks",
+         "late", "dropped", "caught up", "stretched", "virt/real");
+
+  for (PlanckTicker::OverloadPolicy policy :
+       { PlanckTicker::OverloadPolicy::kCatchUp,
+         PlanckTicker::OverloadPolicy::kDrop,
+         PlanckTicker::OverloadPolicy::kStretch })
+  {
+    double virt_per_real = 0;
+    PlanckTicker::TickStats stats = MeasureOverload(policy, &virt_per_real);
+    printf("%10s  %8lld  %8lld  %8lld  %10lld  %10.0fms  %10.3f\n",
+           PlanckTicker::OverloadPolicyToString(policy).c_str(),
+           static_cast<long long>(stats.n_ticks),
+           static_cast<long long>(stats.n_late),
+           static_cast<long long>(stats.n_dropped),
+           static_cast<long long>(stats.n_caught_up),
+           stats.stretched.Milliseconds(), virt_per_real);
+  }
+
+  return 0;
+}
@@ -1,13 +1,59 @@
+#include <time.h>
+#include <cerrno>
+#include <cmath>
+#include <algorithm>
+#include <sstream>
+
 #include "common/result.hpp"
 #include "common/thread.hpp"
+#include "common/span_tracer.hpp"
 #include "common/PlanckTicker.hpp"
 
+using namespace std;
 using namespace evo;
 using namespace std_results;
 
-PlanckTicker :: PlanckTicker (Duration tick_interval)
+PlanckTicker::TickStats :: TickStats ()
+  : n_wakes(0),
+    n_ticks(0),
+    n_late(0),
+    n_dropped(0),
+    n_caught_up(0),
+    stretched(0),
+    jitter_min(0),
+    jitter_max(0),
+    jitter_mean(0),
+    jitter_stddev(0)
+{
+}
+
+string PlanckTicker::TickStats :: ToString () const
+{
+  std::stringstream strm;
+  strm << n_ticks << " ticks in " << n_wakes << " wake-ups, " << n_late
+       << " late, " << n_dropped << " dropped, " << n_caught_up
+       << " caught up, stretched by " << stretched.ToStringPretty()
+       << "; jitter min " << jitter_min.ToStringPretty()
+       << ", mean " << jitter_mean.ToStringPretty()
+       << ", max " << jitter_max.ToStringPretty()
+       << ", stddev " << jitter_stddev.ToStringPretty();
+  return strm.str();
+}
+
+PlanckTicker :: PlanckTicker (Duration tick_interval, TickHandlerFunc func)
   : tick_interval_(tick_interval),
-    start_time_(0)
+    start_time_(Duration(0)),
+    tick_handler_func_(func),
+    spin_margin_(0),
+    overload_policy_(OverloadPolicy::kCatchUp),
+    max_catch_up_(kDefaultMaxCatchUp),
+    stats_log_period_(0),
+    handler_histogram_(GetLatencyHistogram("PlanckTicker.handler")),
+    wake_latency_histogram_(GetLatencyHistogram("PlanckTicker.wake_latency")),
+    sleep_overshoot_histogram_(
+        GetLatencyHistogram("PlanckTicker.sleep_overshoot")),
+    jitter_mean_(0),
+    jitter_m2_(0)
 {
 }
 
@@ -16,25 +62,106 @@ PlanckTicker :: ~PlanckTicker ()
   Stop();
 }
 
+void PlanckTicker :: set_spin_margin (Duration margin)
+{
+  lock_guard<mutex> lock (mutex_);
+  spin_margin_ = margin;
+}
+
+Duration PlanckTicker :: spin_margin () const
+{
+  lock_guard<mutex> lock (mutex_);
+  return spin_margin_;
+}
+
+void PlanckTicker :: set_overload_policy (OverloadPolicy policy)
+{
+  lock_guard<mutex> lock (mutex_);
+  overload_policy_ = policy;
+}
+
+PlanckTicker::OverloadPolicy PlanckTicker :: overload_policy () const
+{
+  lock_guard<mutex> lock (mutex_);
+  return overload_policy_;
+}
+
+void PlanckTicker :: set_max_catch_up (int max_ticks)
+{
+  lock_guard<mutex> lock (mutex_);
+  max_catch_up_ = std::max(max_ticks, 1);
+}
+
+int PlanckTicker :: max_catch_up () const
+{
+  lock_guard<mutex> lock (mutex_);
+  return max_catch_up_;
+}
+
+void PlanckTicker :: set_stats_log_period (Duration period)
+{
+  lock_guard<mutex> lock (mutex_);
+  stats_log_period_ = period;
+}
+
+Duration PlanckTicker :: stats_log_period () const
+{
+  lock_guard<mutex> lock (mutex_);
+  return stats_log_period_;
+}
+
+PlanckTicker::TickStats PlanckTicker :: tick_stats () const
+{
+  lock_guard<mutex> lock (mutex_);
+  return tick_stats_;
+}
+
+void PlanckTicker :: ResetTickStats ()
+{
+  lock_guard<mutex> lock (mutex_);
+  tick_stats_ = TickStats();
+  jitter_mean_ = 0;
+  jitter_m2_ = 0;
+}
+
 Result PlanckTicker :: Start ()
 {
+  Result res;
+
   if (thread_) {
     return STATE_ALREADY_EFFECTIVE.Prepend(
         "Thread has already been started; call Stop() first");
   }
+  if (tick_interval_ <= Duration(0)) {
+    return INVALID_ARGUMENT.Prepend("Tick interval must be positive");
+  }
+
+  ResetTickStats();
 
   thread_.reset( new UThread("PlanckTicker",
       std::bind(&PlanckTicker::ThreadFunc, this, std::placeholders::_1)) );
 
-  thread_->set_cycle_wait_type(UThread::CycleWait::kAbsolute);
-  thread_->set_cycle_wait_period(tick_interval_);
+  // the ticker keeps its own schedule; ProcState() mustn't sleep on top
+  thread_->set_cycle_wait_period(Duration(0));
+  thread_->set_cycle_stats_enabled(true);
+
+  // before the thread exists, so that it never sees a stale value
+  start_time_ = SteadyTimePoint::Now();
 
-  return thread_->Start();
+  if (SUCCESS != (res = thread_->Start()) ||
+      SUCCESS != (res = thread_->Run(opt::Blocking::kOff))) {
+    thread_.reset();
+    return res.Prepend("Couldn't start the ticker thread");
+  }
+
+  return SUCCESS;
 }
 
 Result PlanckTicker :: Stop ()
 {
+  // the UThread's destructor requests kExiting and joins
   thread_.reset();
+  return SUCCESS;
 }
 
 Result PlanckTicker :: ThreadFunc (UThread* uthread)
@@ -43,21 +170,158 @@ Result PlanckTicker :: ThreadFunc (UThread* uthread)
 
   int tick_index = 0;
 
-  start_time_ = TimePoint::Now();
+  // deadline k is due at origin + k * tick_interval_; kStretch moves origin
+  SteadyTimePoint origin = start_time_;
+  int64_t deadline_index = 0;
 
   while (UThread::ProcStateResult::kContinue == uthread->ProcState())
   {
-    TimePoint tick_real_time (TimePoint::Now() - start_time_);
-    TimePoint tick_virt_time = tick_index * tick_interval_;
+    WaitUntil(origin + tick_interval_ * deadline_index);
+
+    const SteadyTimePoint now = SteadyTimePoint::Now();
+
+    // deadlines passed, i.e. ticks owed, including the one just waited for
+    const int64_t n_due = std::max<int64_t>(
+        (now - origin).Nanoseconds() / tick_interval_.Nanoseconds()
+            - deadline_index + 1,
+        1);
+    const Duration jitter =
+        now - (origin + tick_interval_ * (deadline_index + n_due - 1));
+
+    OverloadPolicy policy;
+    int64_t max_ticks;
+    Duration log_period;
+    {
+      lock_guard<mutex> lock (mutex_);
+      policy = overload_policy_;
+      max_ticks = max_catch_up_;
+      log_period = stats_log_period_;
+    }
 
-    if (SUCCESS != (res = tick_handler_func_(
-            tick_index, tick_virt_time, tick_real_time))) {
-      return res.Prepend("Planck tick handler failed");
+    int64_t n_ticks = 1;
+    int64_t n_dropped = 0;
+    Duration stretched (0);
+    switch (policy)
+    {
+    case OverloadPolicy::kCatchUp:
+      n_ticks = std::min(n_due, max_ticks);
+      n_dropped = n_due - n_ticks;
+      break;
+    case OverloadPolicy::kDrop:
+      n_dropped = n_due - 1;
+      break;
+    case OverloadPolicy::kStretch:
+      stretched = tick_interval_ * (n_due - 1);
+      origin += stretched;
+      break;
     }
+    RecordWake(jitter, n_due, n_ticks, n_dropped, stretched);
+    wake_latency_histogram_->Record(jitter);
 
-    ++tick_index;
+    // the oldest deadlines are the ones dropped
+    deadline_index += n_dropped;
+
+    for (int64_t k = 0; k < n_ticks; ++k)
+    {
+      const Duration tick_real_time =
+          (origin - start_time_) + tick_interval_ * deadline_index;
+      const Duration tick_virt_time = tick_interval_ * tick_index;
+
+      {
+        ScopedLatencyTimer timer (handler_histogram_);
+        ScopedSpan span ("PlanckTicker.tick");
+        res = tick_handler_func_(tick_index, tick_virt_time, tick_real_time);
+      }
+      if (SUCCESS != res) {
+        return res.Prepend("Planck tick handler failed");
+      }
+
+      ++tick_index;
+      ++deadline_index;
+    }
+
+    if (log_period > Duration(0)) {
+      LogStatsPeriodically(log_period);
+    }
   }
 
   return SUCCESS;
 }
 
+void PlanckTicker :: WaitUntil (SteadyTimePoint deadline)
+{
+  const Duration margin = spin_margin();
+  const SteadyTimePoint wake_time = deadline - margin;
+
+  // libstdc++'s steady_clock is CLOCK_MONOTONIC, so its epoch is the one
+  // clock_nanosleep() expects
+  const int64_t wake_ns = wake_time.since_epoch().Nanoseconds();
+  struct timespec ts;
+  ts.tv_sec = wake_ns / 1000000000;
+  ts.tv_nsec = wake_ns % 1000000000;
+
+  // when already past it, e.g. while catching up, there is no sleep to
+  // measure
+  if (wake_time > SteadyTimePoint::Now())
+  {
+    // returns the error number rather than setting errno
+    while (EINTR == clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts,
+                                    nullptr)) {
+    }
+    sleep_overshoot_histogram_->Record(SteadyTimePoint::Now() - wake_time);
+  }
+
+  if (margin > Duration(0)) {
+    while (SteadyTimePoint::Now() < deadline) {
+      // spin
+    }
+  }
+}
+
+void PlanckTicker :: RecordWake (Duration jitter, int64_t n_due,
+                                  int64_t n_ticks, int64_t n_dropped,
+                                  Duration stretched)
+{
+  lock_guard<mutex> lock (mutex_);
+
+  TickStats& stats = tick_stats_;
+  if (0 == stats.n_wakes) {
+    stats.jitter_min = jitter;
+    stats.jitter_max = jitter;
+  } else {
+    stats.jitter_min = std::min(stats.jitter_min, jitter);
+    stats.jitter_max = std::max(stats.jitter_max, jitter);
+  }
+  ++stats.n_wakes;
+  stats.n_ticks += n_ticks;
+  if (n_due > 1) {
+    ++stats.n_late;
+  }
+  stats.n_dropped += n_dropped;
+  stats.n_caught_up += n_ticks - 1;
+  stats.stretched += stretched;
+
+  // Welford's online mean and variance
+  const double x = static_cast<double>(jitter.Nanoseconds());
+  const double delta = x - jitter_mean_;
+  jitter_mean_ += delta / stats.n_wakes;
+  jitter_m2_ += delta * (x - jitter_mean_);
+
+  stats.jitter_mean = Duration(static_cast<int64_t>(jitter_mean_));
+  stats.jitter_stddev = Duration(static_cast<int64_t>(
+      sqrt(jitter_m2_ / stats.n_wakes)));
+}
+
+string PlanckTicker :: OverloadPolicyToString (OverloadPolicy policy)
+{
+  switch (policy)
+  {
+  case OverloadPolicy::kCatchUp:
+    return "catch-up";
+  case OverloadPolicy::kDrop:
+    return "drop";
+  case OverloadPolicy::kStretch:
+    return "stretch";
+  }
+  return "Unknown overload policy";
+}
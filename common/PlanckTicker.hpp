@@ -1,38 +1,192 @@
+#ifndef COMMON_PLANCK_TICKER_HPP
+#define COMMON_PLANCK_TICKER_HPP
+
+#include <functional>
 #include <memory>
+#include <mutex>
 #include "common/util.hpp"
+#include "common/time_measures.hpp"
 #include "common/thread.hpp"
+#include "common/latency_histogram.hpp"
 
 namespace evo {
 
 /** Triggers rendering lib's display() at regular intervals
+
+ Tick k is due at start_time() + k * tick_interval on the monotonic clock,
+ so wall clock adjustments don't disturb it and lateness doesn't accumulate.
+ The ticker thread sleeps until each deadline with
+ clock_nanosleep(TIMER_ABSTIME); with a spin margin set, it sleeps only until
+ that much before the deadline and busy-waits the rest, which trades a CPU
+ for sub-millisecond accuracy.
+
+ Each wake-up works like a fixed-step accumulator: every deadline that has
+ passed owes one tick (one fixed step of virtual time).  Normally that is
+ exactly one, but when the handler overruns, the OverloadPolicy decides what
+ happens to the backlog.
+
+ The ticker thread only checks for Stop() between wake-ups, so stopping can
+ take up to one tick interval (plus any catch-up ticks).
+
+ Besides TickStats, every wake-up and handler call goes into the histograms
+ "PlanckTicker.wake_latency" (the jitter), "PlanckTicker.sleep_overshoot"
+ (how late clock_nanosleep() returned) and "PlanckTicker.handler" (see
+ GetLatencyHistogram()), and the ticker thread's UThread cycles are timed
+ too (see UThread::set_cycle_stats_enabled()).
  */
 class PlanckTicker
 {
 public:
 
   /** Args: int tick_count, Duration virtual_time, Duration real_time
+   virtual_time is always tick_count * tick interval.  real_time is the
+   tick's scheduled time since start_time(), which runs ahead of
+   virtual_time as ticks are dropped or stretched.
   */
   typedef std::function<Result (int, Duration, Duration)>
       TickHandlerFunc;
 
+  /** What to do with the deadlines that pass while a tick overruns
+   */
+  enum class OverloadPolicy
+  {
+    kCatchUp,  ///< run one tick per missed deadline, back to back, up to
+               ///  max_catch_up() per wake-up; drop the rest
+    kDrop,     ///< run one tick and skip the missed deadlines
+    kStretch   ///< run one tick and push the schedule back, so virtual time
+               ///  slows down relative to real time
+  };
+
+  /** Counters since Start() or ResetTickStats()
+   */
+  struct TickStats
+  {
+    TickStats ();
+
+    std::string ToString () const;
+
+    int64_t n_wakes;
+
+    /** Tick handler calls
+    */
+    int64_t n_ticks;
+
+    /** Wake-ups that found more than one deadline past
+    */
+    int64_t n_late;
+
+    /** Missed deadlines skipped, under kDrop or beyond the catch-up cap
+    */
+    int64_t n_dropped;
+
+    /** Extra ticks run back to back under kCatchUp
+    */
+    int64_t n_caught_up;
+
+    /** How far kStretch has pushed the schedule back in total
+    */
+    Duration stretched;
+
+    /** Wake-up time minus the latest deadline passed, per wake-up
+    */
+    Duration jitter_min;
+    Duration jitter_max;
+    Duration jitter_mean;
+    Duration jitter_stddev;
+  };
+
   PlanckTicker (Duration tick_interval, TickHandlerFunc func);
 
   virtual ~PlanckTicker ();
 
-  TimePoint start_time () const {
+  Duration tick_interval () const {
+    return tick_interval_;
+  }
+
+  /** Monotonic time of tick 0, set by Start()
+   */
+  SteadyTimePoint start_time () const {
     return start_time_;
   }
 
+  /** Busy-wait for the last \p margin before each deadline instead of
+   sleeping; zero (the default) sleeps all the way.  Takes effect with the
+   next tick.
+   */
+  void set_spin_margin (Duration margin);
+
+  Duration spin_margin () const;
+
+  void set_overload_policy (OverloadPolicy policy);
+
+  OverloadPolicy overload_policy () const;
+
+  /** Most ticks run per wake-up under kCatchUp; at least 1.  Defaults to
+   kDefaultMaxCatchUp.
+   */
+  void set_max_catch_up (int max_ticks);
+
+  int max_catch_up () const;
+
+  TickStats tick_stats () const;
+
+  /** Have the ticker thread LogStatsPeriodically() with \p period; zero (the
+   default) turns that off.
+   */
+  void set_stats_log_period (Duration period);
+
+  Duration stats_log_period () const;
+
+  void ResetTickStats ();
+
+  static std::string OverloadPolicyToString (OverloadPolicy policy);
+
+  static const int kDefaultMaxCatchUp = 4;
+
   Result Start ();
 
   Result Stop ();
 
 private:
 
+  Result ThreadFunc (UThread* uthread);
+
+  /** Sleeps (and spins, per spin_margin_) until \p deadline, recording how
+   late the sleep itself ended in sleep_overshoot_histogram_
+   */
+  void WaitUntil (SteadyTimePoint deadline);
+
+  /** Folds one wake-up into tick_stats_
+   */
+  void RecordWake (Duration jitter, int64_t n_due, int64_t n_ticks,
+                   int64_t n_dropped, Duration stretched);
+
   Duration tick_interval_;
-  Duration start_time_;
+  SteadyTimePoint start_time_;
   std::shared_ptr<UThread> thread_;
   TickHandlerFunc tick_handler_func_;
+
+  /** Guards the settings and tick_stats_, which the ticker thread reads and
+   updates once per wake-up
+   */
+  mutable std::mutex mutex_;
+  Duration spin_margin_;
+  OverloadPolicy overload_policy_;
+  int max_catch_up_;
+  Duration stats_log_period_;
+  TickStats tick_stats_;
+
+  LatencyHistogram* handler_histogram_;
+  LatencyHistogram* wake_latency_histogram_;
+  LatencyHistogram* sleep_overshoot_histogram_;
+
+  /** Unrounded mean jitter and running sum of squared deviations from it
+   (Welford), in ns and ns^2
+  */
+  double jitter_mean_;
+  double jitter_m2_;
 };
 
 }
+
+#endif
@@ -0,0 +1,90 @@
+#ifndef COMMON_ALIGNED_ALLOCATOR_HPP
+#define COMMON_ALIGNED_ALLOCATOR_HPP
+
+#include <stdlib.h>
+#include <cstddef>
+#include <new>
+#include <vector>
+
+namespace evo {
+
+/** Size of a cache line on every x86-64 part we care about; also the widest
+ SIMD register (AVX-512), so arrays aligned to this are suitable for aligned
+ vector loads as well.
+ */
+static const size_t kCacheLineSize = 64;
+
+/** Minimal C++11 allocator that hands out storage aligned to \p Alignment
+ bytes, so that std::vector can be used for SIMD-friendly, cache-line-aligned
+ arrays.
+ */
+template <typename T, size_t Alignment = kCacheLineSize>
+class AlignedAllocator
+{
+public:
+
+  typedef T value_type;
+
+  template <typename U>
+  struct rebind {
+    typedef AlignedAllocator<U, Alignment> other;
+  };
+
+  AlignedAllocator ()
+  {}
+
+  template <typename U>
+  AlignedAllocator (const AlignedAllocator<U, Alignment>&)
+  {}
+
+  T* allocate (size_t n) {
+    void* mem = nullptr;
+    if (0 != posix_memalign(&mem, Alignment, n * sizeof(T))) {
+      throw std::bad_alloc();
+    }
+    return static_cast<T*>(mem);
+  }
+
+  void deallocate (T* ptr, size_t) {
+    free(ptr);
+  }
+
+  template <typename U>
+  bool operator == (const AlignedAllocator<U, Alignment>&) const {
+    return true;
+  }
+
+  template <typename U>
+  bool operator != (const AlignedAllocator<U, Alignment>&) const {
+    return false;
+  }
+};
+
+/** Writes a zero byte to each page of the \p size bytes at \p block, so
+ that the kernel backs them with memory local to the calling thread's NUMA
+ node (Linux places a page where it is first touched).  \p block must be
+ raw storage that holds no objects, e.g. an allocator's block past the
+ elements constructed in it; the bytes are overwritten whenever objects are
+ constructed there.
+ */
+inline void TouchPages (void* block, size_t size)
+{
+  static const size_t kPageSize = 4096;
+
+  unsigned char* bytes = static_cast<unsigned char*>(block);
+  for (size_t i = 0; i < size; i += kPageSize) {
+    bytes[i] = 0;
+  }
+  // the stride can step over the start of the last page
+  if (size > 0) {
+    bytes[size - 1] = 0;
+  }
+}
+
+/** A contiguous, cache-line-aligned array of floats.
+ */
+typedef std::vector<float, AlignedAllocator<float>> AlignedFloatVector;
+
+}
+
+#endif
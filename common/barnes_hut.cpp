@@ -0,0 +1,393 @@
+
+#include <cmath>
+#include <cassert>
+#include <algorithm>
+#include <limits>
+
+#include "common/barnes_hut.hpp"
+
+using namespace std;
+using namespace evo;
+using namespace std_results;
+
+/** Bits of resolution per axis in the Morton keys; 3*21 = 63 bits
+ */
+static const int kMortonBitsPerAxis = 21;
+
+/** Deepest level the tree is ever split to; cells below this could no longer
+ be told apart by their Morton keys
+ */
+static const int kMaxDepth = kMortonBitsPerAxis;
+
+/** Spreads the low 21 bits of \p val so that there are two zero bits between
+ each of them.
+ */
+static inline uint64_t SpreadBits (uint64_t val)
+{
+  val &= 0x1fffff;
+  val = (val | val << 32) & 0x1f00000000ffffULL;
+  val = (val | val << 16) & 0x1f0000ff0000ffULL;
+  val = (val | val << 8)  & 0x100f00f00f00f00fULL;
+  val = (val | val << 4)  & 0x10c30c30c30c30c3ULL;
+  val = (val | val << 2)  & 0x1249249249249249ULL;
+  return val;
+}
+
+static inline uint32_t Quantize (float val, float min, float scale)
+{
+  float q = (val - min) * scale;
+  if (q < 0) {
+    q = 0;
+  }
+  const float max_q = static_cast<float>((1 << kMortonBitsPerAxis) - 1);
+  if (q > max_q) {
+    q = max_q;
+  }
+  return static_cast<uint32_t>(q);
+}
+
+BarnesHutGravity :: BarnesHutGravity (float theta)
+  : theta_(theta),
+    softening_(kDefaultSoftening),
+    leaf_capacity_(kDefaultLeafCapacity)
+{
+}
+
+BarnesHutGravity :: ~BarnesHutGravity ()
+{
+}
+
+Result BarnesHutGravity :: ComputeAccelerations (double G, ParticleStore* things)
+{
+  if (!things) {
+    return INVALID_ARGUMENT.Prepend("BarnesHutGravity: things is null");
+  }
+
+  const size_t n = things->size();
+
+  if (n > static_cast<size_t>(numeric_limits<uint32_t>::max())) {
+    return INVALID_SIZE.Prepend("BarnesHutGravity: too many bodies");
+  }
+
+  things->ZeroAccelerations();
+
+  if (n < 2) {
+    return SUCCESS;
+  }
+
+  Build(*things);
+
+  float* ax = things->ax();
+  float* ay = things->ay();
+  float* az = things->az();
+  const float g = static_cast<float>(G);
+
+  // walking in Morton order keeps consecutive walks on nearly the same path
+  // through the tree, so most of it stays in cache
+  for (uint32_t k = 0; k < n; ++k)
+  {
+    const uint32_t i = order_[k];
+    AccumulateForBody(k, g, &ax[i], &ay[i], &az[i]);
+  }
+
+  return SUCCESS;
+}
+
+Result BarnesHutGravity :: ComputeAccelerationsFor (double G,
+                                                    ParticleStore* things,
+                                                    const uint32_t* targets,
+                                                    size_t n_targets)
+{
+  if (!things) {
+    return INVALID_ARGUMENT.Prepend("BarnesHutGravity: things is null");
+  }
+
+  const size_t n = things->size();
+
+  if (n > static_cast<size_t>(numeric_limits<uint32_t>::max())) {
+    return INVALID_SIZE.Prepend("BarnesHutGravity: too many bodies");
+  }
+
+  float* ax = things->ax();
+  float* ay = things->ay();
+  float* az = things->az();
+
+  for (size_t t = 0; t < n_targets; ++t) {
+    const uint32_t i = targets[t];
+    ax[i] = ay[i] = az[i] = 0;
+  }
+
+  if (n < 2) {
+    return SUCCESS;
+  }
+
+  Build(*things);
+
+  rank_.resize(n);
+  for (uint32_t k = 0; k < n; ++k) {
+    rank_[order_[k]] = k;
+  }
+
+  // walk the targets in Morton order too, for the same cache benefit as in
+  // ComputeAccelerations()
+  target_ranks_.resize(n_targets);
+  for (size_t t = 0; t < n_targets; ++t) {
+    target_ranks_[t] = rank_[targets[t]];
+  }
+  sort(target_ranks_.begin(), target_ranks_.end());
+
+  const float g = static_cast<float>(G);
+  for (uint32_t k : target_ranks_)
+  {
+    const uint32_t i = order_[k];
+    AccumulateForBody(k, g, &ax[i], &ay[i], &az[i]);
+  }
+
+  return SUCCESS;
+}
+
+void BarnesHutGravity :: Build (const ParticleStore& things)
+{
+  const size_t n = things.size();
+  const float* x = things.x();
+  const float* y = things.y();
+  const float* z = things.z();
+  const float* mass = things.mass();
+
+  // bounding cube
+  float min_x = x[0], max_x = x[0];
+  float min_y = y[0], max_y = y[0];
+  float min_z = z[0], max_z = z[0];
+  for (size_t i = 1; i < n; ++i)
+  {
+    min_x = min(min_x, x[i]);
+    max_x = max(max_x, x[i]);
+    min_y = min(min_y, y[i]);
+    max_y = max(max_y, y[i]);
+    min_z = min(min_z, z[i]);
+    max_z = max(max_z, z[i]);
+  }
+  float root_size = max(max_x - min_x, max(max_y - min_y, max_z - min_z));
+  if (root_size <= 0) {
+    root_size = 1;
+  }
+  // a little slack so the maximum coordinate doesn't land exactly on the
+  // cube's far face
+  root_size *= 1.0001f;
+  const float scale = (1 << kMortonBitsPerAxis) / root_size;
+
+  sort_scratch_.resize(n);
+  for (size_t i = 0; i < n; ++i)
+  {
+    uint64_t key =
+        (SpreadBits(Quantize(x[i], min_x, scale)) << 2)
+      | (SpreadBits(Quantize(y[i], min_y, scale)) << 1)
+      |  SpreadBits(Quantize(z[i], min_z, scale));
+    sort_scratch_[i] = make_pair(key, static_cast<uint32_t>(i));
+  }
+  sort(sort_scratch_.begin(), sort_scratch_.end());
+
+  keys_.resize(n);
+  order_.resize(n);
+  sorted_x_.resize(n);
+  sorted_y_.resize(n);
+  sorted_z_.resize(n);
+  sorted_mass_.resize(n);
+  for (size_t k = 0; k < n; ++k)
+  {
+    const uint32_t i = sort_scratch_[k].second;
+    keys_[k] = sort_scratch_[k].first;
+    order_[k] = i;
+    sorted_x_[k] = x[i];
+    sorted_y_[k] = y[i];
+    sorted_z_[k] = z[i];
+    sorted_mass_[k] = mass[i];
+  }
+
+  nodes_.clear();
+  nodes_.reserve(2 * n / leaf_capacity_ + 16);
+
+  Node root;
+  root.size = root_size;
+  root.begin = 0;
+  root.end = static_cast<uint32_t>(n);
+  nodes_.push_back(root);
+
+  BuildNode(0, 0);
+}
+
+void BarnesHutGravity :: BuildNode (int32_t node_index, int depth)
+{
+  // NOTE: nodes_ may reallocate during recursion, so never hold a Node&
+  // across a call to BuildNode()
+  const uint32_t begin = nodes_[node_index].begin;
+  const uint32_t end   = nodes_[node_index].end;
+
+  nodes_[node_index].first_child = -1;
+  nodes_[node_index].n_children = 0;
+
+  if (static_cast<int>(end - begin) > leaf_capacity_ && depth < kMaxDepth)
+  {
+    // bodies are sorted by Morton key and all share the same key prefix down
+    // to this depth, so each octant occupies a contiguous run
+    const int shift = 3 * (kMortonBitsPerAxis - 1 - depth);
+    uint32_t bounds[9];
+    bounds[0] = begin;
+    for (int oct = 0; oct < 8; ++oct)
+    {
+      uint32_t lo = bounds[oct];
+      uint32_t hi = end;
+      while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (static_cast<int>((keys_[mid] >> shift) & 7) <= oct) {
+          lo = mid + 1;
+        } else {
+          hi = mid;
+        }
+      }
+      bounds[oct+1] = lo;
+    }
+
+    int n_children = 0;
+    for (int oct = 0; oct < 8; ++oct) {
+      if (bounds[oct+1] > bounds[oct]) {
+        ++n_children;
+      }
+    }
+
+    const int32_t first_child = static_cast<int32_t>(nodes_.size());
+    const float child_size = nodes_[node_index].size * 0.5f;
+
+    for (int oct = 0; oct < 8; ++oct)
+    {
+      if (bounds[oct+1] > bounds[oct]) {
+        Node child;
+        child.size = child_size;
+        child.begin = bounds[oct];
+        child.end = bounds[oct+1];
+        nodes_.push_back(child);
+      }
+    }
+
+    nodes_[node_index].first_child = first_child;
+    nodes_[node_index].n_children = n_children;
+
+    double m = 0, mx = 0, my = 0, mz = 0;
+    for (int c = 0; c < n_children; ++c)
+    {
+      BuildNode(first_child + c, depth + 1);
+      const Node& child = nodes_[first_child + c];
+      m  += child.mass;
+      mx += static_cast<double>(child.mass) * child.com_x;
+      my += static_cast<double>(child.mass) * child.com_y;
+      mz += static_cast<double>(child.mass) * child.com_z;
+    }
+
+    Node& node = nodes_[node_index];
+    node.mass = static_cast<float>(m);
+    if (m > 0) {
+      node.com_x = static_cast<float>(mx / m);
+      node.com_y = static_cast<float>(my / m);
+      node.com_z = static_cast<float>(mz / m);
+    } else {
+      node.com_x = sorted_x_[begin];
+      node.com_y = sorted_y_[begin];
+      node.com_z = sorted_z_[begin];
+    }
+  }
+  else
+  {
+    double m = 0, mx = 0, my = 0, mz = 0;
+    for (uint32_t k = begin; k < end; ++k)
+    {
+      m  += sorted_mass_[k];
+      mx += static_cast<double>(sorted_mass_[k]) * sorted_x_[k];
+      my += static_cast<double>(sorted_mass_[k]) * sorted_y_[k];
+      mz += static_cast<double>(sorted_mass_[k]) * sorted_z_[k];
+    }
+
+    Node& node = nodes_[node_index];
+    node.mass = static_cast<float>(m);
+    if (m > 0) {
+      node.com_x = static_cast<float>(mx / m);
+      node.com_y = static_cast<float>(my / m);
+      node.com_z = static_cast<float>(mz / m);
+    } else {
+      node.com_x = sorted_x_[begin];
+      node.com_y = sorted_y_[begin];
+      node.com_z = sorted_z_[begin];
+    }
+  }
+}
+
+void BarnesHutGravity :: AccumulateForBody (uint32_t k, float G,
+    float* ax_out, float* ay_out, float* az_out) const
+{
+  const float xi = sorted_x_[k];
+  const float yi = sorted_y_[k];
+  const float zi = sorted_z_[k];
+  const float eps2 = softening_ * softening_;
+  const float theta2 = theta_ * theta_;
+
+  float ax = 0, ay = 0, az = 0;
+
+  // each level pushes at most 8 children and pops one
+  int32_t stack [8 * (kMaxDepth + 1)];
+  int sp = 0;
+  stack[sp++] = 0;
+
+  while (sp > 0)
+  {
+    const Node& node = nodes_[stack[--sp]];
+
+    if (node.n_children > 0)
+    {
+      const float dx = node.com_x - xi;
+      const float dy = node.com_y - yi;
+      const float dz = node.com_z - zi;
+      const float r2 = dx*dx + dy*dy + dz*dz;
+
+      if (node.size * node.size < theta2 * r2)
+      {
+        // far enough away to be treated as a point mass
+        const float d2 = r2 + eps2;
+        const float inv_d = 1.0f / sqrtf(d2);
+        const float s = node.mass * inv_d * inv_d * inv_d;
+        ax += dx * s;
+        ay += dy * s;
+        az += dz * s;
+      }
+      else
+      {
+        for (int c = 0; c < node.n_children; ++c) {
+          stack[sp++] = node.first_child + c;
+        }
+      }
+    }
+    else
+    {
+      for (uint32_t j = node.begin; j < node.end; ++j)
+      {
+        if (j == k) {
+          continue;
+        }
+        const float dx = sorted_x_[j] - xi;
+        const float dy = sorted_y_[j] - yi;
+        const float dz = sorted_z_[j] - zi;
+        const float d2 = dx*dx + dy*dy + dz*dz + eps2;
+        if (d2 <= 0) {
+          continue; // coincident bodies without softening
+        }
+        const float inv_d = 1.0f / sqrtf(d2);
+        const float s = sorted_mass_[j] * inv_d * inv_d * inv_d;
+        ax += dx * s;
+        ay += dy * s;
+        az += dz * s;
+      }
+    }
+  }
+
+  *ax_out = G * ax;
+  *ay_out = G * ay;
+  *az_out = G * az;
+}
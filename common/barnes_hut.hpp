@@ -0,0 +1,139 @@
+#ifndef COMMON_BARNES_HUT_HPP
+#define COMMON_BARNES_HUT_HPP
+
+#include <cstdint>
+#include <vector>
+
+#include "common/aligned_allocator.hpp"
+#include "common/i_force_engine.hpp"
+#include "common/particle_store.hpp"
+#include "common/result.hpp"
+
+namespace evo {
+
+/** Barnes-Hut gravity solver.  Every call to ComputeAccelerations() sorts the
+ bodies along a Morton (Z-order) curve, builds an octree over the sorted
+ order, and then walks the tree once per body, treating any cell that
+ subtends an angle smaller than theta as a single point mass at its center
+ of mass.  Cost is O(N log N) per call.
+ */
+class BarnesHutGravity : public IForceEngine
+{
+public:
+
+  static constexpr float kDefaultTheta = 0.5f;
+  static constexpr float kDefaultSoftening = 0.0f;
+  static const int kDefaultLeafCapacity = 8;
+
+  /** @param theta Opening angle; 0 degenerates to direct summation, larger
+   values are faster and less accurate.
+   */
+  explicit BarnesHutGravity (float theta = kDefaultTheta);
+
+  virtual ~BarnesHutGravity ();
+
+  float theta () const {
+    return theta_;
+  }
+
+  void set_theta (float val) {
+    theta_ = val;
+  }
+
+  /** Plummer softening length; pairwise accelerations are computed as
+   G*m*r / (|r|^2 + softening^2)^(3/2).
+   */
+  float softening () const {
+    return softening_;
+  }
+
+  void set_softening (float val) {
+    softening_ = val;
+  }
+
+  /** Maximum number of bodies held by a leaf cell before it is split.
+   */
+  int leaf_capacity () const {
+    return leaf_capacity_;
+  }
+
+  void set_leaf_capacity (int val) {
+    leaf_capacity_ = (val < 1 ? 1 : val);
+  }
+
+  /** Number of cells in the most recently built tree.
+   */
+  size_t node_count () const {
+    return nodes_.size();
+  }
+
+  virtual Result ComputeAccelerations (double G, ParticleStore* things) override;
+
+  /** The tree is still built over every body; only the walks are limited to
+   \p targets.
+   */
+  virtual Result ComputeAccelerationsFor (double G, ParticleStore* things,
+                                          const uint32_t* targets,
+                                          size_t n_targets) override;
+
+private:
+
+  struct Node
+  {
+    /** Center of mass and total mass of all bodies within the cell
+     */
+    float com_x;
+    float com_y;
+    float com_z;
+    float mass;
+
+    /** Edge length of the cell
+     */
+    float size;
+
+    /** Range of the cell's bodies within the Morton-sorted arrays
+     */
+    uint32_t begin;
+    uint32_t end;
+
+    /** Index of the first of n_children contiguous child cells; leaves have
+     no children
+     */
+    int32_t first_child;
+    int32_t n_children;
+  };
+
+  void Build (const ParticleStore& things);
+
+  void BuildNode (int32_t node_index, int depth);
+
+  void AccumulateForBody (uint32_t sorted_index, float G,
+                          float* ax_out, float* ay_out, float* az_out) const;
+
+  float theta_;
+  float softening_;
+  int leaf_capacity_;
+
+  std::vector<Node> nodes_;
+
+  std::vector<uint64_t> keys_;
+  std::vector<uint32_t> order_;
+
+  /** Inverse of order_, and the Morton ranks of the current targets
+   */
+  std::vector<uint32_t> rank_;
+  std::vector<uint32_t> target_ranks_;
+  std::vector<std::pair<uint64_t, uint32_t>> sort_scratch_;
+
+  /** Positions and masses permuted into Morton order so that leaf loops read
+   contiguous memory
+   */
+  AlignedFloatVector sorted_x_;
+  AlignedFloatVector sorted_y_;
+  AlignedFloatVector sorted_z_;
+  AlignedFloatVector sorted_mass_;
+};
+
+}
+
+#endif
@@ -0,0 +1,273 @@
+
+#include <cmath>
+#include <algorithm>
+#include <limits>
+
+#include "common/block_timestep_integrator.hpp"
+
+using namespace std;
+using namespace evo;
+using namespace std_results;
+
+// min() takes it by reference
+const int BlockTimestepIntegrator :: kMaxMaxLevel;
+
+BlockTimestepIntegrator :: BlockTimestepIntegrator (TaskPool* pool)
+  : pool_(pool),
+    max_level_(kDefaultMaxLevel),
+    eta_(kDefaultEta),
+    length_scale_(0),
+    accelerations_valid_(false),
+    by_level_(kMaxMaxLevel + 1),
+    level_population_(kMaxMaxLevel + 1, 0),
+    force_evaluations_(0),
+    force_engine_calls_(0),
+    deepest_level_(-1)
+{
+}
+
+BlockTimestepIntegrator :: ~BlockTimestepIntegrator ()
+{
+}
+
+void BlockTimestepIntegrator :: set_max_level (int val)
+{
+  max_level_ = max(0, min(val, kMaxMaxLevel));
+}
+
+void BlockTimestepIntegrator :: ResetCounters ()
+{
+  force_evaluations_ = 0;
+  force_engine_calls_ = 0;
+  deepest_level_ = -1;
+}
+
+size_t BlockTimestepIntegrator :: level_population (int level) const
+{
+  if (level < 0 || level > kMaxMaxLevel) {
+    return 0;
+  }
+  return level_population_[level];
+}
+
+Result BlockTimestepIntegrator :: Step (float dt, double G,
+                                        IForceEngine* force_engine,
+                                        ParticleStore* things)
+{
+  Result res;
+  const size_t n = things->size();
+
+  if (n > static_cast<size_t>(numeric_limits<uint32_t>::max())) {
+    return INVALID_SIZE.Prepend("BlockTimestepIntegrator: too many bodies");
+  }
+
+  if (0 == n) {
+    return SUCCESS;
+  }
+
+  if (all_.size() != n)
+  {
+    all_.resize(n);
+    for (uint32_t i = 0; i < n; ++i) {
+      all_[i] = i;
+    }
+    accelerations_valid_ = false;
+  }
+
+  if (!accelerations_valid_ &&
+      SUCCESS != (res = ComputeAccelerations(G, force_engine, things,
+                                             all_.data(), n))) {
+    return res;
+  }
+
+  // every body is synchronized at the start of a tick, so levels are chosen
+  // afresh for this tick's dt
+  levels_.resize(n);
+  for (vector<uint32_t>& bodies : by_level_) {
+    bodies.clear();
+  }
+  for (uint32_t i = 0; i < n; ++i) {
+    AssignLevel(i, DesiredLevel(*things, i, dt));
+  }
+  for (int l = 0; l <= kMaxMaxLevel; ++l) {
+    level_population_[l] = by_level_[l].size();
+  }
+
+  HalfKick(all_, dt, things);
+
+  const uint32_t n_substeps = 1u << max_level_;
+  const float substep_dt = dt / n_substeps;
+  uint32_t pending_drift_substeps = 0;
+
+  for (uint32_t s = 1; s <= n_substeps; ++s)
+  {
+    ++pending_drift_substeps;
+
+    // a level-l timestep spans 2^(max_level-l) substeps, so the bodies whose
+    // timesteps end at substep s are those on level >= first_active
+    const int first_active = max_level_ - __builtin_ctz(s);
+
+    active_.clear();
+    for (int l = first_active; l <= max_level_; ++l) {
+      active_.insert(active_.end(), by_level_[l].begin(), by_level_[l].end());
+    }
+    if (active_.empty()) {
+      continue;
+    }
+
+    Drift(pending_drift_substeps * substep_dt, things);
+    pending_drift_substeps = 0;
+
+    if (SUCCESS != (res = ComputeAccelerations(G, force_engine, things,
+                                               active_.data(),
+                                               active_.size()))) {
+      return res;
+    }
+
+    // closing half kick of the timestep that ends here
+    HalfKick(active_, dt, things);
+
+    if (n_substeps == s) {
+      // the whole universe is synchronized again
+      break;
+    }
+
+    // new levels must start on their own timestep boundary, i.e. be no
+    // coarser than first_active
+    for (int l = first_active; l <= max_level_; ++l) {
+      by_level_[l].clear();
+    }
+    for (uint32_t i : active_) {
+      AssignLevel(i, max(DesiredLevel(*things, i, dt), first_active));
+    }
+
+    // opening half kick of the next timestep
+    HalfKick(active_, dt, things);
+  }
+
+  return SUCCESS;
+}
+
+Result BlockTimestepIntegrator :: ComputeAccelerations (
+    double G, IForceEngine* force_engine, ParticleStore* things,
+    const uint32_t* targets, size_t n_targets)
+{
+  accelerations_valid_ = false;
+
+  if (force_engine)
+  {
+    Result res = force_engine->ComputeAccelerationsFor(G, things, targets,
+                                                       n_targets);
+    if (SUCCESS != res) {
+      return res.Prepend("BlockTimestepIntegrator: couldn't compute"
+                         " accelerations");
+    }
+  }
+  else
+  {
+    float* ax = things->ax();
+    float* ay = things->ay();
+    float* az = things->az();
+    for (size_t t = 0; t < n_targets; ++t) {
+      ax[targets[t]] = ay[targets[t]] = az[targets[t]] = 0;
+    }
+  }
+
+  force_evaluations_ += n_targets;
+  ++force_engine_calls_;
+  accelerations_valid_ = true;
+
+  return SUCCESS;
+}
+
+int BlockTimestepIntegrator :: DesiredLevel (const ParticleStore& things,
+                                             uint32_t i, float dt) const
+{
+  const float ax = things.ax()[i];
+  const float ay = things.ay()[i];
+  const float az = things.az()[i];
+  const float a = sqrtf(ax*ax + ay*ay + az*az);
+
+  if (!(a > 0)) {
+    return 0;
+  }
+
+  const float length = max(things.radius()[i], length_scale_);
+  if (!(length > 0)) {
+    return max_level_;
+  }
+
+  const float dt_i = sqrtf(2 * eta_ * length / a);
+  if (dt_i >= dt) {
+    return 0;
+  }
+
+  const float level = ceilf(log2f(dt / dt_i));
+  // also catches NaN
+  if (!(level < max_level_)) {
+    return max_level_;
+  }
+  return static_cast<int>(level);
+}
+
+void BlockTimestepIntegrator :: AssignLevel (uint32_t i, int level)
+{
+  levels_[i] = static_cast<uint8_t>(level);
+  by_level_[level].push_back(i);
+  deepest_level_ = max(deepest_level_, level);
+}
+
+void BlockTimestepIntegrator :: HalfKick (const vector<uint32_t>& bodies,
+                                          float dt, ParticleStore* things)
+{
+  auto range_func = [&] (size_t begin, size_t end)
+  {
+    float* __restrict__ vx = things->vx();
+    float* __restrict__ vy = things->vy();
+    float* __restrict__ vz = things->vz();
+    const float* __restrict__ ax = things->ax();
+    const float* __restrict__ ay = things->ay();
+    const float* __restrict__ az = things->az();
+    const uint8_t* levels = levels_.data();
+
+    for (size_t k = begin; k < end; ++k)
+    {
+      const uint32_t i = bodies[k];
+      const float half_dt = dt / static_cast<float>(2u << levels[i]);
+      vx[i] += ax[i] * half_dt;
+      vy[i] += ay[i] * half_dt;
+      vz[i] += az[i] * half_dt;
+    }
+  };
+
+  if (pool_) {
+    pool_->ParallelFor(bodies.size(), kMinBodiesPerChunk, range_func);
+  } else {
+    range_func(0, bodies.size());
+  }
+}
+
+void BlockTimestepIntegrator :: Drift (float drift_dt, ParticleStore* things)
+{
+  auto range_func = [=] (size_t begin, size_t end)
+  {
+    float* __restrict__ x = things->x();
+    float* __restrict__ y = things->y();
+    float* __restrict__ z = things->z();
+    const float* __restrict__ vx = things->vx();
+    const float* __restrict__ vy = things->vy();
+    const float* __restrict__ vz = things->vz();
+
+    for (size_t i = begin; i < end; ++i) {
+      x[i] += vx[i] * drift_dt;
+      y[i] += vy[i] * drift_dt;
+      z[i] += vz[i] * drift_dt;
+    }
+  };
+
+  if (pool_) {
+    pool_->ParallelFor(things->size(), kMinBodiesPerChunk, range_func);
+  } else {
+    range_func(0, things->size());
+  }
+}
@@ -0,0 +1,173 @@
+#ifndef COMMON_BLOCK_TIMESTEP_INTEGRATOR_HPP
+#define COMMON_BLOCK_TIMESTEP_INTEGRATOR_HPP
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "common/result.hpp"
+#include "common/i_force_engine.hpp"
+#include "common/i_integrator.hpp"
+#include "common/particle_store.hpp"
+#include "common/task_pool.hpp"
+
+namespace evo {
+
+/** Kick-drift-kick leapfrog with individual, hierarchical block timesteps.
+ Each body sits on a level l and is advanced with a timestep of dt / 2^l,
+ where dt is the tick passed to Step(); the level is chosen from the body's
+ acceleration with the criterion
+
+   dt_i = sqrt(2 * eta * L_i / |a_i|),   L_i = max(radius_i, length_scale)
+
+ i.e. roughly the time to fall a fraction eta of its own size.  A tick is
+ divided into 2^max_level substeps; at each substep only the bodies whose
+ own timestep ends there (the active set) get new accelerations and kicks,
+ so a handful of bodies in close encounters no longer force tiny steps onto
+ the whole universe.  Substeps with no active bodies cost nothing, as the
+ drift of the inactive bodies is deferred until someone needs forces.
+
+ Bodies may move to a finer level whenever they are active, and to a
+ coarser one only where the coarser timestep boundary lines up.  All bodies
+ are synchronized again at the end of every tick.
+ */
+class BlockTimestepIntegrator : public IIntegrator
+{
+public:
+
+  static const int kDefaultMaxLevel = 8;
+  static const int kMaxMaxLevel = 16;
+  static constexpr float kDefaultEta = 0.025f;
+
+  /** Kicks and drifts are split across \p pool, if non-null, above this many
+   bodies per chunk.
+   */
+  static const size_t kMinBodiesPerChunk = 16384;
+
+  /** \p pool may be null, in which case everything runs on the calling thread;
+   the integrator doesn't take ownership.
+   */
+  explicit BlockTimestepIntegrator (TaskPool* pool = nullptr);
+
+  virtual ~BlockTimestepIntegrator ();
+
+  /** Deepest level; the shortest timestep is dt / 2^max_level.  Clamped to
+   [0, kMaxMaxLevel].
+   */
+  int max_level () const {
+    return max_level_;
+  }
+
+  void set_max_level (int val);
+
+  /** Accuracy parameter of the timestep criterion; smaller is more accurate.
+   */
+  float eta () const {
+    return eta_;
+  }
+
+  void set_eta (float val) {
+    eta_ = val;
+  }
+
+  /** Lower bound on the length in the timestep criterion, for point-like
+   bodies; typically the force engine's softening length.  Bodies with both a
+   zero radius and a zero length scale always use the deepest level.
+   */
+  float length_scale () const {
+    return length_scale_;
+  }
+
+  void set_length_scale (float val) {
+    length_scale_ = val;
+  }
+
+  /** Number of body accelerations computed since the last ResetCounters(),
+   i.e. the sum of the active set sizes.
+   */
+  uint64_t force_evaluations () const {
+    return force_evaluations_;
+  }
+
+  /** Number of calls into the force engine since the last ResetCounters().
+   */
+  uint64_t force_engine_calls () const {
+    return force_engine_calls_;
+  }
+
+  /** Deepest level any body has been placed on since the last
+   ResetCounters(); -1 if none.
+   */
+  int deepest_level () const {
+    return deepest_level_;
+  }
+
+  void ResetCounters ();
+
+  /** Number of bodies on \p level at the start of the most recent tick.
+   */
+  size_t level_population (int level) const;
+
+  virtual std::string name () const override {
+    return "block timestep leapfrog";
+  }
+
+  /** At most one per substep, i.e. 2^max_level.
+   */
+  virtual int force_evaluations_per_step () const override {
+    return 1 << max_level_;
+  }
+
+  virtual Result Step (float dt, double G, IForceEngine* force_engine,
+                       ParticleStore* things) override;
+
+  virtual void InvalidateAccelerations () override {
+    accelerations_valid_ = false;
+  }
+
+private:
+
+  Result ComputeAccelerations (double G, IForceEngine* force_engine,
+                               ParticleStore* things, const uint32_t* targets,
+                               size_t n_targets);
+
+  /** Level called for by the timestep criterion, given a tick of \p dt
+   */
+  int DesiredLevel (const ParticleStore& things, uint32_t i, float dt) const;
+
+  void AssignLevel (uint32_t i, int level);
+
+  /** v += a * dt/2^(level+1) for each body in \p bodies, at its own level
+   */
+  void HalfKick (const std::vector<uint32_t>& bodies, float dt,
+                 ParticleStore* things);
+
+  void Drift (float drift_dt, ParticleStore* things);
+
+  TaskPool* pool_;
+
+  int max_level_;
+  float eta_;
+  float length_scale_;
+
+  bool accelerations_valid_;
+
+  std::vector<uint8_t> levels_;
+
+  /** by_level_[l] holds the bodies on level l
+   */
+  std::vector<std::vector<uint32_t>> by_level_;
+
+  std::vector<uint32_t> all_;
+  std::vector<uint32_t> active_;
+
+  std::vector<size_t> level_population_;
+
+  uint64_t force_evaluations_;
+  uint64_t force_engine_calls_;
+  int deepest_level_;
+};
+
+}
+
+#endif
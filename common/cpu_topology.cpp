@@ -0,0 +1,375 @@
+#include <sched.h>
+#include <dirent.h>
+#include <cstdio>
+#include <cstdlib>
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include "common/util.hpp"
+#include "common/cpu_topology.hpp"
+
+using namespace std;
+using namespace evo;
+using namespace std_results;
+
+/** Strips leading and trailing whitespace from \p str_io; kept local so
+ *  the topology code doesn't drag string.o (and boost_regex) into a link
+ */
+static void TrimSysfsField (string* str_io)
+{
+  const char* kSpace = " \t\r\n\f\v";
+  const size_t first = str_io->find_first_not_of(kSpace);
+  if (string::npos == first) {
+    str_io->clear();
+    return;
+  }
+  const size_t last = str_io->find_last_not_of(kSpace);
+  *str_io = str_io->substr(first, last - first + 1);
+}
+
+/** First line of the file at \p path, or false if it can't be read
+ */
+static bool ReadFirstLine (const string& path, string* line_out)
+{
+  ifstream file (path);
+  if (!file || !getline(file, *line_out)) {
+    return false;
+  }
+  TrimSysfsField(line_out);
+  return true;
+}
+
+/** Integer in the file at \p path, or \p default_val if there is none
+ */
+static int ReadInt (const string& path, int default_val)
+{
+  string line;
+  if (!ReadFirstLine(path, &line) || line.empty()) {
+    return default_val;
+  }
+  char* end = nullptr;
+  const long val = strtol(line.c_str(), &end, 10);
+  return ('\0' == *end ? static_cast<int>(val) : default_val);
+}
+
+/** The CPUs in this process's affinity mask
+ */
+static vector<int> AllowedCpus ()
+{
+  vector<int> cpus;
+  cpu_set_t mask;
+  CPU_ZERO(&mask);
+
+  if (0 != sched_getaffinity(0, sizeof(mask), &mask)) {
+    // no way of telling; assume we may use whatever is online
+    return cpus;
+  }
+  for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+    if (CPU_ISSET(cpu, &mask)) {
+      cpus.push_back(cpu);
+    }
+  }
+  return cpus;
+}
+
+const CpuTopology& CpuTopology :: Get ()
+{
+  // thread-safe, as of C++11
+  static const CpuTopology topology = [] {
+    CpuTopology probed;
+    Result res = probed.Probe();
+    if (SUCCESS != res) {
+      QLOG(WARNING) << "Couldn't read the CPU topology, assuming a flat one: "
+                    << res.ToString();
+      probed.SetFallback();
+    }
+    return probed;
+  }();
+
+  return topology;
+}
+
+CpuTopology :: CpuTopology ()
+  : n_numa_nodes_(0)
+{
+}
+
+Result CpuTopology :: Probe (const string& sysfs_root)
+{
+  Result res;
+  string line;
+  vector<int> online;
+
+  const string cpu_root = sysfs_root + "/cpu";
+  if (!ReadFirstLine(cpu_root + "/online", &line)) {
+    return OPEN_FAILED.Prepend("Couldn't read " + cpu_root + "/online");
+  }
+  if (SUCCESS != (res = ParseCpuList(line, &online))) {
+    return res.Prepend("Bad online CPU list");
+  }
+
+  vector<int> allowed = AllowedCpus();
+  if (!allowed.empty())
+  {
+    vector<int> both;
+    set_intersection(online.begin(), online.end(),
+                     allowed.begin(), allowed.end(), back_inserter(both));
+    online.swap(both);
+  }
+  if (online.empty()) {
+    return INSUFFICIENT_DATA.Prepend("No usable CPUs found");
+  }
+
+  cpus_.clear();
+  for (int cpu : online)
+  {
+    const string topo = cpu_root + "/cpu" + to_string(cpu) + "/topology/";
+    CpuInfo info;
+    info.cpu = cpu;
+    // without topology info, every CPU counts as a core of its own
+    info.core = ReadInt(topo + "core_id", cpu);
+    info.package = max(ReadInt(topo + "physical_package_id", 0), 0);
+    info.numa_node = 0;
+    cpus_.push_back(info);
+  }
+
+  // kernels built without NUMA support have no node directory at all
+  const string node_root = sysfs_root + "/node";
+  DIR* dir = opendir(node_root.c_str());
+  if (dir)
+  {
+    struct dirent* entry;
+    while (nullptr != (entry = readdir(dir)))
+    {
+      int node;
+      char trailing;
+      if (1 != sscanf(entry->d_name, "node%d%c", &node, &trailing)) {
+        continue;
+      }
+      vector<int> node_cpus;
+      if (!ReadFirstLine(node_root + "/" + entry->d_name + "/cpulist", &line) ||
+          SUCCESS != ParseCpuList(line, &node_cpus)) {
+        continue;
+      }
+      for (CpuInfo& info : cpus_) {
+        if (binary_search(node_cpus.begin(), node_cpus.end(), info.cpu)) {
+          info.numa_node = node;
+        }
+      }
+    }
+    closedir(dir);
+  }
+
+  sort(cpus_.begin(), cpus_.end(), [] (const CpuInfo& a, const CpuInfo& b) {
+    return (make_tuple(a.numa_node, a.package, a.core, a.cpu) <
+            make_tuple(b.numa_node, b.package, b.core, b.cpu));
+  });
+
+  n_numa_nodes_ = 0;
+  for (const CpuInfo& info : cpus_) {
+    n_numa_nodes_ = max(n_numa_nodes_, info.numa_node + 1);
+  }
+
+  return SUCCESS;
+}
+
+void CpuTopology :: SetFallback ()
+{
+  vector<int> allowed = AllowedCpus();
+  if (allowed.empty()) {
+    allowed.push_back(0);
+  }
+
+  cpus_.clear();
+  for (int cpu : allowed) {
+    CpuInfo info;
+    info.cpu = cpu;
+    info.core = cpu;
+    info.package = 0;
+    info.numa_node = 0;
+    cpus_.push_back(info);
+  }
+  n_numa_nodes_ = 1;
+}
+
+vector<int> CpuTopology :: NodeCpus (int node) const
+{
+  vector<int> node_cpus;
+  for (const CpuInfo& info : cpus_) {
+    if (node == info.numa_node) {
+      node_cpus.push_back(info.cpu);
+    }
+  }
+  sort(node_cpus.begin(), node_cpus.end());
+  return node_cpus;
+}
+
+int CpuTopology :: NodeOfCpu (int cpu) const
+{
+  for (const CpuInfo& info : cpus_) {
+    if (cpu == info.cpu) {
+      return info.numa_node;
+    }
+  }
+  return -1;
+}
+
+vector<int> CpuTopology :: PlaceWorkers (PlacementPolicy policy,
+                                         int n_threads) const
+{
+  vector<int> placement;
+  if (PlacementPolicy::kNone == policy || cpus_.empty() || n_threads <= 0) {
+    return placement;
+  }
+
+  // cpus_ is sorted so that SMT siblings are adjacent; rank each CPU among
+  // the siblings of its core (0 for the first, 1 for the second, ...)
+  vector<int> sibling_rank (cpus_.size(), 0);
+  for (size_t i = 1; i < cpus_.size(); ++i) {
+    const CpuInfo& prev = cpus_[i - 1];
+    const CpuInfo& cur = cpus_[i];
+    if (prev.numa_node == cur.numa_node && prev.package == cur.package &&
+        prev.core == cur.core) {
+      sibling_rank[i] = sibling_rank[i - 1] + 1;
+    }
+  }
+
+  vector<int> order;
+  switch (policy)
+  {
+  case PlacementPolicy::kCompact:
+    for (const CpuInfo& info : cpus_) {
+      order.push_back(info.cpu);
+    }
+    break;
+
+  case PlacementPolicy::kPerCore:
+    for (size_t i = 0; i < cpus_.size(); ++i) {
+      if (0 == sibling_rank[i]) {
+        order.push_back(cpus_[i].cpu);
+      }
+    }
+    break;
+
+  case PlacementPolicy::kScatter:
+  {
+    // per node: one CPU of every core first, SMT siblings after that;
+    // then deal the nodes' lists out round-robin
+    vector<vector<int>> per_node (n_numa_nodes_);
+    const int max_rank = *max_element(sibling_rank.begin(), sibling_rank.end());
+    for (int rank = 0; rank <= max_rank; ++rank) {
+      for (size_t i = 0; i < cpus_.size(); ++i) {
+        if (rank == sibling_rank[i]) {
+          per_node[cpus_[i].numa_node].push_back(cpus_[i].cpu);
+        }
+      }
+    }
+    for (size_t k = 0; order.size() < cpus_.size(); ++k) {
+      for (const vector<int>& node_cpus : per_node) {
+        if (k < node_cpus.size()) {
+          order.push_back(node_cpus[k]);
+        }
+      }
+    }
+    break;
+  }
+
+  default:
+    return placement;
+  }
+
+  for (int t = 0; t < n_threads; ++t) {
+    placement.push_back(order[t % order.size()]);
+  }
+  return placement;
+}
+
+string CpuTopology :: ToString () const
+{
+  std::stringstream strm;
+  strm << cpus_.size() << " CPUs, " << n_numa_nodes_ << " NUMA node(s)";
+  for (int node = 0; node < n_numa_nodes_; ++node)
+  {
+    vector<int> node_cpus = NodeCpus(node);
+    if (node_cpus.empty()) {
+      continue;
+    }
+    strm << "; node " << node << ": ";
+    for (size_t i = 0; i < node_cpus.size(); ++i) {
+      strm << (i > 0 ? "," : "") << node_cpus[i];
+    }
+  }
+  return strm.str();
+}
+
+Result CpuTopology :: ParseCpuList (const string& str, vector<int>* cpus_out)
+{
+  cpus_out->clear();
+
+  std::stringstream strm (str);
+  string range;
+  while (getline(strm, range, ','))
+  {
+    TrimSysfsField(&range);
+    if (range.empty()) {
+      continue;
+    }
+
+    int first, last;
+    char trailing;
+    if (2 == sscanf(range.c_str(), "%d-%d%c", &first, &last, &trailing)) {
+      // a range
+    } else if (1 == sscanf(range.c_str(), "%d%c", &first, &trailing)) {
+      last = first;
+    } else {
+      return INVALID_ARGUMENT.Prepend("Bad CPU list \"" + str + "\"");
+    }
+    if (first < 0 || last < first) {
+      return INVALID_ARGUMENT.Prepend("Bad CPU range \"" + range + "\"");
+    }
+    for (int cpu = first; cpu <= last; ++cpu) {
+      cpus_out->push_back(cpu);
+    }
+  }
+
+  sort(cpus_out->begin(), cpus_out->end());
+  cpus_out->erase(unique(cpus_out->begin(), cpus_out->end()), cpus_out->end());
+  return SUCCESS;
+}
+
+string CpuTopology :: PolicyToString (PlacementPolicy policy)
+{
+  switch (policy)
+  {
+  case PlacementPolicy::kNone:
+    return "none";
+  case PlacementPolicy::kCompact:
+    return "compact";
+  case PlacementPolicy::kScatter:
+    return "scatter";
+  case PlacementPolicy::kPerCore:
+    return "core";
+  }
+  return "Unknown placement policy";
+}
+
+Result CpuTopology :: ParsePolicy (const string& str,
+                                   PlacementPolicy* policy_out)
+{
+  for (PlacementPolicy policy : { PlacementPolicy::kNone,
+                                  PlacementPolicy::kCompact,
+                                  PlacementPolicy::kScatter,
+                                  PlacementPolicy::kPerCore }) {
+    if (PolicyToString(policy) == str) {
+      *policy_out = policy;
+      return SUCCESS;
+    }
+  }
+  return INVALID_ARGUMENT.Prepend("Unknown placement policy \"" + str +
+                                  "\"; expected none, compact, scatter or "
+                                  "core");
+}
@@ -0,0 +1,109 @@
+#ifndef COMMON_CPU_TOPOLOGY_HPP
+#define COMMON_CPU_TOPOLOGY_HPP
+
+#include <string>
+#include <vector>
+
+#include "common/result.hpp"
+
+namespace evo {
+
+/** How a pool's worker threads are spread over the machine's CPUs; see
+ CpuTopology::PlaceWorkers().
+ */
+enum class PlacementPolicy
+{
+  kNone,     ///< leave placement to the scheduler
+  kCompact,  ///< fill a NUMA node core by core, SMT siblings included
+  kScatter,  ///< round-robin across NUMA nodes, one CPU per core first
+  kPerCore   ///< one thread per physical core, ignoring SMT siblings
+};
+
+/** Where a single logical CPU sits in the machine.
+ */
+struct CpuInfo
+{
+  int cpu;        ///< logical CPU number, as used by sched_setaffinity()
+  int core;       ///< core id, unique only within the package
+  int package;    ///< physical package (socket)
+  int numa_node;  ///< 0 on machines (or kernels) without NUMA
+};
+
+/** Logical CPUs available to this process, and their cores, packages and
+ NUMA nodes, as read from sysfs (/sys/devices/system/{cpu,node}), so no
+ libnuma or hwloc is needed.  CPUs outside the process's affinity mask (e.g.
+ under taskset or a cgroup cpuset) are left out.
+ */
+class CpuTopology
+{
+public:
+
+  /** The machine's topology, probed on first use.  If probing fails, e.g.
+   with no sysfs mounted, every allowed CPU is its own core on package 0 and
+   node 0.
+   */
+  static const CpuTopology& Get ();
+
+  CpuTopology ();
+
+  /** Reads the topology from sysfs below \p sysfs_root.
+   \returns Result; fails if:
+      * The online CPU list can't be read.
+   */
+  evo::Result Probe (const std::string& sysfs_root = "/sys/devices/system");
+
+  /** Sorted by NUMA node, package, core, then CPU number
+   */
+  const std::vector<CpuInfo>& cpus () const {
+    return cpus_;
+  }
+
+  int n_numa_nodes () const {
+    return n_numa_nodes_;
+  }
+
+  /** Logical CPUs of NUMA node \p node, empty if there is no such node
+   */
+  std::vector<int> NodeCpus (int node) const;
+
+  /** NUMA node of logical CPU \p cpu, or -1 if it isn't available to us
+   */
+  int NodeOfCpu (int cpu) const;
+
+  /** The CPU for each of \p n_threads threads under \p policy; threads
+   beyond the number of CPUs (or cores, for kPerCore) wrap around.  Empty for
+   PlacementPolicy::kNone.
+   */
+  std::vector<int> PlaceWorkers (PlacementPolicy policy, int n_threads) const;
+
+  std::string ToString () const;
+
+  /** Parses a sysfs CPU list such as "0-3,8-11" into \p cpus_out
+   \returns Result; fails if:
+      * \p str isn't a well-formed list.
+   */
+  static evo::Result ParseCpuList (const std::string& str,
+                                   std::vector<int>* cpus_out);
+
+  static std::string PolicyToString (PlacementPolicy policy);
+
+  /** Inverse of PolicyToString()
+   \returns Result; fails if:
+      * \p str names no policy.
+   */
+  static evo::Result ParsePolicy (const std::string& str,
+                                  PlacementPolicy* policy_out);
+
+private:
+
+  /** One CPU per core, every allowed CPU, on node 0
+   */
+  void SetFallback ();
+
+  std::vector<CpuInfo> cpus_;
+  int n_numa_nodes_;
+};
+
+}
+
+#endif
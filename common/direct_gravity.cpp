@@ -0,0 +1,384 @@
+
+#include <cmath>
+#include <string>
+
+#if defined(__x86_64__) || defined(__i386__)
+  #define EVO_X86 1
+  #include <immintrin.h>
+#endif
+
+#include "common/direct_gravity.hpp"
+
+using namespace std;
+using namespace evo;
+using namespace std_results;
+
+/** Every kernel computes, for each i in [begin, end):
+      a_i = G * sum_j m_j * (r_j - r_i) / (|r_j - r_i|^2 + eps^2)^(3/2)
+ Pairs whose softened squared distance is zero (the self term when eps == 0)
+ contribute nothing.  The SIMD kernels use a hardware reciprocal square root
+ refined by one Newton-Raphson step, which is accurate to a few ulps.
+ */
+
+static void ScalarKernel (size_t begin, size_t end, size_t n,
+                          const float* x, const float* y, const float* z,
+                          const float* mass, float eps2, float G,
+                          float* ax, float* ay, float* az)
+{
+  for (size_t i = begin; i < end; ++i)
+  {
+    const float xi = x[i], yi = y[i], zi = z[i];
+    float sx = 0, sy = 0, sz = 0;
+
+    for (size_t j = 0; j < n; ++j)
+    {
+      const float dx = x[j] - xi;
+      const float dy = y[j] - yi;
+      const float dz = z[j] - zi;
+      const float d2 = dx*dx + dy*dy + dz*dz + eps2;
+      if (d2 > 0) {
+        const float inv_d = 1.0f / sqrtf(d2);
+        const float s = mass[j] * inv_d * inv_d * inv_d;
+        sx += dx * s;
+        sy += dy * s;
+        sz += dz * s;
+      }
+    }
+
+    ax[i] = G * sx;
+    ay[i] = G * sy;
+    az[i] = G * sz;
+  }
+}
+
+#ifdef EVO_X86
+
+static inline float HorizontalSum (__m128 v)
+{
+  __m128 shuf = _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 3, 0, 1));
+  __m128 sums = _mm_add_ps(v, shuf);
+  shuf = _mm_movehl_ps(shuf, sums);
+  sums = _mm_add_ss(sums, shuf);
+  return _mm_cvtss_f32(sums);
+}
+
+static void SseKernel (size_t begin, size_t end, size_t n,
+                       const float* x, const float* y, const float* z,
+                       const float* mass, float eps2, float G,
+                       float* ax, float* ay, float* az)
+{
+  const __m128 v_eps2 = _mm_set1_ps(eps2);
+  const __m128 v_zero = _mm_setzero_ps();
+  const __m128 v_half = _mm_set1_ps(0.5f);
+  const __m128 v_three_halves = _mm_set1_ps(1.5f);
+  const size_t n_vec = n & ~static_cast<size_t>(3);
+
+  for (size_t i = begin; i < end; ++i)
+  {
+    const float xi = x[i], yi = y[i], zi = z[i];
+    const __m128 v_xi = _mm_set1_ps(xi);
+    const __m128 v_yi = _mm_set1_ps(yi);
+    const __m128 v_zi = _mm_set1_ps(zi);
+    __m128 v_sx = v_zero, v_sy = v_zero, v_sz = v_zero;
+
+    for (size_t j = 0; j < n_vec; j += 4)
+    {
+      __m128 dx = _mm_sub_ps(_mm_loadu_ps(x + j), v_xi);
+      __m128 dy = _mm_sub_ps(_mm_loadu_ps(y + j), v_yi);
+      __m128 dz = _mm_sub_ps(_mm_loadu_ps(z + j), v_zi);
+      __m128 d2 = _mm_add_ps(
+          _mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)),
+          _mm_add_ps(_mm_mul_ps(dz, dz), v_eps2));
+      __m128 inv_d = _mm_rsqrt_ps(d2);
+      inv_d = _mm_mul_ps(inv_d, _mm_sub_ps(v_three_halves,
+          _mm_mul_ps(_mm_mul_ps(v_half, d2), _mm_mul_ps(inv_d, inv_d))));
+      __m128 s = _mm_mul_ps(_mm_loadu_ps(mass + j),
+                            _mm_mul_ps(inv_d, _mm_mul_ps(inv_d, inv_d)));
+      s = _mm_and_ps(s, _mm_cmpgt_ps(d2, v_zero));
+      v_sx = _mm_add_ps(v_sx, _mm_mul_ps(dx, s));
+      v_sy = _mm_add_ps(v_sy, _mm_mul_ps(dy, s));
+      v_sz = _mm_add_ps(v_sz, _mm_mul_ps(dz, s));
+    }
+
+    float sx = HorizontalSum(v_sx);
+    float sy = HorizontalSum(v_sy);
+    float sz = HorizontalSum(v_sz);
+
+    for (size_t j = n_vec; j < n; ++j)
+    {
+      const float dx = x[j] - xi;
+      const float dy = y[j] - yi;
+      const float dz = z[j] - zi;
+      const float d2 = dx*dx + dy*dy + dz*dz + eps2;
+      if (d2 > 0) {
+        const float inv_d = 1.0f / sqrtf(d2);
+        const float s = mass[j] * inv_d * inv_d * inv_d;
+        sx += dx * s;
+        sy += dy * s;
+        sz += dz * s;
+      }
+    }
+
+    ax[i] = G * sx;
+    ay[i] = G * sy;
+    az[i] = G * sz;
+  }
+}
+
+__attribute__((target("avx2,fma")))
+static void Avx2Kernel (size_t begin, size_t end, size_t n,
+                        const float* x, const float* y, const float* z,
+                        const float* mass, float eps2, float G,
+                        float* ax, float* ay, float* az)
+{
+  const __m256 v_eps2 = _mm256_set1_ps(eps2);
+  const __m256 v_zero = _mm256_setzero_ps();
+  const __m256 v_neg_half = _mm256_set1_ps(-0.5f);
+  const __m256 v_three_halves = _mm256_set1_ps(1.5f);
+  const size_t n_vec = n & ~static_cast<size_t>(7);
+
+  for (size_t i = begin; i < end; ++i)
+  {
+    const float xi = x[i], yi = y[i], zi = z[i];
+    const __m256 v_xi = _mm256_set1_ps(xi);
+    const __m256 v_yi = _mm256_set1_ps(yi);
+    const __m256 v_zi = _mm256_set1_ps(zi);
+    __m256 v_sx = v_zero, v_sy = v_zero, v_sz = v_zero;
+
+    for (size_t j = 0; j < n_vec; j += 8)
+    {
+      __m256 dx = _mm256_sub_ps(_mm256_loadu_ps(x + j), v_xi);
+      __m256 dy = _mm256_sub_ps(_mm256_loadu_ps(y + j), v_yi);
+      __m256 dz = _mm256_sub_ps(_mm256_loadu_ps(z + j), v_zi);
+      __m256 d2 = _mm256_fmadd_ps(dx, dx, v_eps2);
+      d2 = _mm256_fmadd_ps(dy, dy, d2);
+      d2 = _mm256_fmadd_ps(dz, dz, d2);
+      __m256 inv_d = _mm256_rsqrt_ps(d2);
+      // inv_d *= 1.5 - 0.5 * d2 * inv_d^2
+      inv_d = _mm256_mul_ps(inv_d, _mm256_fmadd_ps(
+          _mm256_mul_ps(v_neg_half, d2), _mm256_mul_ps(inv_d, inv_d),
+          v_three_halves));
+      __m256 s = _mm256_mul_ps(_mm256_loadu_ps(mass + j),
+                               _mm256_mul_ps(inv_d, _mm256_mul_ps(inv_d, inv_d)));
+      s = _mm256_and_ps(s, _mm256_cmp_ps(d2, v_zero, _CMP_GT_OQ));
+      v_sx = _mm256_fmadd_ps(dx, s, v_sx);
+      v_sy = _mm256_fmadd_ps(dy, s, v_sy);
+      v_sz = _mm256_fmadd_ps(dz, s, v_sz);
+    }
+
+    float sx = HorizontalSum(_mm_add_ps(_mm256_castps256_ps128(v_sx),
+                                        _mm256_extractf128_ps(v_sx, 1)));
+    float sy = HorizontalSum(_mm_add_ps(_mm256_castps256_ps128(v_sy),
+                                        _mm256_extractf128_ps(v_sy, 1)));
+    float sz = HorizontalSum(_mm_add_ps(_mm256_castps256_ps128(v_sz),
+                                        _mm256_extractf128_ps(v_sz, 1)));
+
+    for (size_t j = n_vec; j < n; ++j)
+    {
+      const float dx = x[j] - xi;
+      const float dy = y[j] - yi;
+      const float dz = z[j] - zi;
+      const float d2 = dx*dx + dy*dy + dz*dz + eps2;
+      if (d2 > 0) {
+        const float inv_d = 1.0f / sqrtf(d2);
+        const float s = mass[j] * inv_d * inv_d * inv_d;
+        sx += dx * s;
+        sy += dy * s;
+        sz += dz * s;
+      }
+    }
+
+    ax[i] = G * sx;
+    ay[i] = G * sy;
+    az[i] = G * sz;
+  }
+}
+
+__attribute__((target("avx512f")))
+static void Avx512Kernel (size_t begin, size_t end, size_t n,
+                          const float* x, const float* y, const float* z,
+                          const float* mass, float eps2, float G,
+                          float* ax, float* ay, float* az)
+{
+  const __m512 v_eps2 = _mm512_set1_ps(eps2);
+  const __m512 v_zero = _mm512_setzero_ps();
+  const __m512 v_neg_half = _mm512_set1_ps(-0.5f);
+  const __m512 v_three_halves = _mm512_set1_ps(1.5f);
+
+  for (size_t i = begin; i < end; ++i)
+  {
+    const __m512 v_xi = _mm512_set1_ps(x[i]);
+    const __m512 v_yi = _mm512_set1_ps(y[i]);
+    const __m512 v_zi = _mm512_set1_ps(z[i]);
+    __m512 v_sx = v_zero, v_sy = v_zero, v_sz = v_zero;
+
+    for (size_t j = 0; j < n; j += 16)
+    {
+      // the final partial vector is handled with masked loads; masked-off
+      // lanes have zero mass and are excluded by the d2 > 0 mask anyway
+      const __mmask16 lanes = (n - j >= 16) ?
+          static_cast<__mmask16>(0xffff) :
+          static_cast<__mmask16>((1u << (n - j)) - 1);
+      __m512 dx = _mm512_sub_ps(_mm512_maskz_loadu_ps(lanes, x + j), v_xi);
+      __m512 dy = _mm512_sub_ps(_mm512_maskz_loadu_ps(lanes, y + j), v_yi);
+      __m512 dz = _mm512_sub_ps(_mm512_maskz_loadu_ps(lanes, z + j), v_zi);
+      __m512 d2 = _mm512_fmadd_ps(dx, dx, v_eps2);
+      d2 = _mm512_fmadd_ps(dy, dy, d2);
+      d2 = _mm512_fmadd_ps(dz, dz, d2);
+      __m512 inv_d = _mm512_rsqrt14_ps(d2);
+      inv_d = _mm512_mul_ps(inv_d, _mm512_fmadd_ps(
+          _mm512_mul_ps(v_neg_half, d2), _mm512_mul_ps(inv_d, inv_d),
+          v_three_halves));
+      const __mmask16 valid =
+          lanes & _mm512_cmp_ps_mask(d2, v_zero, _CMP_GT_OQ);
+      __m512 s = _mm512_maskz_mul_ps(valid, _mm512_maskz_loadu_ps(lanes, mass + j),
+                                     _mm512_mul_ps(inv_d, _mm512_mul_ps(inv_d, inv_d)));
+      v_sx = _mm512_fmadd_ps(dx, s, v_sx);
+      v_sy = _mm512_fmadd_ps(dy, s, v_sy);
+      v_sz = _mm512_fmadd_ps(dz, s, v_sz);
+    }
+
+    ax[i] = G * _mm512_reduce_add_ps(v_sx);
+    ay[i] = G * _mm512_reduce_add_ps(v_sy);
+    az[i] = G * _mm512_reduce_add_ps(v_sz);
+  }
+}
+
+#endif // EVO_X86
+
+static DirectGravity::Isa DetectIsaViaCpuid ()
+{
+#ifdef EVO_X86
+  // __builtin_cpu_supports() consults cpuid and also accounts for whether the
+  // OS saves the wider register state (xgetbv)
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512f")) {
+    return DirectGravity::Isa::kAvx512;
+  }
+  if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+    return DirectGravity::Isa::kAvx2;
+  }
+  if (__builtin_cpu_supports("sse2")) {
+    return DirectGravity::Isa::kSse;
+  }
+#endif
+  return DirectGravity::Isa::kScalar;
+}
+
+/** Probed during static initialization so the choice is made once, at
+ startup, rather than on the first force evaluation.
+ */
+static const DirectGravity::Isa g_detected_isa = DetectIsaViaCpuid();
+
+
+string DirectGravity :: IsaToString (Isa isa)
+{
+  switch (isa)
+  {
+  case Isa::kScalar:
+    return "Scalar";
+  case Isa::kSse:
+    return "SSE";
+  case Isa::kAvx2:
+    return "AVX2";
+  case Isa::kAvx512:
+    return "AVX-512";
+  // no default clause so that the compiler will issue a warning if we've
+  // skipped an enum member
+  }
+
+  return "Unknown ISA '" + to_string(static_cast<int>(isa)) + "'";
+}
+
+DirectGravity::Isa DirectGravity :: DetectedIsa ()
+{
+  return g_detected_isa;
+}
+
+bool DirectGravity :: IsIsaSupported (Isa isa)
+{
+  // each ISA is a superset of the ones listed before it
+  return (static_cast<int>(isa) <= static_cast<int>(g_detected_isa));
+}
+
+DirectGravity :: DirectGravity ()
+  : isa_(g_detected_isa),
+    softening_(0)
+{
+}
+
+DirectGravity :: ~DirectGravity ()
+{
+}
+
+Result DirectGravity :: set_isa (Isa isa)
+{
+  if (!IsIsaSupported(isa)) {
+    return NOT_IMPLEMENTED.Prepend(
+        "DirectGravity: CPU does not support " + IsaToString(isa));
+  }
+  isa_ = isa;
+  return SUCCESS;
+}
+
+Result DirectGravity :: ComputeAccelerations (double G, ParticleStore* things)
+{
+  if (!things) {
+    return INVALID_ARGUMENT.Prepend("DirectGravity: things is null");
+  }
+
+  const size_t n = things->size();
+
+  ComputeRange(0, n, n, things->x(), things->y(), things->z(), things->mass(),
+               static_cast<float>(G), things->ax(), things->ay(), things->az());
+
+  return SUCCESS;
+}
+
+Result DirectGravity :: ComputeAccelerationsFor (double G,
+                                                ParticleStore* things,
+                                                const uint32_t* targets,
+                                                size_t n_targets)
+{
+  if (!things) {
+    return INVALID_ARGUMENT.Prepend("DirectGravity: things is null");
+  }
+
+  const size_t n = things->size();
+
+  // each target is a full, vectorized sweep over the sources, so the
+  // per-call overhead of a one-body range is negligible
+  for (size_t t = 0; t < n_targets; ++t) {
+    ComputeRange(targets[t], targets[t] + 1, n, things->x(), things->y(),
+                 things->z(), things->mass(), static_cast<float>(G),
+                 things->ax(), things->ay(), things->az());
+  }
+
+  return SUCCESS;
+}
+
+void DirectGravity :: ComputeRange (size_t begin, size_t end, size_t n,
+                                    const float* x, const float* y,
+                                    const float* z, const float* mass, float G,
+                                    float* ax, float* ay, float* az) const
+{
+  const float eps2 = softening_ * softening_;
+
+  switch (isa_)
+  {
+#ifdef EVO_X86
+  case Isa::kAvx512:
+    Avx512Kernel(begin, end, n, x, y, z, mass, eps2, G, ax, ay, az);
+    return;
+  case Isa::kAvx2:
+    Avx2Kernel(begin, end, n, x, y, z, mass, eps2, G, ax, ay, az);
+    return;
+  case Isa::kSse:
+    SseKernel(begin, end, n, x, y, z, mass, eps2, G, ax, ay, az);
+    return;
+#endif
+  default:
+    ScalarKernel(begin, end, n, x, y, z, mass, eps2, G, ax, ay, az);
+    return;
+  }
+}
@@ -0,0 +1,90 @@
+#ifndef COMMON_DIRECT_GRAVITY_HPP
+#define COMMON_DIRECT_GRAVITY_HPP
+
+#include <string>
+
+#include "common/i_force_engine.hpp"
+#include "common/particle_store.hpp"
+#include "common/result.hpp"
+
+namespace evo {
+
+/** Exact all-pairs gravity solver with Plummer softening.  The inner loop is
+ vectorized for SSE, AVX2 and AVX-512; the widest instruction set supported
+ by the CPU is picked once at startup via cpuid, and a scalar kernel is used
+ everywhere else.  O(N^2), so intended for populations below roughly 20k
+ bodies, beyond which BarnesHutGravity wins.
+ */
+class DirectGravity : public IForceEngine
+{
+public:
+
+  enum class Isa
+  {
+    kScalar,
+    kSse,
+    kAvx2,
+    kAvx512
+  };
+
+  /** Maps each Isa to its respective text name.
+   */
+  static std::string IsaToString (Isa isa);
+
+  /** The widest instruction set the current CPU (and OS) supports; evaluated
+   once and cached.
+   */
+  static Isa DetectedIsa ();
+
+  /** Whether the current CPU can execute kernels built for \p isa.
+   */
+  static bool IsIsaSupported (Isa isa);
+
+  DirectGravity ();
+
+  virtual ~DirectGravity ();
+
+  Isa isa () const {
+    return isa_;
+  }
+
+  /** Forces a specific kernel, e.g. to compare against the scalar path.
+   @return SUCCESS, or NOT_IMPLEMENTED if the CPU can't run \p isa.
+   */
+  Result set_isa (Isa isa);
+
+  /** Plummer softening length; pairwise accelerations are computed as
+   G*m*r / (|r|^2 + softening^2)^(3/2).
+   */
+  float softening () const {
+    return softening_;
+  }
+
+  void set_softening (float val) {
+    softening_ = val;
+  }
+
+  virtual Result ComputeAccelerations (double G, ParticleStore* things) override;
+
+  virtual Result ComputeAccelerationsFor (double G, ParticleStore* things,
+                                          const uint32_t* targets,
+                                          size_t n_targets) override;
+
+  /** Computes the accelerations of bodies [begin, end) due to all \p n
+   bodies, writing them to \p ax, \p ay, \p az at the same indices.
+   Exposed so that callers can split the outer loop across threads.
+   */
+  void ComputeRange (size_t begin, size_t end, size_t n,
+                     const float* x, const float* y, const float* z,
+                     const float* mass, float G,
+                     float* ax, float* ay, float* az) const;
+
+private:
+
+  Isa isa_;
+  float softening_;
+};
+
+}
+
+#endif
@@ -0,0 +1,59 @@
+#ifndef COMMON_I_BROADPHASE_HPP
+#define COMMON_I_BROADPHASE_HPP
+
+#include <cstdint>
+#include <vector>
+
+#include "common/result.hpp"
+#include "common/particle_store.hpp"
+
+namespace evo {
+
+/** A pair of overlapping bodies, identified by their ParticleStore indices;
+ a is always less than b.
+ */
+struct ContactPair
+{
+  uint32_t a;
+  uint32_t b;
+};
+
+/**
+ * An interface for collision broadphases that find the pairs of overlapping
+ * spheres among the bodies of a ParticleStore.
+ */
+class IBroadphase
+{
+public:
+
+  typedef std::vector<ContactPair>::const_iterator ContactIterator;
+
+  virtual ~IBroadphase ()
+  {}
+
+  /**
+   * Recomputes the set of overlapping pairs from the current positions and
+   * radii of \p things.  Intended to be called once per tick.
+   * @param things The bodies.
+   * @return SUCCESS, or an error if the contacts could not be computed.
+   */
+  virtual Result Update (const ParticleStore& things) = 0;
+
+  /**
+   * Gets the pairs found by the most recent call to Update(), in no
+   * particular order.  Each overlapping pair appears exactly once.
+   */
+  virtual const std::vector<ContactPair>& contacts () const = 0;
+
+  ContactIterator begin () const {
+    return contacts().begin();
+  }
+
+  ContactIterator end () const {
+    return contacts().end();
+  }
+};
+
+}
+
+#endif
@@ -0,0 +1,55 @@
+#ifndef COMMON_I_FORCE_ENGINE_HPP
+#define COMMON_I_FORCE_ENGINE_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+#include "common/result.hpp"
+#include "common/particle_store.hpp"
+
+namespace evo {
+
+/**
+ * An interface for gravity solvers that turn the positions and masses held by
+ * a ParticleStore into per-body accelerations.
+ */
+class IForceEngine
+{
+public:
+
+  virtual ~IForceEngine ()
+  {}
+
+  /**
+   * Overwrites the acceleration of every body in \p things with the
+   * gravitational acceleration exerted on it by all of the other bodies.
+   * @param G The gravitational constant.
+   * @param things The bodies; positions and masses are read, accelerations
+   * are written.
+   * @return SUCCESS, or an error if the accelerations could not be computed.
+   */
+  virtual Result ComputeAccelerations (double G, ParticleStore* things) = 0;
+
+  /**
+   * Like ComputeAccelerations(), but only the accelerations of the bodies
+   * listed in \p targets need to be brought up to date; every body still acts
+   * as a source.  The accelerations of the other bodies may be left alone or
+   * overwritten.  The default implementation simply computes everything;
+   * solvers whose cost scales with the number of targets override it.
+   * @param G The gravitational constant.
+   * @param things The bodies.
+   * @param targets Indices of the bodies whose accelerations are wanted; no
+   * index appears twice.
+   * @param n_targets Number of entries in \p targets.
+   * @return SUCCESS, or an error if the accelerations could not be computed.
+   */
+  virtual Result ComputeAccelerationsFor (double G, ParticleStore* things,
+                                          const uint32_t* /*targets*/,
+                                          size_t /*n_targets*/) {
+    return ComputeAccelerations(G, things);
+  }
+};
+
+}
+
+#endif
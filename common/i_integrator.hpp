@@ -0,0 +1,55 @@
+#ifndef COMMON_I_INTEGRATOR_HPP
+#define COMMON_I_INTEGRATOR_HPP
+
+#include <string>
+
+#include "common/result.hpp"
+#include "common/i_force_engine.hpp"
+#include "common/particle_store.hpp"
+
+namespace evo {
+
+/**
+ * An interface for time integrators that advance the positions and velocities
+ * of the bodies in a ParticleStore by one timestep.
+ */
+class IIntegrator
+{
+public:
+
+  virtual ~IIntegrator ()
+  {}
+
+  /** Name of the integration scheme, for log messages.
+   */
+  virtual std::string name () const = 0;
+
+  /** Number of times Step() calls IForceEngine::ComputeAccelerations(),
+   once the integrator has warmed up.
+   */
+  virtual int force_evaluations_per_step () const = 0;
+
+  /**
+   * Advances \p things by \p dt.  On return, the bodies' accelerations match
+   * their new positions.
+   * @param dt The timestep, in seconds.
+   * @param G The gravitational constant.
+   * @param force_engine Solver used to compute accelerations; if null, the
+   * bodies move ballistically.
+   * @param things The bodies.
+   * @return SUCCESS, or the force engine's error.
+   */
+  virtual Result Step (float dt, double G, IForceEngine* force_engine,
+                       ParticleStore* things) = 0;
+
+  /**
+   * Tells the integrator that the accelerations stored in the ParticleStore
+   * no longer match the bodies' positions (e.g. a body was added or the force
+   * engine was replaced), so they are recomputed before the next Step().
+   */
+  virtual void InvalidateAccelerations () = 0;
+};
+
+}
+
+#endif
@@ -0,0 +1,181 @@
+#include <algorithm>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <string>
+
+#include "common/util.hpp"
+#include "common/latency_histogram.hpp"
+
+using namespace std;
+using namespace evo;
+
+static map<string, unique_ptr<LatencyHistogram>> g_histograms;
+static mutex g_histograms_mutex;
+
+/** Steady clock time of the last LogStatsPeriodically() output, in ns
+ */
+static atomic<int64_t> g_last_stats_log_ns (0);
+
+LatencyHistogram :: LatencyHistogram (const string& name)
+  : name_(name),
+    buckets_(new atomic<uint64_t> [kNumBuckets])
+{
+  Reset();
+}
+
+int64_t LatencyHistogram :: BucketIndex (int64_t ns)
+{
+  if (ns < kExactLimit) {
+    return std::max<int64_t>(ns, 0);
+  }
+
+  const int exponent = 63 - __builtin_clzll(static_cast<uint64_t>(ns));
+  if (exponent >= kMaxExponent) {
+    return kNumBuckets - 1;
+  }
+
+  // the kSubBucketBits bits below the leading one pick the sub-bucket
+  const int64_t sub_bucket = (ns >> (exponent - kSubBucketBits)) - kSubBuckets;
+  return kExactLimit + (exponent - kSubBucketBits - 1) * kSubBuckets +
+         sub_bucket;
+}
+
+int64_t LatencyHistogram :: BucketValue (int64_t index)
+{
+  if (index < kExactLimit) {
+    return index;
+  }
+
+  const int64_t octave = (index - kExactLimit) / kSubBuckets;
+  const int64_t sub_bucket = (index - kExactLimit) % kSubBuckets;
+  const int shift = static_cast<int>(octave) + 1;
+  const int64_t lowest = (kSubBuckets + sub_bucket) << shift;
+  return lowest + (int64_t(1) << shift) / 2;
+}
+
+void LatencyHistogram :: RecordNanoseconds (int64_t ns)
+{
+  ns = std::max<int64_t>(ns, 0);
+
+  buckets_[BucketIndex(ns)].fetch_add(1, memory_order_relaxed);
+  count_.fetch_add(1, memory_order_relaxed);
+  sum_.fetch_add(ns, memory_order_relaxed);
+
+  int64_t prev = min_.load(memory_order_relaxed);
+  while (ns < prev &&
+         !min_.compare_exchange_weak(prev, ns, memory_order_relaxed)) {
+  }
+  prev = max_.load(memory_order_relaxed);
+  while (ns > prev &&
+         !max_.compare_exchange_weak(prev, ns, memory_order_relaxed)) {
+  }
+}
+
+Duration LatencyHistogram :: min () const
+{
+  return Duration(0 == count() ? 0 : min_.load(memory_order_relaxed));
+}
+
+Duration LatencyHistogram :: max () const
+{
+  return Duration(max_.load(memory_order_relaxed));
+}
+
+Duration LatencyHistogram :: mean () const
+{
+  const int64_t n = count();
+  return Duration(0 == n ? 0 : sum_.load(memory_order_relaxed) / n);
+}
+
+Duration LatencyHistogram :: Percentile (double percentile) const
+{
+  // count_ may run ahead of the buckets while others record; sum the
+  // buckets instead
+  uint64_t total = 0;
+  for (int64_t i = 0; i < kNumBuckets; ++i) {
+    total += buckets_[i].load(memory_order_relaxed);
+  }
+  if (0 == total) {
+    return Duration(0);
+  }
+
+  const double fraction = std::min(std::max(percentile, 0.0), 100.0) / 100.0;
+  const uint64_t rank = std::max<uint64_t>(
+      static_cast<uint64_t>(fraction * total + 0.5), 1);
+
+  uint64_t seen = 0;
+  for (int64_t i = 0; i < kNumBuckets; ++i)
+  {
+    seen += buckets_[i].load(memory_order_relaxed);
+    if (seen >= rank) {
+      // never report more than was actually seen
+      return std::min(Duration(BucketValue(i)), max());
+    }
+  }
+  return max();
+}
+
+void LatencyHistogram :: Reset ()
+{
+  for (int64_t i = 0; i < kNumBuckets; ++i) {
+    buckets_[i].store(0, memory_order_relaxed);
+  }
+  count_.store(0, memory_order_relaxed);
+  sum_.store(0, memory_order_relaxed);
+  min_.store(INT64_MAX, memory_order_relaxed);
+  max_.store(0, memory_order_relaxed);
+}
+
+string LatencyHistogram :: ToString () const
+{
+  std::stringstream strm;
+  strm << name_ << ": n = " << count()
+       << ", p50 = " << Percentile(50).ToStringPretty()
+       << ", p99 = " << Percentile(99).ToStringPretty()
+       << ", max = " << max().ToStringPretty();
+  return strm.str();
+}
+
+LatencyHistogram* evo::GetLatencyHistogram (const string& name)
+{
+  lock_guard<mutex> lock (g_histograms_mutex);
+
+  unique_ptr<LatencyHistogram>& histogram = g_histograms[name];
+  if (!histogram) {
+    histogram.reset(new LatencyHistogram(name));
+  }
+  return histogram.get();
+}
+
+string evo::DumpStats ()
+{
+  lock_guard<mutex> lock (g_histograms_mutex);
+
+  std::stringstream strm;
+  for (const auto& name_histogram : g_histograms) {
+    if (name_histogram.second->count() > 0) {
+      strm << name_histogram.second->ToString() << "\n";
+    }
+  }
+  return strm.str();
+}
+
+void evo::LogStatsPeriodically (Duration period)
+{
+  const int64_t now = SteadyTimePoint::Now().since_epoch().Nanoseconds();
+  int64_t last = g_last_stats_log_ns.load(memory_order_relaxed);
+
+  if (now - last < period.Nanoseconds() ||
+      !g_last_stats_log_ns.compare_exchange_strong(last, now,
+                                                   memory_order_relaxed)) {
+    // not due yet, or another thread is logging this round
+    return;
+  }
+
+  std::stringstream strm (DumpStats());
+  string line;
+  while (getline(strm, line)) {
+    QLOG(INFO) << line;
+  }
+}
@@ -0,0 +1,146 @@
+#ifndef COMMON_LATENCY_HISTOGRAM_HPP
+#define COMMON_LATENCY_HISTOGRAM_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "common/i_stringable.hpp"
+#include "common/time_measures.hpp"
+
+namespace evo {
+
+/** HDR-style histogram of durations: exact below kExactLimit ns, and above
+ that kSubBuckets linear buckets per power of two, i.e. a relative error of
+ at most 1 / kSubBuckets (about 1.6%), up to kMaxExponent (~73 minutes);
+ longer durations land in the top bucket.
+
+ Record() is lock-free and wait-free apart from the min / max updates, which
+ are CAS loops that rarely retry, so any number of threads may record into
+ the same histogram.  The readers (Percentile() etc.) see a consistent enough
+ picture for reporting but not an atomic snapshot.
+ */
+class LatencyHistogram : public IStringable
+{
+public:
+
+  static const int kSubBucketBits = 6;
+  static const int64_t kSubBuckets = int64_t(1) << kSubBucketBits;
+  static const int64_t kExactLimit = 2 * kSubBuckets;
+  static const int kMaxExponent = 42;
+
+  explicit LatencyHistogram (const std::string& name);
+
+  LatencyHistogram (const LatencyHistogram& copy_src) = delete;
+
+  LatencyHistogram& operator = (const LatencyHistogram& copy_src) = delete;
+
+  const std::string& name () const {
+    return name_;
+  }
+
+  /** Negative durations count as zero
+   */
+  void Record (Duration duration) {
+    RecordNanoseconds(duration.Nanoseconds());
+  }
+
+  void RecordNanoseconds (int64_t ns);
+
+  int64_t count () const {
+    return count_.load(std::memory_order_relaxed);
+  }
+
+  Duration min () const;
+
+  Duration max () const;
+
+  Duration mean () const;
+
+  /** Smallest recorded duration that \p percentile percent of the samples
+   don't exceed, to within the bucket resolution; zero if empty.
+   */
+  Duration Percentile (double percentile) const;
+
+  /** Not atomic with respect to concurrent Record() calls, which may be
+   partly lost or partly kept.
+   */
+  void Reset ();
+
+  /** e.g. "name: n = 1000, p50 = 1.2 ms, p99 = 3.4 ms, max = 5.6 ms"
+   */
+  virtual std::string ToString () const override;
+
+private:
+
+  static const int64_t kNumBuckets =
+      kExactLimit + (kMaxExponent - kSubBucketBits) * kSubBuckets;
+
+  static int64_t BucketIndex (int64_t ns);
+
+  /** Midpoint of the values that land in \p index
+   */
+  static int64_t BucketValue (int64_t index);
+
+  std::string name_;
+
+  std::unique_ptr<std::atomic<uint64_t>[]> buckets_;
+  std::atomic<int64_t> count_;
+  std::atomic<int64_t> sum_;
+  std::atomic<int64_t> min_;
+  std::atomic<int64_t> max_;
+};
+
+/** Records the time from construction to destruction into a histogram, e.g.
+ for one phase of a tick.  Does nothing if the histogram is null.  Timed with
+ FastClock, so cheap enough for fine-grained phases.
+ */
+class ScopedLatencyTimer
+{
+public:
+
+  explicit ScopedLatencyTimer (LatencyHistogram* histogram)
+    : histogram_(histogram),
+      start_(0)
+  {
+    if (histogram_) {
+      start_ = FastClock::Now();
+    }
+  }
+
+  ~ScopedLatencyTimer () {
+    if (histogram_) {
+      histogram_->Record(FastClock::ToDuration(FastClock::Now() - start_));
+    }
+  }
+
+  ScopedLatencyTimer (const ScopedLatencyTimer& copy_src) = delete;
+
+  ScopedLatencyTimer& operator = (const ScopedLatencyTimer& copy_src) = delete;
+
+private:
+
+  LatencyHistogram* histogram_;
+  FastClock::Ticks start_;
+};
+
+/** The process-wide histogram called \p name, created on first use.  It is
+ never freed, so callers should look it up once and keep the pointer; the
+ lookup itself takes a mutex.
+ */
+LatencyHistogram* GetLatencyHistogram (const std::string& name);
+
+/** One line per histogram with samples (see LatencyHistogram::ToString()),
+ sorted by name
+ */
+std::string DumpStats ();
+
+/** QLOGs DumpStats() if at least \p period has passed since it last did so;
+ otherwise costs one clock read.  For calling from a loop, from any thread.
+ */
+void LogStatsPeriodically (Duration period);
+
+}
+
+#endif
@@ -0,0 +1,472 @@
+
+#include <cmath>
+#include <cassert>
+#include <algorithm>
+#include <string>
+
+#include "common/particle_mesh.hpp"
+
+using namespace std;
+using namespace evo;
+using namespace std_results;
+
+ParticleMeshGravity :: ParticleMeshGravity (int grid_size, float box_size,
+                                            const Coords3& box_origin)
+  : grid_size_(grid_size),
+    box_size_(box_size),
+    box_origin_(box_origin),
+    short_range_correction_(false),
+    split_scale_cells_(kDefaultSplitScaleCells),
+    softening_(0),
+    is_init_(false)
+{
+}
+
+ParticleMeshGravity :: ~ParticleMeshGravity ()
+{
+}
+
+Result ParticleMeshGravity :: Init ()
+{
+  if (grid_size_ < 4 || 0 != (grid_size_ & (grid_size_ - 1))) {
+    return INVALID_ARGUMENT.Prepend(
+        "ParticleMeshGravity: grid size must be a power of two >= 4, got "
+        + to_string(grid_size_));
+  }
+  if (!(box_size_ > 0)) {
+    return INVALID_ARGUMENT.Prepend(
+        "ParticleMeshGravity: box size must be positive");
+  }
+
+  const size_t n_cells =
+      static_cast<size_t>(grid_size_) * grid_size_ * grid_size_;
+
+  grid_.assign(n_cells, Complex(0, 0));
+  grid_ax_.assign(n_cells, 0.0f);
+  grid_ay_.assign(n_cells, 0.0f);
+  grid_az_.assign(n_cells, 0.0f);
+
+  twiddles_.resize(grid_size_ / 2);
+  for (int k = 0; k < grid_size_ / 2; ++k) {
+    double angle = -2.0 * M_PI * k / grid_size_;
+    twiddles_[k] = Complex(cos(angle), sin(angle));
+  }
+
+  int log2_size = 0;
+  while ((1 << log2_size) < grid_size_) {
+    ++log2_size;
+  }
+  bit_reverse_.resize(grid_size_);
+  for (int i = 0; i < grid_size_; ++i)
+  {
+    int rev = 0;
+    for (int b = 0; b < log2_size; ++b) {
+      if (i & (1 << b)) {
+        rev |= 1 << (log2_size - 1 - b);
+      }
+    }
+    bit_reverse_[i] = rev;
+  }
+
+  fft_line_.resize(grid_size_);
+
+  is_init_ = true;
+
+  return SUCCESS;
+}
+
+Result ParticleMeshGravity :: ComputeAccelerations (double G,
+                                                    ParticleStore* things)
+{
+  Result res;
+
+  if (!things) {
+    return INVALID_ARGUMENT.Prepend("ParticleMeshGravity: things is null");
+  }
+
+  if (!is_init_ && SUCCESS != (res = Init())) {
+    return res;
+  }
+
+  if (things->empty()) {
+    return SUCCESS;
+  }
+
+  Deposit(*things);
+  Fft3d(false);
+  SolvePotential(G);
+  Fft3d(true);
+  DifferentiatePotential();
+  Interpolate(things);
+
+  if (short_range_correction_) {
+    AddShortRange(G, things);
+  }
+
+  return SUCCESS;
+}
+
+float ParticleMeshGravity :: ToGridUnits (float pos, float origin) const
+{
+  const float m = static_cast<float>(grid_size_);
+  float u = (pos - origin) * (m / box_size_);
+  u -= m * floorf(u / m);
+  // floating point rounding can land exactly on the far face
+  if (u >= m) {
+    u = 0;
+  }
+  return u;
+}
+
+void ParticleMeshGravity :: Deposit (const ParticleStore& things)
+{
+  const size_t n = things.size();
+  const float* x = things.x();
+  const float* y = things.y();
+  const float* z = things.z();
+  const float* mass = things.mass();
+  const int mask = grid_size_ - 1;
+  const double h = static_cast<double>(box_size_) / grid_size_;
+  const double inv_cell_volume = 1.0 / (h * h * h);
+
+  std::fill(grid_.begin(), grid_.end(), Complex(0, 0));
+
+  for (size_t p = 0; p < n; ++p)
+  {
+    const float ux = ToGridUnits(x[p], box_origin_.x);
+    const float uy = ToGridUnits(y[p], box_origin_.y);
+    const float uz = ToGridUnits(z[p], box_origin_.z);
+    const int i0 = static_cast<int>(ux);
+    const int j0 = static_cast<int>(uy);
+    const int k0 = static_cast<int>(uz);
+    const int i1 = (i0 + 1) & mask;
+    const int j1 = (j0 + 1) & mask;
+    const int k1 = (k0 + 1) & mask;
+    const double fx = ux - i0, fy = uy - j0, fz = uz - k0;
+    const double gx = 1 - fx,  gy = 1 - fy,  gz = 1 - fz;
+    const double rho = mass[p] * inv_cell_volume;
+
+    grid_[CellIndex(i0, j0, k0)] += rho * gx * gy * gz;
+    grid_[CellIndex(i0, j0, k1)] += rho * gx * gy * fz;
+    grid_[CellIndex(i0, j1, k0)] += rho * gx * fy * gz;
+    grid_[CellIndex(i0, j1, k1)] += rho * gx * fy * fz;
+    grid_[CellIndex(i1, j0, k0)] += rho * fx * gy * gz;
+    grid_[CellIndex(i1, j0, k1)] += rho * fx * gy * fz;
+    grid_[CellIndex(i1, j1, k0)] += rho * fx * fy * gz;
+    grid_[CellIndex(i1, j1, k1)] += rho * fx * fy * fz;
+  }
+}
+
+static inline double Sinc (double x)
+{
+  return (0 == x ? 1.0 : sin(x) / x);
+}
+
+void ParticleMeshGravity :: SolvePotential (double G)
+{
+  const int m = grid_size_;
+  const double k_unit = 2.0 * M_PI / box_size_;
+  const double h = static_cast<double>(box_size_) / m;
+  const double rs = split_scale_cells_ * h;
+  const double rs2 = (short_range_correction_ ? rs * rs : 0.0);
+
+  for (int a = 0; a < m; ++a)
+  {
+    const int na = (a < m / 2 ? a : a - m);
+    const double ka = k_unit * na;
+    const double wa = Sinc(M_PI * na / m);
+
+    for (int b = 0; b < m; ++b)
+    {
+      const int nb = (b < m / 2 ? b : b - m);
+      const double kb = k_unit * nb;
+      const double wb = Sinc(M_PI * nb / m);
+
+      for (int c = 0; c < m; ++c)
+      {
+        const int nc = (c < m / 2 ? c : c - m);
+        const double kc = k_unit * nc;
+        const double wc = Sinc(M_PI * nc / m);
+        const double k2 = ka*ka + kb*kb + kc*kc;
+        Complex& cell = grid_[CellIndex(a, b, c)];
+
+        if (0 == k2) {
+          // drop the mean density
+          cell = 0;
+          continue;
+        }
+
+        // the CIC window is sinc^2 per axis and is applied twice (deposit
+        // and interpolation), so deconvolve by sinc^4
+        const double w = wa * wb * wc;
+        const double w2 = w * w;
+        double green = -4.0 * M_PI * G / (k2 * w2 * w2);
+        if (rs2 > 0) {
+          green *= exp(-k2 * rs2);
+        }
+        cell *= green;
+      }
+    }
+  }
+}
+
+void ParticleMeshGravity :: DifferentiatePotential ()
+{
+  const int m = grid_size_;
+  const int mask = m - 1;
+  const double h = static_cast<double>(box_size_) / m;
+  // fourth-order central difference: -(8(p1 - m1) - (p2 - m2)) / 12h
+  const double scale = -1.0 / (12.0 * h);
+
+  for (int i = 0; i < m; ++i)
+  {
+    const int ip1 = (i + 1) & mask, ip2 = (i + 2) & mask;
+    const int im1 = (i - 1) & mask, im2 = (i - 2) & mask;
+
+    for (int j = 0; j < m; ++j)
+    {
+      const int jp1 = (j + 1) & mask, jp2 = (j + 2) & mask;
+      const int jm1 = (j - 1) & mask, jm2 = (j - 2) & mask;
+
+      for (int k = 0; k < m; ++k)
+      {
+        const int kp1 = (k + 1) & mask, kp2 = (k + 2) & mask;
+        const int km1 = (k - 1) & mask, km2 = (k - 2) & mask;
+        const size_t cell = CellIndex(i, j, k);
+
+        grid_ax_[cell] = static_cast<float>(scale * (
+            8.0 * (grid_[CellIndex(ip1, j, k)].real() - grid_[CellIndex(im1, j, k)].real())
+                - (grid_[CellIndex(ip2, j, k)].real() - grid_[CellIndex(im2, j, k)].real()) ));
+        grid_ay_[cell] = static_cast<float>(scale * (
+            8.0 * (grid_[CellIndex(i, jp1, k)].real() - grid_[CellIndex(i, jm1, k)].real())
+                - (grid_[CellIndex(i, jp2, k)].real() - grid_[CellIndex(i, jm2, k)].real()) ));
+        grid_az_[cell] = static_cast<float>(scale * (
+            8.0 * (grid_[CellIndex(i, j, kp1)].real() - grid_[CellIndex(i, j, km1)].real())
+                - (grid_[CellIndex(i, j, kp2)].real() - grid_[CellIndex(i, j, km2)].real()) ));
+      }
+    }
+  }
+}
+
+void ParticleMeshGravity :: Interpolate (ParticleStore* things) const
+{
+  const size_t n = things->size();
+  const float* x = things->x();
+  const float* y = things->y();
+  const float* z = things->z();
+  float* ax = things->ax();
+  float* ay = things->ay();
+  float* az = things->az();
+  const int mask = grid_size_ - 1;
+
+  for (size_t p = 0; p < n; ++p)
+  {
+    const float ux = ToGridUnits(x[p], box_origin_.x);
+    const float uy = ToGridUnits(y[p], box_origin_.y);
+    const float uz = ToGridUnits(z[p], box_origin_.z);
+    const int i0 = static_cast<int>(ux);
+    const int j0 = static_cast<int>(uy);
+    const int k0 = static_cast<int>(uz);
+    const int i1 = (i0 + 1) & mask;
+    const int j1 = (j0 + 1) & mask;
+    const int k1 = (k0 + 1) & mask;
+    const float fx = ux - i0, fy = uy - j0, fz = uz - k0;
+    const float gx = 1 - fx,  gy = 1 - fy,  gz = 1 - fz;
+
+    const size_t cells [8] = {
+      CellIndex(i0, j0, k0), CellIndex(i0, j0, k1),
+      CellIndex(i0, j1, k0), CellIndex(i0, j1, k1),
+      CellIndex(i1, j0, k0), CellIndex(i1, j0, k1),
+      CellIndex(i1, j1, k0), CellIndex(i1, j1, k1) };
+    const float weights [8] = {
+      gx * gy * gz, gx * gy * fz, gx * fy * gz, gx * fy * fz,
+      fx * gy * gz, fx * gy * fz, fx * fy * gz, fx * fy * fz };
+
+    float sx = 0, sy = 0, sz = 0;
+    for (int c = 0; c < 8; ++c) {
+      sx += weights[c] * grid_ax_[cells[c]];
+      sy += weights[c] * grid_ay_[cells[c]];
+      sz += weights[c] * grid_az_[cells[c]];
+    }
+
+    ax[p] = sx;
+    ay[p] = sy;
+    az[p] = sz;
+  }
+}
+
+void ParticleMeshGravity :: AddShortRange (double G, ParticleStore* things)
+{
+  const size_t n = things->size();
+  const float* x = things->x();
+  const float* y = things->y();
+  const float* z = things->z();
+  const float* mass = things->mass();
+  float* ax = things->ax();
+  float* ay = things->ay();
+  float* az = things->az();
+
+  const double box = box_size_;
+  const double h = box / grid_size_;
+  const double rs = split_scale_cells_ * h;
+  const double r_cut = kShortRangeCutoff * rs;
+  const double r_cut2 = r_cut * r_cut;
+  const double eps2 = static_cast<double>(softening_) * softening_;
+  const double inv_sqrt_pi = 1.0 / sqrt(M_PI);
+
+  // chaining mesh with cells at least r_cut wide, so only the 27 surrounding
+  // cells need to be searched; with fewer than 3 cells per axis the
+  // neighbourhood would wrap onto itself, so fall back to a single cell
+  int nc = static_cast<int>(box / r_cut);
+  if (nc < 3) {
+    nc = 1;
+  }
+  const double chain_scale = nc / box;
+
+  chain_heads_.assign(static_cast<size_t>(nc) * nc * nc, -1);
+  chain_next_.resize(n);
+
+  vector<int> body_cell (3 * n);
+  for (size_t p = 0; p < n; ++p)
+  {
+    int ci = min(nc - 1, static_cast<int>(ToGridUnits(x[p], box_origin_.x) * h * chain_scale));
+    int cj = min(nc - 1, static_cast<int>(ToGridUnits(y[p], box_origin_.y) * h * chain_scale));
+    int ck = min(nc - 1, static_cast<int>(ToGridUnits(z[p], box_origin_.z) * h * chain_scale));
+    body_cell[3*p]   = ci;
+    body_cell[3*p+1] = cj;
+    body_cell[3*p+2] = ck;
+    size_t cell = (static_cast<size_t>(ci) * nc + cj) * nc + ck;
+    chain_next_[p] = chain_heads_[cell];
+    chain_heads_[cell] = static_cast<int32_t>(p);
+  }
+
+  const int reach = (nc >= 3 ? 1 : 0);
+
+  for (size_t p = 0; p < n; ++p)
+  {
+    double sx = 0, sy = 0, sz = 0;
+
+    for (int di = -reach; di <= reach; ++di)
+    for (int dj = -reach; dj <= reach; ++dj)
+    for (int dk = -reach; dk <= reach; ++dk)
+    {
+      const int ci = (body_cell[3*p]   + di + nc) % nc;
+      const int cj = (body_cell[3*p+1] + dj + nc) % nc;
+      const int ck = (body_cell[3*p+2] + dk + nc) % nc;
+      const size_t cell = (static_cast<size_t>(ci) * nc + cj) * nc + ck;
+
+      for (int32_t q = chain_heads_[cell]; q >= 0; q = chain_next_[q])
+      {
+        if (static_cast<size_t>(q) == p) {
+          continue;
+        }
+        // minimum image displacement
+        double dx = static_cast<double>(x[q]) - x[p];
+        double dy = static_cast<double>(y[q]) - y[p];
+        double dz = static_cast<double>(z[q]) - z[p];
+        dx -= box * nearbyint(dx / box);
+        dy -= box * nearbyint(dy / box);
+        dz -= box * nearbyint(dz / box);
+
+        const double r2 = dx*dx + dy*dy + dz*dz;
+        if (r2 > r_cut2) {
+          continue;
+        }
+        const double d2 = r2 + eps2;
+        if (0 == d2) {
+          continue;
+        }
+        const double d = sqrt(d2);
+        const double u = d / (2.0 * rs);
+        const double split = erfc(u) + (d / rs) * inv_sqrt_pi * exp(-u * u);
+        const double s = mass[q] * split / (d2 * d);
+        sx += dx * s;
+        sy += dy * s;
+        sz += dz * s;
+      }
+    }
+
+    ax[p] += static_cast<float>(G * sx);
+    ay[p] += static_cast<float>(G * sy);
+    az[p] += static_cast<float>(G * sz);
+  }
+}
+
+void ParticleMeshGravity :: Fft1d (Complex* data, bool inverse) const
+{
+  const int m = grid_size_;
+
+  for (int i = 0; i < m; ++i) {
+    const int r = bit_reverse_[i];
+    if (r > i) {
+      std::swap(data[i], data[r]);
+    }
+  }
+
+  for (int len = 2; len <= m; len <<= 1)
+  {
+    const int half = len >> 1;
+    const int step = m / len;
+    for (int i = 0; i < m; i += len)
+    {
+      for (int j = 0; j < half; ++j)
+      {
+        Complex w = twiddles_[j * step];
+        if (inverse) {
+          w = conj(w);
+        }
+        const Complex u = data[i + j];
+        const Complex v = data[i + j + half] * w;
+        data[i + j] = u + v;
+        data[i + j + half] = u - v;
+      }
+    }
+  }
+}
+
+void ParticleMeshGravity :: Fft3d (bool inverse)
+{
+  const int m = grid_size_;
+  const size_t plane = static_cast<size_t>(m) * m;
+
+  // innermost axis is contiguous; transform in place
+  for (int i = 0; i < m; ++i) {
+    for (int j = 0; j < m; ++j) {
+      Fft1d(&grid_[CellIndex(i, j, 0)], inverse);
+    }
+  }
+
+  // the other two axes are strided; gather each line into a scratch buffer
+  for (int i = 0; i < m; ++i) {
+    for (int k = 0; k < m; ++k) {
+      Complex* base = &grid_[CellIndex(i, 0, k)];
+      for (int j = 0; j < m; ++j) {
+        fft_line_[j] = base[static_cast<size_t>(j) * m];
+      }
+      Fft1d(fft_line_.data(), inverse);
+      for (int j = 0; j < m; ++j) {
+        base[static_cast<size_t>(j) * m] = fft_line_[j];
+      }
+    }
+  }
+
+  for (int j = 0; j < m; ++j) {
+    for (int k = 0; k < m; ++k) {
+      Complex* base = &grid_[CellIndex(0, j, k)];
+      for (int i = 0; i < m; ++i) {
+        fft_line_[i] = base[i * plane];
+      }
+      Fft1d(fft_line_.data(), inverse);
+      for (int i = 0; i < m; ++i) {
+        base[i * plane] = fft_line_[i];
+      }
+    }
+  }
+
+  if (inverse) {
+    const double norm = 1.0 / (static_cast<double>(plane) * m);
+    for (Complex& cell : grid_) {
+      cell *= norm;
+    }
+  }
+}
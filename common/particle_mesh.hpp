@@ -0,0 +1,166 @@
+#ifndef COMMON_PARTICLE_MESH_HPP
+#define COMMON_PARTICLE_MESH_HPP
+
+#include <complex>
+#include <vector>
+
+#include "common/aligned_allocator.hpp"
+#include "common/i_force_engine.hpp"
+#include "common/particle_store.hpp"
+#include "common/result.hpp"
+#include "common/util.hpp"
+
+namespace evo {
+
+/** Particle-mesh gravity solver for large, roughly uniform universes with
+ periodic boundaries.  Each call deposits the bodies' masses onto a cubic
+ grid with cloud-in-cell (CIC) weights, solves Poisson's equation with an
+ FFT, differentiates the potential on the grid, and interpolates the
+ accelerations back to the bodies with the same CIC weights.
+ Cost is O(N + M log M) for M grid cells.
+
+ The mean density is subtracted (the k = 0 mode is dropped), as is usual for
+ periodic cosmological boxes, so an isolated clump does not feel its own
+ periodic images' net pull.
+
+ Forces are only resolved down to a couple of grid cells.  Enabling the
+ short-range correction turns this into a P3M solver: the mesh force is
+ smoothed with a Gaussian of width split_scale(), and the remaining
+ short-range part is summed directly over neighbours within
+ kShortRangeCutoff split scales.
+ */
+class ParticleMeshGravity : public IForceEngine
+{
+public:
+
+  static const int kDefaultGridSize = 64;
+
+  /** Width of the Gaussian force split, in grid cells
+   */
+  static constexpr float kDefaultSplitScaleCells = 1.25f;
+
+  /** Short-range pairs further apart than this many split scales are
+   ignored; the neglected force is below 1e-4 of the Newtonian value
+   */
+  static constexpr float kShortRangeCutoff = 4.5f;
+
+  /** @param grid_size Cells per axis; must be a power of two.
+   @param box_size Edge length of the periodic box.
+   @param box_origin Corner of the periodic box with the smallest coordinates.
+   */
+  ParticleMeshGravity (int grid_size, float box_size,
+                       const Coords3& box_origin = Coords3());
+
+  virtual ~ParticleMeshGravity ();
+
+  int grid_size () const {
+    return grid_size_;
+  }
+
+  float box_size () const {
+    return box_size_;
+  }
+
+  const Coords3& box_origin () const {
+    return box_origin_;
+  }
+
+  /** Whether the direct short-range (P3M) correction is applied.
+   */
+  bool short_range_correction () const {
+    return short_range_correction_;
+  }
+
+  void set_short_range_correction (bool enable) {
+    short_range_correction_ = enable;
+  }
+
+  /** Gaussian force-split scale used by the short-range correction, in grid
+   cells.
+   */
+  float split_scale_cells () const {
+    return split_scale_cells_;
+  }
+
+  void set_split_scale_cells (float val) {
+    split_scale_cells_ = val;
+  }
+
+  /** Plummer softening length applied to the short-range pair sum.
+   */
+  float softening () const {
+    return softening_;
+  }
+
+  void set_softening (float val) {
+    softening_ = val;
+  }
+
+  /** Bodies outside the box are wrapped back into it before the accelerations
+   are computed; their stored positions are left untouched.
+   */
+  virtual Result ComputeAccelerations (double G, ParticleStore* things) override;
+
+private:
+
+  typedef std::complex<double> Complex;
+
+  Result Init ();
+
+  size_t CellIndex (int i, int j, int k) const {
+    return (static_cast<size_t>(i) * grid_size_ + j) * grid_size_ + k;
+  }
+
+  /** Converts \p pos into grid units, wrapped into [0, grid_size)
+   */
+  float ToGridUnits (float pos, float origin) const;
+
+  void Deposit (const ParticleStore& things);
+
+  void SolvePotential (double G);
+
+  void DifferentiatePotential ();
+
+  void Interpolate (ParticleStore* things) const;
+
+  void AddShortRange (double G, ParticleStore* things);
+
+  void Fft1d (Complex* data, bool inverse) const;
+
+  void Fft3d (bool inverse);
+
+  int grid_size_;
+  float box_size_;
+  Coords3 box_origin_;
+  bool short_range_correction_;
+  float split_scale_cells_;
+  float softening_;
+
+  bool is_init_;
+
+  /** Density, and after SolvePotential(), potential
+   */
+  std::vector<Complex> grid_;
+
+  /** Mesh accelerations
+   */
+  AlignedFloatVector grid_ax_;
+  AlignedFloatVector grid_ay_;
+  AlignedFloatVector grid_az_;
+
+  /** Twiddle factors and bit-reversal permutation for a grid_size_-point FFT
+   */
+  std::vector<Complex> twiddles_;
+  std::vector<int> bit_reverse_;
+  std::vector<Complex> fft_line_;
+
+  /** Chaining mesh for the short-range sum: heads of per-cell linked lists
+   and the next-body links
+   */
+  std::vector<int32_t> chain_heads_;
+  std::vector<int32_t> chain_next_;
+};
+
+}
+
+#endif
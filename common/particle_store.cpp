@@ -0,0 +1,177 @@
+
+#include <string>
+#include <sstream>
+#include <algorithm>
+#include <cassert>
+
+#include "common/particle_store.hpp"
+#include "common/task_pool.hpp"
+
+using namespace std;
+using namespace evo;
+
+void SphericalThingView :: CopyTo (SphericalThing* thing) const
+{
+  store_->CopyTo(index_, thing);
+}
+
+string SphericalThingView :: ToString () const
+{
+  std::stringstream strm;
+  strm << "mass = " << mass()
+       << ", radius = " << radius()
+       << ", pos = { " << pos().ToString()
+       << " }, vel = { " << vel().ToString()
+       << " }, accel = { " << accel().ToString() << " }";
+  return strm.str();
+}
+
+
+ParticleStore :: ParticleStore ()
+{
+}
+
+ParticleStore :: ~ParticleStore ()
+{
+}
+
+/** First-touches the storage behind floats [begin, end) of \p array, which
+ must be past its size() but within its capacity().  Those floats don't exist
+ yet, so the storage is touched as raw bytes of the allocator's block rather
+ than through the vector's elements.
+ */
+static void TouchReservedFloats (AlignedFloatVector* array, size_t begin,
+                                 size_t end)
+{
+  assert (begin >= array->size() && end <= array->capacity());
+
+  unsigned char* storage = reinterpret_cast<unsigned char*>(array->data());
+  TouchPages(storage + begin * sizeof(float), (end - begin) * sizeof(float));
+}
+
+void ParticleStore :: Reserve (size_t capacity, TaskPool* pool)
+{
+  const bool grows = (capacity > mass_.capacity());
+
+  x_.reserve(capacity);
+  y_.reserve(capacity);
+  z_.reserve(capacity);
+  vx_.reserve(capacity);
+  vy_.reserve(capacity);
+  vz_.reserve(capacity);
+  ax_.reserve(capacity);
+  ay_.reserve(capacity);
+  az_.reserve(capacity);
+  mass_.reserve(capacity);
+  radius_.reserve(capacity);
+
+  if (!grows || !pool || 0 == pool->n_workers()) {
+    return;
+  }
+
+  // the bodies already present were copied over, and so placed, by the
+  // calling thread; the rest of the new storage is split among the workers
+  const size_t first = size();
+  const size_t n_workers = pool->n_workers();
+  pool->RunOnEachWorker([&] (int w) {
+    const size_t begin = first + (capacity - first) * w / n_workers;
+    const size_t end = first + (capacity - first) * (w + 1) / n_workers;
+    for (AlignedFloatVector* array : { &x_, &y_, &z_, &vx_, &vy_, &vz_,
+                                       &ax_, &ay_, &az_, &mass_, &radius_ }) {
+      TouchReservedFloats(array, begin, end);
+    }
+  });
+}
+
+void ParticleStore :: Clear ()
+{
+  x_.clear();
+  y_.clear();
+  z_.clear();
+  vx_.clear();
+  vy_.clear();
+  vz_.clear();
+  ax_.clear();
+  ay_.clear();
+  az_.clear();
+  mass_.clear();
+  radius_.clear();
+}
+
+size_t ParticleStore :: Add (const SphericalThing& thing)
+{
+  size_t index = Add(thing.mass(), thing.radius(), thing.pos(), thing.vel());
+
+  ax_[index] = thing.accel().x;
+  ay_[index] = thing.accel().y;
+  az_[index] = thing.accel().z;
+
+  return index;
+}
+
+size_t ParticleStore :: Add (float mass, float radius, const Coords3& pos,
+                             const Coords3& vel)
+{
+  x_.push_back(pos.x);
+  y_.push_back(pos.y);
+  z_.push_back(pos.z);
+  vx_.push_back(vel.x);
+  vy_.push_back(vel.y);
+  vz_.push_back(vel.z);
+  ax_.push_back(0);
+  ay_.push_back(0);
+  az_.push_back(0);
+  mass_.push_back(mass);
+  radius_.push_back(radius);
+
+  return mass_.size() - 1;
+}
+
+void ParticleStore :: Remove (size_t index)
+{
+  assert (index < size());
+
+  size_t last = size() - 1;
+
+  if (index != last) {
+    x_[index] = x_[last];
+    y_[index] = y_[last];
+    z_[index] = z_[last];
+    vx_[index] = vx_[last];
+    vy_[index] = vy_[last];
+    vz_[index] = vz_[last];
+    ax_[index] = ax_[last];
+    ay_[index] = ay_[last];
+    az_[index] = az_[last];
+    mass_[index] = mass_[last];
+    radius_[index] = radius_[last];
+  }
+
+  x_.pop_back();
+  y_.pop_back();
+  z_.pop_back();
+  vx_.pop_back();
+  vy_.pop_back();
+  vz_.pop_back();
+  ax_.pop_back();
+  ay_.pop_back();
+  az_.pop_back();
+  mass_.pop_back();
+  radius_.pop_back();
+}
+
+void ParticleStore :: ZeroAccelerations ()
+{
+  std::fill(ax_.begin(), ax_.end(), 0.0f);
+  std::fill(ay_.begin(), ay_.end(), 0.0f);
+  std::fill(az_.begin(), az_.end(), 0.0f);
+}
+
+void ParticleStore :: CopyTo (size_t index, SphericalThing* thing) const
+{
+  thing->set_mass(mass_[index]);
+  thing->set_radius(radius_[index]);
+  thing->set_pos(Coords3(x_[index], y_[index], z_[index]));
+  thing->set_vel(Coords3(vx_[index], vy_[index], vz_[index]));
+  thing->set_accel(Coords3(ax_[index], ay_[index], az_[index]));
+}
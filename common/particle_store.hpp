@@ -0,0 +1,263 @@
+#ifndef COMMON_PARTICLE_STORE_HPP
+#define COMMON_PARTICLE_STORE_HPP
+
+#include <cstddef>
+#include <string>
+
+#include "common/aligned_allocator.hpp"
+#include "common/spherical_thing.hpp"
+#include "common/util.hpp"
+
+namespace evo {
+
+class ParticleStore;
+class TaskPool;
+
+/** Writable stand-in for a Coords3& whose components live in three separate
+ arrays.  Keeps expressions such as "thing.pos().x += 1" working on a
+ SphericalThingView.
+ */
+class Coords3Ref
+{
+public:
+
+  Coords3Ref (float& _x, float& _y, float& _z)
+  : x(_x), y(_y), z(_z)
+  {}
+
+  operator Coords3 () const {
+    return Coords3(x, y, z);
+  }
+
+  Coords3Ref& operator = (const Coords3& val) {
+    x = val.x;
+    y = val.y;
+    z = val.z;
+    return *this;
+  }
+
+  std::string ToString () const {
+    return Coords3(x, y, z).ToString();
+  }
+
+  float& x;
+  float& y;
+  float& z;
+};
+
+/** Lightweight handle to a single body held by a ParticleStore.  Offers the
+ same accessors as SphericalThing so that code written against the latter
+ keeps working, but owns nothing; it is invalidated by any operation that
+ adds or removes bodies from the store.
+ */
+class SphericalThingView
+{
+public:
+
+  SphericalThingView (ParticleStore* store, size_t index)
+  : store_(store), index_(index)
+  {}
+
+  size_t index () const {
+    return index_;
+  }
+
+  inline float mass () const;
+  inline void set_mass (float val);
+
+  inline float radius () const;
+  inline void set_radius (float val);
+
+  inline Coords3 pos () const;
+  inline Coords3Ref pos ();
+  inline void set_pos (const Coords3& val);
+
+  inline Coords3 vel () const;
+  inline Coords3Ref vel ();
+  inline void set_vel (const Coords3& val);
+
+  inline Coords3 accel () const;
+  inline Coords3Ref accel ();
+  inline void set_accel (const Coords3& val);
+
+  /** Copies the body's state into a standalone SphericalThing.
+   */
+  void CopyTo (SphericalThing* thing) const;
+
+  std::string ToString () const;
+
+private:
+
+  ParticleStore* store_;
+  size_t index_;
+};
+
+/** Structure-of-arrays storage for the bodies of a universe.
+ Each per-body quantity is kept in its own contiguous, cache-line-aligned
+ array so that the physics loops, which only ever touch a handful of fields,
+ stream through memory without dragging vtable pointers and unrelated members
+ into the cache.  Hot loops should work on the raw arrays (x(), vx(), ...)
+ directly; SphericalThingView exists for convenience elsewhere.
+ */
+class ParticleStore
+{
+public:
+
+  ParticleStore ();
+
+  ~ParticleStore ();
+
+  size_t size () const {
+    return mass_.size();
+  }
+
+  bool empty () const {
+    return mass_.empty();
+  }
+
+  float* x () { return x_.data(); }
+  float* y () { return y_.data(); }
+  float* z () { return z_.data(); }
+  const float* x () const { return x_.data(); }
+  const float* y () const { return y_.data(); }
+  const float* z () const { return z_.data(); }
+
+  float* vx () { return vx_.data(); }
+  float* vy () { return vy_.data(); }
+  float* vz () { return vz_.data(); }
+  const float* vx () const { return vx_.data(); }
+  const float* vy () const { return vy_.data(); }
+  const float* vz () const { return vz_.data(); }
+
+  float* ax () { return ax_.data(); }
+  float* ay () { return ay_.data(); }
+  float* az () { return az_.data(); }
+  const float* ax () const { return ax_.data(); }
+  const float* ay () const { return ay_.data(); }
+  const float* az () const { return az_.data(); }
+
+  float* mass () { return mass_.data(); }
+  const float* mass () const { return mass_.data(); }
+
+  float* radius () { return radius_.data(); }
+  const float* radius () const { return radius_.data(); }
+
+  /** Pre-allocates storage for \p capacity bodies.  If \p pool is given and
+   has workers, the newly allocated pages past the current bodies are first
+   touched by the workers, each taking an equal, contiguous slab, so that on a
+   NUMA machine with pinned workers (see PlacementPolicy) each slab lands on
+   the node of the worker that touched it rather than all on the caller's.
+   */
+  void Reserve (size_t capacity, TaskPool* pool = nullptr);
+
+  /** Removes all bodies.
+   */
+  void Clear ();
+
+  /** Appends a body initialized from \p thing.
+   @return The index of the new body.
+   */
+  size_t Add (const SphericalThing& thing);
+
+  /** Appends a body with the given properties and zero acceleration.
+   @return The index of the new body.
+   */
+  size_t Add (float mass, float radius, const Coords3& pos,
+              const Coords3& vel = Coords3());
+
+  /** Removes the body at \p index by moving the last body into its slot;
+   the order of the remaining bodies is therefore not preserved.
+   */
+  void Remove (size_t index);
+
+  /** Sets every body's acceleration to zero.
+   */
+  void ZeroAccelerations ();
+
+  SphericalThingView Get (size_t index) {
+    return SphericalThingView(this, index);
+  }
+
+  SphericalThingView operator [] (size_t index) {
+    return SphericalThingView(this, index);
+  }
+
+  /** Copies the state of the body at \p index into a standalone
+   SphericalThing.
+   */
+  void CopyTo (size_t index, SphericalThing* thing) const;
+
+private:
+
+  AlignedFloatVector x_;
+  AlignedFloatVector y_;
+  AlignedFloatVector z_;
+
+  AlignedFloatVector vx_;
+  AlignedFloatVector vy_;
+  AlignedFloatVector vz_;
+
+  AlignedFloatVector ax_;
+  AlignedFloatVector ay_;
+  AlignedFloatVector az_;
+
+  AlignedFloatVector mass_;
+  AlignedFloatVector radius_;
+};
+
+
+inline float SphericalThingView :: mass () const {
+  return store_->mass()[index_];
+}
+
+inline void SphericalThingView :: set_mass (float val) {
+  store_->mass()[index_] = val;
+}
+
+inline float SphericalThingView :: radius () const {
+  return store_->radius()[index_];
+}
+
+inline void SphericalThingView :: set_radius (float val) {
+  store_->radius()[index_] = val;
+}
+
+inline Coords3 SphericalThingView :: pos () const {
+  return Coords3(store_->x()[index_], store_->y()[index_], store_->z()[index_]);
+}
+
+inline Coords3Ref SphericalThingView :: pos () {
+  return Coords3Ref(store_->x()[index_], store_->y()[index_], store_->z()[index_]);
+}
+
+inline void SphericalThingView :: set_pos (const Coords3& val) {
+  pos() = val;
+}
+
+inline Coords3 SphericalThingView :: vel () const {
+  return Coords3(store_->vx()[index_], store_->vy()[index_], store_->vz()[index_]);
+}
+
+inline Coords3Ref SphericalThingView :: vel () {
+  return Coords3Ref(store_->vx()[index_], store_->vy()[index_], store_->vz()[index_]);
+}
+
+inline void SphericalThingView :: set_vel (const Coords3& val) {
+  vel() = val;
+}
+
+inline Coords3 SphericalThingView :: accel () const {
+  return Coords3(store_->ax()[index_], store_->ay()[index_], store_->az()[index_]);
+}
+
+inline Coords3Ref SphericalThingView :: accel () {
+  return Coords3Ref(store_->ax()[index_], store_->ay()[index_], store_->az()[index_]);
+}
+
+inline void SphericalThingView :: set_accel (const Coords3& val) {
+  accel() = val;
+}
+
+}
+
+#endif
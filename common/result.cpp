@@ -8,84 +8,82 @@ using namespace std;
 using namespace evo;
 using namespace std_results;
 
-Result :: Result ()
+struct Result::Segment
 {
-  Init(DEFAULT_ERROR_CODE);
-}
+  Segment (const char* literal, shared_ptr<const Segment> next)
+    : literal(literal),
+      next(std::move(next))
+  {}
 
-Result :: Result (const Result& copy_src)
-{
-  operator=(copy_src);
-}
+  Segment (string text, shared_ptr<const Segment> next)
+    : literal(nullptr),
+      owned(std::move(text)),
+      next(std::move(next))
+  {}
 
-Result :: Result (int code)
-{
-  Init(code);
-}
+  const char* text () const {
+    return (literal ? literal : owned.c_str());
+  }
 
-Result :: Result (int code, const string& message)
-{
-  Init(code, message);
-}
+  /** Static text, or null if the text is in owned
+  */
+  const char* literal;
+  string owned;
 
-Result :: ~Result ()
-{
-}
+  /** The rest of the message
+  */
+  shared_ptr<const Segment> next;
+};
 
-void Result :: Init (int code)
+Result :: Result (int code, const string& message)
 {
-  code_ = code;
+  Init(code, message);
 }
 
 void Result :: Init (int code, const string& message)
 {
   code_ = code;
-  message_.reset(new string(message));
+  set_message(message);
 }
 
-Result& Result :: operator = (const Result& copy_src)
+string Result :: message () const
 {
-  code_ = copy_src.code_;
-
-  if (copy_src.message_) {
-    set_message(*copy_src.message_);
-  }
-  else {
-    message_.reset();
+  if (segments_)
+  {
+    string msg;
+    for (const Segment* seg = segments_.get(); seg; seg = seg->next.get()) {
+      if (seg != segments_.get()) {
+        msg += ": ";
+      }
+      msg += seg->text();
+    }
+    return msg;
   }
-
-  return *this;
-}
-
-bool Result :: operator == (const Result& arg) const
-{
-  // deliberately ignoring message if either code has been set; this facilitates
-  // intuitive evaluation of code such as:
-  // Result res = file.Read(&buf, 222);
-  // if (NOT_OPEN == res) ...
-
-  if (DEFAULT_ERROR_CODE == arg.code_ && DEFAULT_ERROR_CODE == code_) {
-    return ( (!arg.message_ && !message_) ||
-             (arg.message_ && message_ && *arg.message_ == *message_) );
+  else if (literal_) {
+    return literal_;
   }
   else {
-    return (arg.code_ == code_);
+    return ErrorCodeToString(code_);
   }
 }
 
-bool Result :: operator != (const Result& arg) const
-{
-  return !operator==(arg);
-}
-
-bool Result :: is_error () const
+void Result :: set_message (const string& message)
 {
-  return (INVALID_RESULT_CODE != code_ && SUCCESS_CODE != code_);
+  literal_ = nullptr;
+  // an empty message means the default one, and needs no segment
+  if (message.empty()) {
+    segments_.reset();
+  } else {
+    segments_ = make_shared<const Segment>(message, nullptr);
+  }
 }
 
-bool Result :: is_success () const
+bool Result :: MessagesEqual (const Result& arg) const
 {
-  return (SUCCESS_CODE == code_);
+  const bool has_custom = has_message();
+  const bool arg_has_custom = arg.has_message();
+  return ( (!arg_has_custom && !has_custom) ||
+           (arg_has_custom && has_custom && arg.message() == message()) );
 }
 
 Result& Result :: FromErrno (const string& leading_msg)
@@ -110,36 +108,52 @@ Result& Result :: FromErrno (int errno_code, const string& leading_msg)
 void Result :: Clear ()
 {
   code_ = DEFAULT_ERROR_CODE;
-  if (message_) {
-    message_->clear();
-  }
+  literal_ = nullptr;
+  segments_.reset();
 }
 
 Result& Result :: Prepend (const string& msg)
 {
-  if (has_message()) {
-    set_message(msg + ": " + *message_);
-  }
-  else {
+  if (!has_message()) {
     set_message(msg);
+    return *this;
   }
+  if (!segments_) {
+    segments_ = make_shared<const Segment>(literal_, nullptr);
+    literal_ = nullptr;
+  }
+  segments_ = make_shared<const Segment>(msg, std::move(segments_));
   return *this;
 }
 
 Result Result :: Prepend (const string& msg) const
 {
-  if (has_message()) {
-    return Result(code_, msg + ": " + *message_);
+  Result prepended (*this);
+  prepended.Prepend(msg);
+  return prepended;
+}
+
+Result& Result :: PrependLiteral (const char* msg)
+{
+  if (!has_message()) {
+    literal_ = msg;
+    segments_.reset();
+    return *this;
   }
-  else {
-    return Result(code_, msg);
+  if (!segments_) {
+    segments_ = make_shared<const Segment>(literal_, nullptr);
+    literal_ = nullptr;
   }
+  segments_ = make_shared<const Segment>(msg, std::move(segments_));
+  return *this;
 }
 
 Result& Result :: Append (const string& msg)
 {
+  // the chain only grows at the front, so appending flattens it; rare
+  // enough not to matter
   if (has_message()) {
-    set_message(*message_ + ": " + msg);
+    set_message(message() + ": " + msg);
   }
   else {
     set_message(msg);
@@ -149,12 +163,9 @@ Result& Result :: Append (const string& msg)
 
 Result Result :: Append (const string& msg) const
 {
-  if (has_message()) {
-    return Result(code_, *message_ + ": " + msg);
-  }
-  else {
-    return Result(code_, msg);
-  }
+  Result appended (*this);
+  appended.Append(msg);
+  return appended;
 }
 
 string Result :: ToString () const
@@ -180,7 +191,7 @@ string Result :: ToString () const
   }
   else if (has_message())
   {
-    return *message_;
+    return message();
   }
 
   return "<uninitialized>";
@@ -1,8 +1,13 @@
 #ifndef COMMON_RESULT_HPP
 #define COMMON_RESULT_HPP
 
+#include <cassert>
+#include <cstddef>
+#include <new>
 #include <string>
 #include <memory>
+#include <type_traits>
+#include <utility>
 #include "common/i_stringable.hpp"
 #include "common/i_cloneable.hpp"
 
@@ -12,6 +17,12 @@ namespace evo {
  * a variety of error codes. Also contains a message string that can
  * either be a default value or a custom string particular to the error
  * that occurred.
+ *
+ * Results without a custom message never touch the heap, and neither does a
+ * string literal message, which is kept by pointer.  A message built up by
+ * Prepend()s is an immutable chain of segments shared between copies, so
+ * copying or moving an error costs at most a reference count, and each
+ * Prepend() adds one segment rather than reallocating the whole string.
  */
 class Result : public IStringable, public ICloneable
 {
@@ -26,6 +37,11 @@ public:
    */
   Result (const Result& copy_src);
 
+  /** Constructs a result by taking the code and message of \p move_src,
+   * which is left with no message.
+   */
+  Result (Result&& move_src) noexcept;
+
   /** Constructs a Result object with result code \p code and the default
    * message string.
    * @param code The result code the new object will use.
@@ -39,7 +55,23 @@ public:
    */
   Result (int code, const std::string& message);
 
-  virtual ~Result ();
+  /** As above, but keeps the string literal \p message by pointer.
+   */
+  template <size_t N>
+  Result (int code, const char (&message) [N])
+    : code_(code),
+      literal_(message)
+  {}
+
+  /** As above, for a message in a (non-const) buffer, which is copied.
+   */
+  template <size_t N>
+  Result (int code, char (&message) [N])
+    : Result(code, std::string(message))
+  {}
+
+  virtual ~Result ()
+  {}
 
   /** Copies the result code and message string from \p copy_src into the
    * object.
@@ -47,6 +79,11 @@ public:
    */
   Result& operator = (const Result& copy_src);
 
+  /** Takes the result code and message from \p move_src, which is left with
+   * no message.
+   */
+  Result& operator = (Result&& move_src) noexcept;
+
   /** Compares two Result objects for equality. This only takes into account the
    * code, except when both Results have the default error code. In this case
    * only the messages are used to determine equality.
@@ -66,42 +103,26 @@ public:
     return code_;
   }
 
-  // TODO: can't return a const string& because if nullptr == message_, the
-  //       result is an implied conversion from const char* to string, which
-  //       is a temporary instance, and therefore cannot be returned as a reference;
-  //       would it be better to return const char* here, or a std::string copy?
+  // TODO: can't return a const string& because the message may be a literal
+  //       or a chain of segments, which only exist joined up as a temporary;
+  //       would it be better to return const char* here, or a std::string
+  //       copy?
   /** Gets a copy of the object's message string.
    * @return the message string copy.
    */
-  std::string message () const
-  {
-    if (message_) {
-      return *message_;
-    }
-    else {
-      return ErrorCodeToString(code_);
-    }
-  }
+  std::string message () const;
 
   /** Sets the Result instance's message string.
    * @param message The new message string.
    */
-  void set_message (const std::string& message)
-  {
-    if (message_) {
-      message_->assign(message);
-    }
-    else {
-      message_.reset(new std::string(message));
-    }
-  }
+  void set_message (const std::string& message);
 
   /** Whether or not the Result instance has a custom message.
    * @return True if a custom message has been set, false if the default message
    * is being used.
    */
   bool has_message () const {
-    return (message_ && !message_->empty());
+    return (segments_ || (literal_ && '\0' != *literal_));
   }
 
   /** Whether or not the Result indicates an error.
@@ -147,6 +168,35 @@ public:
   */
   Result Prepend (const std::string& msg) const;
 
+  /** As above, but keeps the string literal \p msg by pointer instead of
+   * copying it, so that a Result without a message yet stays off the heap.
+   * Only for literals and other arrays of static storage duration: a const
+   * local array would dangle.
+   */
+  template <size_t N>
+  Result& Prepend (const char (&msg) [N]) {
+    return PrependLiteral(msg);
+  }
+
+  template <size_t N>
+  Result Prepend (const char (&msg) [N]) const {
+    Result prepended (*this);
+    prepended.PrependLiteral(msg);
+    return prepended;
+  }
+
+  /** For messages in (non-const) buffers, which are copied
+   */
+  template <size_t N>
+  Result& Prepend (char (&msg) [N]) {
+    return Prepend(std::string(msg));
+  }
+
+  template <size_t N>
+  Result Prepend (char (&msg) [N]) const {
+    return Prepend(std::string(msg));
+  }
+
   /** Appends a message to the end of the existing message string.
    * This is useful for modifying the message as the result goes up the
    * call stack.
@@ -183,22 +233,38 @@ protected:
 
 private:
 
+  /** One piece of a message; the whole message is the segments' text,
+   * joined by ": "
+   */
+  struct Segment;
+
   void Init (int code);
   void Init (int code, const std::string& message);
 
+  /** Compares the custom messages, for operator==
+   */
+  bool MessagesEqual (const Result& arg) const;
+
+  Result& PrependLiteral (const char* msg);
+
   /** Numeric code associated with the error
    */
   int code_;
 
-  /** Message associated with the error; note that this is initialized to and
-      remains a nullptr until such time as it becomes necessary to store a
-      textual message.  This is because Result objects are expected to be
-      constructed very regularly, and as such minimizing overhead is important.
-      Result instances that specify a built-in error code (such as NIL_DATA) but
-      not a custom message can simply invoke ErrorCodeToString() on demand,
-      rather than initialize message_ to the return of ErrorCodeToString().
+  /** Message associated with the error, when it is a single string literal
+      and segments_ is null.  Note that neither is set until such time as it
+      becomes necessary to store a textual message.  This is because Result
+      objects are expected to be constructed very regularly, and as such
+      minimizing overhead is important.  Result instances that specify a
+      built-in error code (such as NIL_DATA) but not a custom message can
+      simply invoke ErrorCodeToString() on demand.
+   */
+  const char* literal_;
+
+  /** Message associated with the error otherwise, first segment first;
+      never modified once shared, so that copies can share it
    */
-  std::shared_ptr<std::string> message_;
+  std::shared_ptr<const Segment> segments_;
 };
 
 /** This adds ostream support, so that one can write something like:
@@ -366,4 +432,280 @@ static const evo::Result WRONG_ARCHIVE_INDEX (WRONG_ARCHIVE_INDEX_CODE);
 
 }
 
+// Inline, as every call and return of a Result goes through these; they need
+// the codes above.
+
+inline evo::Result :: Result ()
+{
+  Init(std_results::DEFAULT_ERROR_CODE);
+}
+
+inline evo::Result :: Result (const Result& copy_src)
+  : code_(copy_src.code_),
+    literal_(copy_src.literal_),
+    segments_(copy_src.segments_)
+{
+}
+
+inline evo::Result :: Result (Result&& move_src) noexcept
+  : code_(move_src.code_),
+    literal_(move_src.literal_),
+    segments_(std::move(move_src.segments_))
+{
+  move_src.literal_ = nullptr;
+}
+
+inline evo::Result :: Result (int code)
+{
+  Init(code);
+}
+
+inline void evo::Result :: Init (int code)
+{
+  code_ = code;
+  literal_ = nullptr;
+}
+
+inline evo::Result& evo::Result :: operator = (const Result& copy_src)
+{
+  code_ = copy_src.code_;
+  literal_ = copy_src.literal_;
+  segments_ = copy_src.segments_;
+
+  return *this;
+}
+
+inline evo::Result& evo::Result :: operator = (Result&& move_src) noexcept
+{
+  code_ = move_src.code_;
+  literal_ = move_src.literal_;
+  segments_ = std::move(move_src.segments_);
+  move_src.literal_ = nullptr;
+
+  return *this;
+}
+
+inline bool evo::Result :: operator == (const Result& arg) const
+{
+  // deliberately ignoring message if either code has been set; this facilitates
+  // intuitive evaluation of code such as:
+  // Result res = file.Read(&buf, 222);
+  // if (NOT_OPEN == res) ...
+
+  if (std_results::DEFAULT_ERROR_CODE == arg.code_ &&
+      std_results::DEFAULT_ERROR_CODE == code_) {
+    return MessagesEqual(arg);
+  }
+  else {
+    return (arg.code_ == code_);
+  }
+}
+
+inline bool evo::Result :: operator != (const Result& arg) const
+{
+  return !operator==(arg);
+}
+
+inline bool evo::Result :: is_error () const
+{
+  return (std_results::INVALID_RESULT_CODE != code_ &&
+          std_results::SUCCESS_CODE != code_);
+}
+
+inline bool evo::Result :: is_success () const
+{
+  return (std_results::SUCCESS_CODE == code_);
+}
+
+namespace evo {
+
+/** Either a value of type T or the error that prevented producing one, so
+ that functions can return their result by value instead of through an
+ out-parameter:
+
+    ResultOr<int> port = ParseValue<int>(port_str);
+    if (SUCCESS != port) {
+      return port.result().Prepend("Bad port");
+    }
+    Listen(*port);
+
+ Holds a Result from the same code table, which is SUCCESS exactly when there
+ is a value.  T need not be default constructible or copyable, only movable.
+ */
+template <typename T>
+class ResultOr
+{
+public:
+
+  /** Success, with \p value
+   */
+  ResultOr (const T& value)
+    : result_(std_results::SUCCESS)
+  {
+    new (&value_) T(value);
+  }
+
+  ResultOr (T&& value)
+    : result_(std_results::SUCCESS)
+  {
+    new (&value_) T(std::move(value));
+  }
+
+  /** Failure; \p error must not be SUCCESS, and is turned into
+   INVALID_RESULT if it is
+   */
+  ResultOr (const Result& error)
+    : result_(error)
+  {
+    CheckError();
+  }
+
+  ResultOr (Result&& error)
+    : result_(std::move(error))
+  {
+    CheckError();
+  }
+
+  ResultOr (const ResultOr& copy_src)
+    : result_(copy_src.result_)
+  {
+    if (copy_src.ok()) {
+      new (&value_) T(copy_src.value_);
+    }
+  }
+
+  ResultOr (ResultOr&& move_src)
+    : result_(move_src.result_)
+  {
+    if (move_src.ok()) {
+      new (&value_) T(std::move(move_src.value_));
+    }
+  }
+
+  ~ResultOr () {
+    Destroy();
+  }
+
+  ResultOr& operator = (const ResultOr& copy_src) {
+    if (this != &copy_src) {
+      Destroy();
+      result_ = copy_src.result_;
+      if (copy_src.ok()) {
+        new (&value_) T(copy_src.value_);
+      }
+    }
+    return *this;
+  }
+
+  ResultOr& operator = (ResultOr&& move_src) {
+    if (this != &move_src) {
+      Destroy();
+      result_ = move_src.result_;
+      if (move_src.ok()) {
+        new (&value_) T(std::move(move_src.value_));
+      }
+    }
+    return *this;
+  }
+
+  bool ok () const {
+    return result_.is_success();
+  }
+
+  /** SUCCESS, or the error
+   */
+  const Result& result () const {
+    return result_;
+  }
+
+  /** The value; only if ok()
+   */
+  T& value () & {
+    assert (ok());
+    return value_;
+  }
+
+  const T& value () const & {
+    assert (ok());
+    return value_;
+  }
+
+  T&& value () && {
+    assert (ok());
+    return std::move(value_);
+  }
+
+  /** The value if ok(), otherwise \p default_value
+   */
+  template <typename U>
+  T value_or (U&& default_value) const & {
+    return (ok() ? value_ : static_cast<T>(std::forward<U>(default_value)));
+  }
+
+  T& operator * () & {
+    return value();
+  }
+
+  const T& operator * () const & {
+    return value();
+  }
+
+  T&& operator * () && {
+    return std::move(*this).value();
+  }
+
+  T* operator -> () {
+    return &value();
+  }
+
+  const T* operator -> () const {
+    return &value();
+  }
+
+  /** Compares result() with \p arg, as Result::operator== does
+   */
+  bool operator == (const Result& arg) const {
+    return (result_ == arg);
+  }
+
+  bool operator != (const Result& arg) const {
+    return (result_ != arg);
+  }
+
+private:
+
+  void CheckError () {
+    assert (!result_.is_success());
+    if (result_.is_success()) {
+      result_ = std_results::INVALID_RESULT;
+    }
+  }
+
+  void Destroy () {
+    if (ok()) {
+      value_.~T();
+    }
+  }
+
+  Result result_;
+
+  /** Constructed only if ok()
+  */
+  union {
+    T value_;
+  };
+};
+
+template <typename T>
+inline bool operator == (const Result& lhs, const ResultOr<T>& rhs) {
+  return (rhs == lhs);
+}
+
+template <typename T>
+inline bool operator != (const Result& lhs, const ResultOr<T>& rhs) {
+  return (rhs != lhs);
+}
+
+}
+
 #endif
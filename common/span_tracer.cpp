@@ -0,0 +1,339 @@
+#include <errno.h>
+#include <unistd.h>
+#include <cstdio>
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "common/util.hpp"
+#include "common/thread.hpp"
+#include "common/span_tracer.hpp"
+
+using namespace std;
+using namespace evo;
+using namespace std_results;
+
+namespace {
+
+struct SpanEvent
+{
+  const char* name;
+  int64_t start_ns;
+  int64_t end_ns;
+};
+
+/** One thread's spans: a single-producer, single-consumer ring that the
+ thread appends to and the flusher drains
+ */
+class ThreadSpans
+{
+public:
+
+  explicit ThreadSpans (size_t capacity)
+    : lwpid(GetCurrentThreadLwpid()),
+      thread_name(GetCurrentThreadName()),
+      exited(false),
+      described(false),
+      ring_(capacity),
+      mask_(capacity - 1),
+      head_(0),
+      tail_(0)
+  {}
+
+  /** @return false if the ring is full
+   */
+  bool Push (const char* name, int64_t start_ns, int64_t end_ns) {
+    const uint64_t head = head_.load(memory_order_relaxed);
+    if (head - tail_.load(memory_order_acquire) > mask_) {
+      return false;
+    }
+    SpanEvent& event = ring_[head & mask_];
+    event.name = name;
+    event.start_ns = start_ns;
+    event.end_ns = end_ns;
+    head_.store(head + 1, memory_order_release);
+    return true;
+  }
+
+  /** Calls \p func on each span pushed so far, oldest first, then frees
+   their slots; for the flusher only.
+   */
+  template <typename Func>
+  void Drain (Func func) {
+    const uint64_t head = head_.load(memory_order_acquire);
+    uint64_t tail = tail_.load(memory_order_relaxed);
+    for (; tail != head; ++tail) {
+      func(ring_[tail & mask_]);
+    }
+    tail_.store(tail, memory_order_release);
+  }
+
+  bool empty () const {
+    return (head_.load(memory_order_acquire) ==
+            tail_.load(memory_order_relaxed));
+  }
+
+  const pid_t lwpid;
+  const string thread_name;
+
+  /** Set when the thread ends, after which the ring is freed once drained
+  */
+  atomic<bool> exited;
+
+  /** Whether the current trace file has this thread's name yet; flusher
+      only
+  */
+  bool described;
+
+private:
+
+  vector<SpanEvent> ring_;
+  const uint64_t mask_;
+  atomic<uint64_t> head_;
+  atomic<uint64_t> tail_;
+};
+
+/** Owns the calling thread's ring, and lets the flusher know when the
+ thread is gone
+ */
+struct ThreadSpansHolder
+{
+  ~ThreadSpansHolder () {
+    if (spans) {
+      spans->exited.store(true, memory_order_release);
+    }
+  }
+
+  shared_ptr<ThreadSpans> spans;
+};
+
+}
+
+atomic<bool> SpanTracer :: enabled_ (false);
+
+static thread_local ThreadSpansHolder tls_spans;
+
+/** Every thread's ring, guarded by g_threads_mutex.  The threads append
+ to theirs without the lock.
+ */
+static vector<shared_ptr<ThreadSpans>> g_threads;
+static mutex g_threads_mutex;
+static atomic<size_t> g_ring_capacity (SpanTracer::kDefaultRingCapacity);
+static atomic<int64_t> g_n_dropped (0);
+
+/** The trace file and its flusher, guarded by g_file_mutex
+ */
+static FILE* g_file = nullptr;
+static int64_t g_trace_start_ns = 0;
+static unique_ptr<UThread> g_flusher;
+static mutex g_file_mutex;
+
+static ThreadSpans* RegisterCurrentThread ()
+{
+  tls_spans.spans = make_shared<ThreadSpans>(
+      g_ring_capacity.load(memory_order_relaxed));
+
+  lock_guard<mutex> lock (g_threads_mutex);
+  g_threads.push_back(tls_spans.spans);
+  return tls_spans.spans.get();
+}
+
+static string JsonEscape (const string& str)
+{
+  string escaped;
+  for (char c : str)
+  {
+    if ('"' == c || '\\' == c) {
+      escaped += '\\';
+      escaped += c;
+    } else if (static_cast<unsigned char>(c) < 0x20) {
+      char buf [8];
+      snprintf(buf, sizeof(buf), "\\u%04x", c);
+      escaped += buf;
+    } else {
+      escaped += c;
+    }
+  }
+  return escaped;
+}
+
+/** Writes out every ring's spans and forgets the rings of threads that have
+ exited; needs g_file_mutex
+ */
+static void Flush_locked ()
+{
+  vector<shared_ptr<ThreadSpans>> threads;
+  {
+    lock_guard<mutex> lock (g_threads_mutex);
+    threads = g_threads;
+  }
+
+  const pid_t pid = getpid();
+  for (const shared_ptr<ThreadSpans>& spans : threads)
+  {
+    // checked before draining, so that no span pushed just before the
+    // thread exited is missed
+    const bool exited = spans->exited.load(memory_order_acquire);
+
+    if (!spans->described && !spans->empty())
+    {
+      const string name = (spans->thread_name.empty()
+                           ? "thread " + to_string(spans->lwpid)
+                           : spans->thread_name);
+      fprintf(g_file, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,"
+              "\"tid\":%d,\"args\":{\"name\":\"%s\"}},\n", pid, spans->lwpid,
+              JsonEscape(name).c_str());
+      spans->described = true;
+    }
+
+    // Chrome wants microseconds
+    spans->Drain([&] (const SpanEvent& event) {
+      fprintf(g_file, "{\"name\":\"%s\",\"ph\":\"X\",\"pid\":%d,\"tid\":%d,"
+              "\"ts\":%.3f,\"dur\":%.3f},\n", event.name, pid, spans->lwpid,
+              (event.start_ns - g_trace_start_ns) / 1e3,
+              (event.end_ns - event.start_ns) / 1e3);
+    });
+
+    if (exited)
+    {
+      lock_guard<mutex> lock (g_threads_mutex);
+      g_threads.erase(find(g_threads.begin(), g_threads.end(), spans));
+    }
+  }
+
+  fflush(g_file);
+}
+
+static Result FlusherThreadFunc (UThread* uthread)
+{
+  while (UThread::ProcStateResult::kContinue == uthread->ProcState())
+  {
+    lock_guard<mutex> lock (g_file_mutex);
+    Flush_locked();
+  }
+  return SUCCESS;
+}
+
+Result SpanTracer :: Start (const string& path, Duration flush_period,
+                            size_t ring_capacity)
+{
+  Result res;
+
+  lock_guard<mutex> lock (g_file_mutex);
+
+  if (g_file) {
+    return STATE_ALREADY_EFFECTIVE.Prepend(
+        "Already tracing; call SpanTracer::Stop() first");
+  }
+  if (flush_period <= Duration(0) || 0 == ring_capacity) {
+    return INVALID_ARGUMENT.Prepend(
+        "Flush period and ring capacity must be positive");
+  }
+
+  g_file = fopen(path.c_str(), "w");
+  if (!g_file) {
+    return Result().FromErrno("Couldn't open trace file \"" + path + "\"");
+  }
+
+  size_t capacity = 1;
+  while (capacity < ring_capacity) {
+    capacity <<= 1;
+  }
+  g_ring_capacity.store(capacity, memory_order_relaxed);
+  g_n_dropped.store(0, memory_order_relaxed);
+  g_trace_start_ns = SteadyTimePoint::Now().since_epoch().Nanoseconds();
+
+  // left over from an earlier trace, e.g. spans that ended during Stop()
+  {
+    lock_guard<mutex> threads_lock (g_threads_mutex);
+    for (const shared_ptr<ThreadSpans>& spans : g_threads) {
+      spans->Drain([] (const SpanEvent&) {});
+      spans->described = false;
+    }
+  }
+
+  fprintf(g_file, "[\n{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,"
+          "\"args\":{\"name\":\"%s\"}},\n", getpid(),
+          JsonEscape(program_invocation_short_name).c_str());
+
+  g_flusher.reset(new UThread("SpanTracer", FlusherThreadFunc));
+  g_flusher->set_cycle_wait_period(flush_period);
+
+  enabled_.store(true, memory_order_relaxed);
+
+  if (SUCCESS != (res = g_flusher->Start()) ||
+      SUCCESS != (res = g_flusher->Run(opt::Blocking::kOff))) {
+    enabled_.store(false, memory_order_relaxed);
+    g_flusher.reset();
+    fclose(g_file);
+    g_file = nullptr;
+    return res.Prepend("Couldn't start the trace flusher thread");
+  }
+
+  return SUCCESS;
+}
+
+Result SpanTracer :: Stop ()
+{
+  enabled_.store(false, memory_order_relaxed);
+
+  // the UThread's destructor requests kExiting and joins; not under
+  // g_file_mutex, which the flusher takes
+  unique_ptr<UThread> flusher;
+  {
+    lock_guard<mutex> lock (g_file_mutex);
+    flusher.swap(g_flusher);
+  }
+  flusher.reset();
+
+  lock_guard<mutex> lock (g_file_mutex);
+
+  if (!g_file) {
+    return NOT_INIT.Prepend("Not tracing");
+  }
+
+  Flush_locked();
+
+  // drop the trailing comma; a lone ']' would do for Chrome, but not for
+  // stricter JSON readers
+  fseek(g_file, -2, SEEK_CUR);
+  fprintf(g_file, "\n]\n");
+
+  const bool write_failed = ferror(g_file);
+  const int close_ret = fclose(g_file);
+  g_file = nullptr;
+
+  if (write_failed || 0 != close_ret) {
+    return Result().FromErrno(EIO, "Couldn't write the trace file");
+  }
+
+  const int64_t n_lost = g_n_dropped.load(memory_order_relaxed);
+  if (n_lost > 0) {
+    QLOG(WARNING) << n_lost << " spans were dropped; consider a larger ring "
+                  << "capacity or a shorter flush period";
+  }
+
+  return SUCCESS;
+}
+
+void SpanTracer :: Record (const char* name, int64_t start_ns, int64_t end_ns)
+{
+  if (!enabled()) {
+    return;
+  }
+
+  ThreadSpans* spans = tls_spans.spans.get();
+  if (!spans) {
+    spans = RegisterCurrentThread();
+  }
+  if (!spans->Push(name, start_ns, end_ns)) {
+    g_n_dropped.fetch_add(1, memory_order_relaxed);
+  }
+}
+
+int64_t SpanTracer :: n_dropped ()
+{
+  return g_n_dropped.load(memory_order_relaxed);
+}
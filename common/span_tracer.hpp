@@ -0,0 +1,109 @@
+#ifndef COMMON_SPAN_TRACER_HPP
+#define COMMON_SPAN_TRACER_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "common/result.hpp"
+#include "common/time_measures.hpp"
+
+namespace evo {
+
+/** Records timed spans (see ScopedSpan) into per-thread ring buffers, and
+ writes them out as Chrome trace-event JSON from a background thread, so a
+ run can be opened in chrome://tracing or ui.perfetto.dev as a timeline with
+ one track per thread, named after its UThread and keyed by its LWPID.
+
+ Recording a span takes no locks: each thread appends to its own ring, which
+ only the flusher thread drains.  When a ring fills up faster than it is
+ flushed, further spans are dropped (and counted) rather than blocking.
+ While tracing is off, a ScopedSpan costs a relaxed load and one branch on
+ it (see ScopedSpan).
+
+ The output is the JSON array flavour of the format, whose closing bracket
+ is optional, so the file is usable even when the process never gets to call
+ Stop(), e.g. when killed out of a GLUT main loop.
+ */
+class SpanTracer
+{
+public:
+
+  /** Spans per thread that can wait for the flusher before any are dropped
+   */
+  static const size_t kDefaultRingCapacity = 1 << 16;
+
+  static bool enabled () {
+    return enabled_.load(std::memory_order_relaxed);
+  }
+
+  /** Starts tracing into a new file at \p path, which is flushed every
+   \p flush_period.  Rings are created on each thread's first span, with
+   \p ring_capacity rounded up to a power of two.
+   */
+  static Result Start (const std::string& path,
+                       Duration flush_period = Duration::FromMilliseconds(100),
+                       size_t ring_capacity = kDefaultRingCapacity);
+
+  /** Stops tracing, writes out the spans still buffered and closes the file
+   */
+  static Result Stop ();
+
+  /** Appends a span with the given steady clock times, in ns, to the calling
+   thread's ring; a no-op unless enabled().  \p name isn't copied, so it must
+   outlive the trace, e.g. a string literal.
+   */
+  static void Record (const char* name, int64_t start_ns, int64_t end_ns);
+
+  /** Spans lost to full rings since Start()
+   */
+  static int64_t n_dropped ();
+
+private:
+
+  static std::atomic<bool> enabled_;
+};
+
+/** Records the time from construction to destruction as a span called
+ \p name, if tracing was enabled at construction.  \p name must outlive the
+ trace (see SpanTracer::Record()).
+
+ The destructor's test of name_ repeats the constructor's decision, so it is
+ always predicted correctly, and when both are inlined into one function the
+ compiler folds the two tests into one.
+ */
+class ScopedSpan
+{
+public:
+
+  explicit ScopedSpan (const char* name)
+    : name_(nullptr),
+      start_ns_(0)
+  {
+    if (SpanTracer::enabled()) {
+      name_ = name;
+      start_ns_ = SteadyTimePoint::Now().since_epoch().Nanoseconds();
+    }
+  }
+
+  ~ScopedSpan () {
+    if (name_) {
+      SpanTracer::Record(name_, start_ns_,
+                         SteadyTimePoint::Now().since_epoch().Nanoseconds());
+    }
+  }
+
+  ScopedSpan (const ScopedSpan& copy_src) = delete;
+
+  ScopedSpan& operator = (const ScopedSpan& copy_src) = delete;
+
+private:
+
+  const char* name_;
+  int64_t start_ns_;
+};
+
+}
+
+#endif
@@ -0,0 +1,236 @@
+
+#include <cmath>
+#include <algorithm>
+#include <functional>
+#include <limits>
+#include <boost/thread.hpp>
+
+#include "common/spatial_hash_grid.hpp"
+
+using namespace std;
+using namespace evo;
+using namespace std_results;
+
+static inline int32_t ToCell (float pos, float inv_cell_size)
+{
+  float c = floorf(pos * inv_cell_size);
+  // keep absurdly distant bodies from overflowing; they merely share a cell
+  const float limit = static_cast<float>(numeric_limits<int32_t>::max() / 2);
+  if (c > limit) {
+    c = limit;
+  } else if (c < -limit) {
+    c = -limit;
+  }
+  return static_cast<int32_t>(c);
+}
+
+SpatialHashGrid :: SpatialHashGrid ()
+  : n_threads_(1),
+    task_pool_(nullptr),
+    cell_size_(0),
+    table_mask_(0)
+{
+}
+
+SpatialHashGrid :: ~SpatialHashGrid ()
+{
+}
+
+void SpatialHashGrid :: set_task_pool (TaskPool* pool)
+{
+  task_pool_ = pool;
+  if (pool) {
+    n_threads_ = max(n_threads_, pool->n_workers() + 1);
+  }
+}
+
+void SpatialHashGrid :: RunChunks (int n_chunks,
+                                   const function<void (int)>& func)
+{
+  if (n_chunks <= 1) {
+    func(0);
+    return;
+  }
+
+  if (task_pool_) {
+    task_pool_->ParallelForEach(n_chunks, [&] (size_t c) {
+      func(static_cast<int>(c));
+    });
+    return;
+  }
+
+  // chunk 0 on the calling thread
+  boost::thread_group helpers;
+  for (int c = 1; c < n_chunks; ++c) {
+    helpers.create_thread(std::bind(func, c));
+  }
+  func(0);
+  helpers.join_all();
+}
+
+Result SpatialHashGrid :: Update (const ParticleStore& things)
+{
+  const size_t n = things.size();
+
+  contacts_.clear();
+
+  // the table's size, a power of two of at least 2 * n, must fit a uint32_t
+  if (n > (static_cast<size_t>(1) << 30)) {
+    return INVALID_SIZE.Prepend("SpatialHashGrid: too many bodies");
+  }
+
+  if (n < 2) {
+    return SUCCESS;
+  }
+
+  const float* radius = things.radius();
+  float max_radius = 0;
+  for (size_t i = 0; i < n; ++i) {
+    max_radius = max(max_radius, radius[i]);
+  }
+  if (!(max_radius > 0)) {
+    // points never overlap
+    return SUCCESS;
+  }
+  cell_size_ = 2 * max_radius;
+
+  // about two buckets per body keeps collisions rare
+  uint32_t table_size = 1;
+  while (table_size < 2 * n) {
+    table_size <<= 1;
+  }
+  table_mask_ = table_size - 1;
+
+  const int n_chunks = static_cast<int>(max(static_cast<size_t>(1),
+      min(static_cast<size_t>(n_threads_), n / kMinBodiesPerThread)));
+  const size_t chunk_size = (n + n_chunks - 1) / n_chunks;
+
+  cells_.resize(3 * n);
+  buckets_.resize(n);
+  sorted_.resize(n);
+  thread_counts_.resize(n_chunks);
+  thread_contacts_.resize(n_chunks);
+
+  // counting sort, pass 1: per-chunk histograms
+  RunChunks(n_chunks, [&] (int c) {
+    HashRange(things, c, min(n, c * chunk_size), min(n, (c + 1) * chunk_size));
+  });
+
+  // pass 2: exclusive prefix sum over (bucket, chunk), so that each chunk
+  // scatters into its own disjoint slice of every bucket
+  bucket_start_.resize(table_size + 1);
+  uint32_t total = 0;
+  for (uint32_t b = 0; b < table_size; ++b)
+  {
+    bucket_start_[b] = total;
+    for (int c = 0; c < n_chunks; ++c) {
+      uint32_t count = thread_counts_[c][b];
+      thread_counts_[c][b] = total;
+      total += count;
+    }
+  }
+  bucket_start_[table_size] = total;
+
+  // pass 3: scatter
+  RunChunks(n_chunks, [&] (int c) {
+    ScatterRange(c, min(n, c * chunk_size), min(n, (c + 1) * chunk_size));
+  });
+
+  // every body looks for overlapping partners with a greater index
+  RunChunks(n_chunks, [&] (int c) {
+    QueryRange(things, c, min(n, c * chunk_size), min(n, (c + 1) * chunk_size));
+  });
+
+  for (int c = 0; c < n_chunks; ++c) {
+    contacts_.insert(contacts_.end(), thread_contacts_[c].begin(),
+                     thread_contacts_[c].end());
+  }
+
+  return SUCCESS;
+}
+
+void SpatialHashGrid :: HashRange (const ParticleStore& things,
+                                   int thread_index, size_t begin, size_t end)
+{
+  const float* x = things.x();
+  const float* y = things.y();
+  const float* z = things.z();
+  const float inv_cell_size = 1.0f / cell_size_;
+
+  vector<uint32_t>& counts = thread_counts_[thread_index];
+  counts.assign(static_cast<size_t>(table_mask_) + 1, 0);
+
+  for (size_t i = begin; i < end; ++i)
+  {
+    const int32_t cx = ToCell(x[i], inv_cell_size);
+    const int32_t cy = ToCell(y[i], inv_cell_size);
+    const int32_t cz = ToCell(z[i], inv_cell_size);
+    cells_[3*i]   = cx;
+    cells_[3*i+1] = cy;
+    cells_[3*i+2] = cz;
+    const uint32_t bucket = HashCell(cx, cy, cz);
+    buckets_[i] = bucket;
+    ++counts[bucket];
+  }
+}
+
+void SpatialHashGrid :: ScatterRange (int thread_index, size_t begin,
+                                      size_t end)
+{
+  vector<uint32_t>& offsets = thread_counts_[thread_index];
+
+  for (size_t i = begin; i < end; ++i) {
+    sorted_[offsets[buckets_[i]]++] = static_cast<uint32_t>(i);
+  }
+}
+
+void SpatialHashGrid :: QueryRange (const ParticleStore& things,
+                                    int thread_index, size_t begin, size_t end)
+{
+  const float* x = things.x();
+  const float* y = things.y();
+  const float* z = things.z();
+  const float* radius = things.radius();
+
+  vector<ContactPair>& out = thread_contacts_[thread_index];
+  out.clear();
+
+  for (size_t i = begin; i < end; ++i)
+  {
+    // distinct neighbour cells can hash to the same bucket; visit each bucket
+    // only once so that no pair is reported twice
+    uint32_t visited [27];
+    int n_visited = 0;
+
+    for (int dx = -1; dx <= 1; ++dx)
+    for (int dy = -1; dy <= 1; ++dy)
+    for (int dz = -1; dz <= 1; ++dz)
+    {
+      const uint32_t bucket =
+          HashCell(cells_[3*i] + dx, cells_[3*i+1] + dy, cells_[3*i+2] + dz);
+
+      if (find(visited, visited + n_visited, bucket) != visited + n_visited) {
+        continue;
+      }
+      visited[n_visited++] = bucket;
+
+      for (uint32_t k = bucket_start_[bucket]; k < bucket_start_[bucket+1]; ++k)
+      {
+        const uint32_t j = sorted_[k];
+        if (j <= i) {
+          continue;
+        }
+        const float ddx = x[j] - x[i];
+        const float ddy = y[j] - y[i];
+        const float ddz = z[j] - z[i];
+        const float reach = radius[i] + radius[j];
+        if (ddx*ddx + ddy*ddy + ddz*ddz < reach * reach) {
+          ContactPair pair;
+          pair.a = static_cast<uint32_t>(i);
+          pair.b = j;
+          out.push_back(pair);
+        }
+      }
+    }
+  }
+}
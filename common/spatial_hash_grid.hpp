@@ -0,0 +1,121 @@
+#ifndef COMMON_SPATIAL_HASH_GRID_HPP
+#define COMMON_SPATIAL_HASH_GRID_HPP
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include "common/i_broadphase.hpp"
+#include "common/particle_store.hpp"
+#include "common/result.hpp"
+#include "common/task_pool.hpp"
+
+namespace evo {
+
+/** Uniform-grid broadphase for sphere-sphere contacts.  Every Update() picks
+ a cell size of twice the largest radius, so that any two overlapping
+ spheres lie in the same or in adjacent cells, hashes each body's cell into a
+ table, and groups the bodies by bucket with a counting sort.  Each body then
+ checks the bodies in the 27 buckets around it.  The count, scatter and query
+ passes are split across threads when the population is large enough to
+ make that worthwhile.
+
+ Best when radii are similar; a few very large bodies inflate the cell size
+ for everyone (see SweepAndPrune).
+ */
+class SpatialHashGrid : public IBroadphase
+{
+public:
+
+  /** Populations smaller than this are always processed on the calling
+   thread.
+   */
+  static const size_t kMinBodiesPerThread = 4096;
+
+  SpatialHashGrid ();
+
+  virtual ~SpatialHashGrid ();
+
+  /** Cell edge length chosen by the most recent Update().
+   */
+  float cell_size () const {
+    return cell_size_;
+  }
+
+  /** Upper bound on the number of threads used by Update().
+   */
+  int n_threads () const {
+    return n_threads_;
+  }
+
+  void set_n_threads (int val) {
+    n_threads_ = (val < 1 ? 1 : val);
+  }
+
+  /** Pool on which Update() runs its passes, or null to start threads of
+   its own for each pass.  Setting a pool also raises n_threads() to the
+   pool's thread count, so that every worker gets a share.  The grid doesn't
+   take ownership.
+   */
+  TaskPool* task_pool () const {
+    return task_pool_;
+  }
+
+  void set_task_pool (TaskPool* pool);
+
+  virtual Result Update (const ParticleStore& things) override;
+
+  virtual const std::vector<ContactPair>& contacts () const override {
+    return contacts_;
+  }
+
+private:
+
+  uint32_t HashCell (int32_t cx, int32_t cy, int32_t cz) const {
+    // the usual large-prime spatial hash (Teschner et al.)
+    return ( (static_cast<uint32_t>(cx) * 73856093u)
+           ^ (static_cast<uint32_t>(cy) * 19349663u)
+           ^ (static_cast<uint32_t>(cz) * 83492791u) ) & table_mask_;
+  }
+
+  void HashRange (const ParticleStore& things, int thread_index,
+                  size_t begin, size_t end);
+
+  void ScatterRange (int thread_index, size_t begin, size_t end);
+
+  void QueryRange (const ParticleStore& things, int thread_index,
+                   size_t begin, size_t end);
+
+  /** Runs \p func(0) .. \p func(n_chunks-1) concurrently and returns once
+   all of them have finished
+   */
+  void RunChunks (int n_chunks, const std::function<void (int)>& func);
+
+  int n_threads_;
+  TaskPool* task_pool_;
+  float cell_size_;
+  uint32_t table_mask_;
+
+  /** Per-body cell coordinates (3 per body) and bucket
+   */
+  std::vector<int32_t> cells_;
+  std::vector<uint32_t> buckets_;
+
+  /** Per-thread bucket histograms, turned into per-thread scatter offsets by
+   the prefix sum
+   */
+  std::vector<std::vector<uint32_t>> thread_counts_;
+
+  /** bucket_start_[b] .. bucket_start_[b+1] is the range of sorted_ that
+   holds the bodies hashed to bucket b
+   */
+  std::vector<uint32_t> bucket_start_;
+  std::vector<uint32_t> sorted_;
+
+  std::vector<std::vector<ContactPair>> thread_contacts_;
+  std::vector<ContactPair> contacts_;
+};
+
+}
+
+#endif
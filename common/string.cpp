@@ -1,3 +1,5 @@
+#include <cctype>
+#include <cstdlib>
 #include <cstring>
 #include <strings.h>
 #include <iostream>
@@ -9,7 +11,13 @@
 #include <string>
 #include <algorithm>
 #include <functional>
+#include <memory>
+#ifdef __SSE2__
+#include <immintrin.h>
+#endif
 #include <boost/regex.hpp>
+#include <boost/thread.hpp>
+#include <boost/utility/string_view.hpp>
 
 #include "common/result.hpp"
 #include "common/string.hpp"
@@ -175,6 +183,219 @@ vector<NumericType> evo::StrExplodeNum (const string& str, char delim)
   return tokens_out;
 }
 
+// the templates above are defined here rather than in the header, so
+// instantiate them for the usual NumericTypes
+template vector<double>& evo::StrExplodeNum (const string&, char,
+                                             vector<double>*);
+template vector<float>& evo::StrExplodeNum (const string&, char,
+                                            vector<float>*);
+template vector<int>& evo::StrExplodeNum (const string&, char, vector<int>*);
+template vector<long>& evo::StrExplodeNum (const string&, char,
+                                           vector<long>*);
+template vector<double> evo::StrExplodeNum (const string&, char);
+template vector<float> evo::StrExplodeNum (const string&, char);
+template vector<int> evo::StrExplodeNum (const string&, char);
+template vector<long> evo::StrExplodeNum (const string&, char);
+
+const ptrdiff_t evo::StrSplitView :: kBlockSize;
+
+uint64_t evo::StrSplitView :: DelimiterMask (const char* block,
+                                             const char* end, char delim)
+{
+  const ptrdiff_t length = std::min(end - block, kBlockSize);
+  uint64_t mask = 0;
+  ptrdiff_t i = 0;
+
+#ifdef __AVX2__
+  const __m256i delims_32 = _mm256_set1_epi8(delim);
+  for (; i + 32 <= length; i += 32)
+  {
+    const __m256i bytes = _mm256_loadu_si256(
+        reinterpret_cast<const __m256i*>(block + i));
+    const uint32_t matches = static_cast<uint32_t>(
+        _mm256_movemask_epi8(_mm256_cmpeq_epi8(bytes, delims_32)));
+    mask |= static_cast<uint64_t>(matches) << i;
+  }
+#endif
+#ifdef __SSE2__
+  const __m128i delims_16 = _mm_set1_epi8(delim);
+  for (; i + 16 <= length; i += 16)
+  {
+    const __m128i bytes = _mm_loadu_si128(
+        reinterpret_cast<const __m128i*>(block + i));
+    const uint32_t matches = static_cast<uint32_t>(
+        _mm_movemask_epi8(_mm_cmpeq_epi8(bytes, delims_16)));
+    mask |= static_cast<uint64_t>(matches) << i;
+  }
+#endif
+
+  // the tail of the string, or everything without SIMD
+  for (; i < length; ++i) {
+    if (delim == block[i]) {
+      mask |= uint64_t(1) << i;
+    }
+  }
+  return mask;
+}
+
+/** Powers of ten that a double holds exactly, for StrToDouble()
+ */
+static const double kExactPowersOf10 [] = {
+  1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+  1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+static const int kMaxExactPowerOf10 = 22;
+static const uint64_t kMaxExactMantissa = uint64_t(1) << 53;
+
+static inline bool IsDigit (char ch)
+{
+  return static_cast<unsigned char>(ch - '0') < 10;
+}
+
+/** isspace() in the "C" locale, without the call
+ */
+static inline bool IsSpace (char ch)
+{
+  return (' ' == ch || static_cast<unsigned char>(ch - '\t') < 5);
+}
+
+bool evo::StrToDouble (boost::string_view str, double* value_out)
+{
+  const char* pos = str.data();
+  const char* end = pos + str.size();
+  while (pos < end && IsSpace(*pos)) {
+    ++pos;
+  }
+  while (end > pos && IsSpace(end[-1])) {
+    --end;
+  }
+  const char* const number_begin = pos;
+
+  bool negative = false;
+  if (pos < end && ('-' == *pos || '+' == *pos)) {
+    negative = ('-' == *pos);
+    ++pos;
+  }
+
+  // the digits are accumulated as an integer, which is only used if there
+  // turn out to be few enough of them for it to be exact
+  uint64_t mantissa = 0;
+  int n_digits = 0;
+  int exponent = 0;
+
+  for (; pos < end && IsDigit(*pos); ++pos, ++n_digits) {
+    mantissa = mantissa * 10 + (*pos - '0');
+  }
+  if (pos < end && '.' == *pos)
+  {
+    ++pos;
+    for (; pos < end && IsDigit(*pos); ++pos, ++n_digits, --exponent) {
+      mantissa = mantissa * 10 + (*pos - '0');
+    }
+  }
+  if (n_digits > 0 && pos < end && ('e' == *pos || 'E' == *pos))
+  {
+    ++pos;
+    bool exponent_negative = false;
+    if (pos < end && ('-' == *pos || '+' == *pos)) {
+      exponent_negative = ('-' == *pos);
+      ++pos;
+    }
+    int explicit_exponent = 0;
+    const char* exponent_begin = pos;
+    for (; pos < end && IsDigit(*pos); ++pos) {
+      if (explicit_exponent < 100000) {
+        explicit_exponent = explicit_exponent * 10 + (*pos - '0');
+      }
+    }
+    if (pos == exponent_begin) {
+      // e.g. "1e"; let strtod() decide
+      n_digits = 0;
+    }
+    exponent += (exponent_negative ? -explicit_exponent : explicit_exponent);
+  }
+
+  // with both the mantissa and the power of ten exact, the one
+  // multiplication or division rounds correctly
+  if (pos == end && n_digits > 0 && n_digits <= 19 &&
+      mantissa <= kMaxExactMantissa &&
+      exponent >= -kMaxExactPowerOf10 && exponent <= kMaxExactPowerOf10)
+  {
+    double value = static_cast<double>(mantissa);
+    if (exponent < 0) {
+      value /= kExactPowersOf10[-exponent];
+    } else {
+      value *= kExactPowersOf10[exponent];
+    }
+    *value_out = (negative ? -value : value);
+    return true;
+  }
+
+  // strtod() needs a NUL terminator, which str may not have
+  const size_t length = end - number_begin;
+  char buf [64];
+  string long_buf;
+  const char* number = buf;
+  if (length < sizeof(buf)) {
+    memcpy(buf, number_begin, length);
+    buf[length] = '\0';
+  } else {
+    long_buf.assign(number_begin, length);
+    number = long_buf.c_str();
+  }
+
+  char* endptr = nullptr;
+  const double value = strtod(number, &endptr);
+  if (0 == length || number + length != endptr) {
+    return false;
+  }
+  *value_out = value;
+  return true;
+}
+
+bool evo::StrToInt64 (boost::string_view str, int64_t* value_out)
+{
+  const char* pos = str.data();
+  const char* end = pos + str.size();
+  while (pos < end && IsSpace(*pos)) {
+    ++pos;
+  }
+  while (end > pos && IsSpace(end[-1])) {
+    --end;
+  }
+
+  bool negative = false;
+  if (pos < end && ('-' == *pos || '+' == *pos)) {
+    negative = ('-' == *pos);
+    ++pos;
+  }
+  if (pos == end) {
+    return false;
+  }
+
+  // accumulated unsigned, so that INT64_MIN's magnitude fits
+  const uint64_t limit = (negative
+                          ? static_cast<uint64_t>(INT64_MAX) + 1
+                          : static_cast<uint64_t>(INT64_MAX));
+  uint64_t magnitude = 0;
+  for (; pos < end; ++pos)
+  {
+    if (!IsDigit(*pos)) {
+      return false;
+    }
+    const uint64_t digit = *pos - '0';
+    if (magnitude > (limit - digit) / 10) {
+      return false;
+    }
+    magnitude = magnitude * 10 + digit;
+  }
+
+  *value_out = (negative ? static_cast<int64_t>(0 - magnitude)
+                         : static_cast<int64_t>(magnitude));
+  return true;
+}
+
 int evo::StrCountChars (const string& str, char ch)
 {
   return std::count(str.begin(), str.end(), ch);
@@ -242,13 +463,93 @@ string& evo::TrimWhitespace (string* str_io)
   return TrimLeadingWhitespace(&TrimTrailingWhitespace(str_io));
 }
 
-Result evo::regex::GetMatch (const string &contents, const string &pattern,
-                              int value_capture_index, string *match)
+struct evo::regex::Pattern::Compiled
 {
-  boost::regex r(pattern);
+  explicit Compiled (const string& text)
+    : text(text),
+      result(SUCCESS)
+  {
+    try {
+      compiled.assign(text);
+    } catch (const boost::regex_error& e) {
+      result = PARSE_FAILED.Prepend("Invalid regex pattern \"" + text +
+                                    "\": " + e.what());
+    }
+  }
+
+  const string text;
+  boost::regex compiled;
+  Result result;
+};
+
+shared_ptr<const evo::regex::Pattern::Compiled> evo::regex::Pattern :: Lookup (
+    const string& text)
+{
+  // compiled patterns by text; lookups vastly outnumber insertions, hence
+  // the shared lock
+  static unordered_map<string, shared_ptr<const Compiled>> patterns;
+  static boost::shared_mutex patterns_mutex;
+
+  {
+    boost::shared_lock<boost::shared_mutex> lock (patterns_mutex);
+    auto iter = patterns.find(text);
+    if (patterns.end() != iter) {
+      return iter->second;
+    }
+  }
+
+  // compiled outside the lock; should two threads race to compile the same
+  // text, the first to insert wins and the other's copy is dropped
+  auto compiled = make_shared<const Compiled>(text);
+
+  boost::unique_lock<boost::shared_mutex> lock (patterns_mutex);
+  if (patterns.size() >= kMaxCachedPatterns) {
+    return compiled;
+  }
+  return patterns.emplace(text, compiled).first->second;
+}
+
+evo::regex::Pattern :: Pattern (const string &text)
+  : compiled_(Lookup(text))
+{
+}
+
+evo::regex::Pattern :: Pattern (const char *text)
+  : compiled_(Lookup(text))
+{
+}
+
+const string& evo::regex::Pattern :: text () const
+{
+  return compiled_->text;
+}
+
+const Result& evo::regex::Pattern :: result () const
+{
+  return compiled_->result;
+}
+
+bool evo::regex::Pattern :: ok () const
+{
+  return compiled_->result.is_success();
+}
+
+const boost::regex& evo::regex::Pattern :: compiled () const
+{
+  return compiled_->compiled;
+}
+
+ResultOr<string> evo::regex::GetMatch (const string &contents,
+                                        const Pattern &pattern,
+                                        int value_capture_index)
+{
+  if (!pattern.ok()) {
+    return pattern.result();
+  }
+
   smatch m;
 
-  if (!regex_search(contents, m, r)) {
+  if (!regex_search(contents, m, pattern.compiled())) {
     return NOT_FOUND.Prepend(
         "Regex pattern didn't match any portion of the subject");
   }
@@ -259,36 +560,29 @@ Result evo::regex::GetMatch (const string &contents, const string &pattern,
         + to_string(m.size()) );
   }
 
-  *match = m[value_capture_index];
-  return SUCCESS;
+  return m[value_capture_index].str();
 }
 
-Result evo::regex::GetMatch (const string &contents, const string &pattern,
-                              string *match)
+ResultOr<string> evo::regex::GetMatch (const string &contents,
+                                        const Pattern &pattern)
 {
-  return GetMatch(contents, pattern, 0, match);
+  return GetMatch(contents, pattern, 0);
 }
 
 template <>
-Result evo::ParseValue(const string &str, bool *value)
+ResultOr<bool> evo::ParseValue<bool> (const string &str)
 {
-  int intval = 0;
-  if (SUCCESS == ParseValue(str, &intval))
-  {
-    *value = (0 != intval);
-  }
-  else
-  {
-    const string& lcstr = StrToLower(str);
-    if (lcstr == "true") {
-      *value = true;
-    } else if (lcstr == "false") {
-      *value = false;
-    } else {
-      return PARSE_FAILED;
-    }
+  ResultOr<int> intval = ParseValue<int>(str);
+  if (intval.ok()) {
+    return (0 != *intval);
   }
 
-  return SUCCESS;
+  const string& lcstr = StrToLower(str);
+  if (lcstr == "true") {
+    return true;
+  } else if (lcstr == "false") {
+    return false;
+  }
+  return PARSE_FAILED;
 }
 
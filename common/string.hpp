@@ -1,6 +1,8 @@
 #ifndef HPP_ps_string
 #define HPP_ps_string
 
+#include <cstddef>
+#include <cstdint>
 #include <cstdlib>
 #include <cstring>
 #include <string>
@@ -8,10 +10,16 @@
 #include <vector>
 #include <unordered_set>
 #include <algorithm>
+#include <iterator>
 #include <functional>
+#include <type_traits>
+#include <memory>
 #include <cctype>
+#include <cmath>
+#include <limits>
 #include <locale>
 #include <boost/regex.hpp>
+#include <boost/utility/string_view.hpp>
 
 #include "common/result.hpp"
 
@@ -82,6 +90,49 @@ static const std::string kNonNumericPrintable =
 
 namespace regex {
 
+/** A compiled regex pattern.  Constructing one looks the pattern text up in
+ a process-wide cache and compiles it only the first time any thread asks
+ for that text, so a Pattern, or just the text passed to GetMatch() and
+ GetValue(), costs a hash lookup rather than a compilation after that; keep
+ a Pattern around to skip even the lookup.  Cheap to copy, immutable, and
+ safe to match with from any number of threads.
+ */
+class Pattern
+{
+public:
+
+  Pattern (const std::string &text);
+
+  Pattern (const char *text);
+
+  const std::string& text () const;
+
+  /** SUCCESS, or PARSE_FAILED if the text isn't a valid regex
+   */
+  const evo::Result& result () const;
+
+  bool ok () const;
+
+  /** Only if ok()
+   */
+  const boost::regex& compiled () const;
+
+  /** Most distinct pattern texts cached; beyond that, new ones are compiled
+   for each Pattern constructed
+   */
+  static const size_t kMaxCachedPatterns = 1024;
+
+private:
+
+  struct Compiled;
+
+  /** The cached compilation of \p text, compiling it if there is none
+   */
+  static std::shared_ptr<const Compiled> Lookup (const std::string &text);
+
+  std::shared_ptr<const Compiled> compiled_;
+};
+
 /** Regex pattern that matches a real-valued number.
  */
 static const std::string kDoublePattern = R"([eE\+\.\-\d]+)";
@@ -91,8 +142,9 @@ static const std::string kDoublePattern = R"([eE\+\.\-\d]+)";
  @param field_name The name of the variable/parameter/field to which a
  real-valued number is being assigned.
  */
-inline std::string MakeDoubleAssignmentPattern (const std::string &field_name) {
-  return R"(\b)" + field_name + R"(\s*=\s*()" + kDoublePattern + R"()\s*$)";
+inline Pattern MakeDoubleAssignmentPattern (const std::string &field_name) {
+  return Pattern(R"(\b)" + field_name + R"(\s*=\s*()" + kDoublePattern +
+                 R"()\s*$)");
 }
 
 }
@@ -434,6 +486,265 @@ std::vector<NumericType>& StrExplodeNum (const std::string& str, char delim,
 template <typename NumericType>
 std::vector<NumericType> StrExplodeNum (const std::string& str, char delim);
 
+/** Splits a string on a delimiter like StrExplode() does, but lazily and
+ * without copying: iterating yields each token as a view into \p str, which
+ * must outlive the iteration.  As with StrExplode(), a string with n
+ * delimiters yields n + 1 tokens, any of which may be empty, and an empty
+ * string yields none.
+ *
+ * Delimiters are found a 64-byte block at a time with SSE2 (or AVX2, when
+ * built with it) byte compares, and the resulting bitmask is then consumed
+ * a token at a time, so that short tokens such as CSV fields cost only a
+ * few instructions each.
+ *
+ * @code
+ * for (boost::string_view field : StrSplitView(line, ',')) { ... }
+ * @endcode
+ */
+class StrSplitView
+{
+  /** Bytes of input scanned for delimiters at a time, one per mask bit
+   */
+  static const std::ptrdiff_t kBlockSize = 64;
+
+public:
+
+  class const_iterator
+  {
+  public:
+
+    typedef std::forward_iterator_tag iterator_category;
+    typedef boost::string_view value_type;
+    typedef std::ptrdiff_t difference_type;
+    typedef const boost::string_view* pointer;
+    typedef const boost::string_view& reference;
+
+    /** Constructs the end iterator.
+     */
+    const_iterator ()
+      : end_(nullptr),
+        block_(nullptr),
+        mask_(0),
+        delim_('\0'),
+        done_(true)
+    {}
+
+    const_iterator (boost::string_view str, char delim)
+      : end_(str.data() + str.size()),
+        block_(str.data()),
+        mask_(str.empty() ? 0 : DelimiterMask(str.data(), end_, delim)),
+        delim_(delim),
+        done_(str.empty())
+    {
+      if (!done_) {
+        FindToken(str.data());
+      }
+    }
+
+    reference operator * () const {
+      return token_;
+    }
+
+    pointer operator -> () const {
+      return &token_;
+    }
+
+    const_iterator& operator ++ () {
+      const char* token_end = token_.data() + token_.size();
+      if (token_end == end_) {
+        done_ = true;
+        token_ = boost::string_view();
+      } else {
+        FindToken(token_end + 1);
+      }
+      return *this;
+    }
+
+    const_iterator operator ++ (int) {
+      const_iterator prev (*this);
+      ++(*this);
+      return prev;
+    }
+
+    bool operator == (const const_iterator& other) const {
+      return (done_ == other.done_ &&
+              (done_ || token_.data() == other.token_.data()));
+    }
+
+    bool operator != (const const_iterator& other) const {
+      return !(*this == other);
+    }
+
+  private:
+
+    /** Sets token_ to run from \p token_begin up to the next delimiter
+     whose bit is still set in mask_, loading further blocks as needed, or
+     up to the end of the string if there are no more delimiters.
+     */
+    void FindToken (const char* token_begin) {
+      while (0 == mask_)
+      {
+        if (end_ - block_ <= kBlockSize) {
+          token_ = boost::string_view(token_begin, end_ - token_begin);
+          return;
+        }
+        block_ += kBlockSize;
+        mask_ = DelimiterMask(block_, end_, delim_);
+      }
+      const char* token_end = block_ + __builtin_ctzll(mask_);
+      mask_ &= mask_ - 1;
+      token_ = boost::string_view(token_begin, token_end - token_begin);
+    }
+
+    boost::string_view token_;
+    const char* end_;
+
+    /** The block being consumed, and the bits of the delimiters in it that
+     are still ahead of token_
+     */
+    const char* block_;
+    uint64_t mask_;
+
+    char delim_;
+    bool done_;
+  };
+
+  StrSplitView (boost::string_view str, char delim)
+    : str_(str),
+      delim_(delim)
+  {}
+
+  const_iterator begin () const {
+    return const_iterator(str_, delim_);
+  }
+
+  const_iterator end () const {
+    return const_iterator();
+  }
+
+private:
+
+  /** @return A mask with bit i set if block[i] is \p delim, for the up to
+   kBlockSize bytes from \p block that are before \p end.
+   */
+  static uint64_t DelimiterMask (const char* block, const char* end,
+                                 char delim);
+
+  boost::string_view str_;
+  char delim_;
+};
+
+/** Parses all of \p str as a double, like strtod() does, but without needing
+ * \p str to be NUL terminated.  Plain decimals whose digits fit in a double's
+ * mantissa, with small exponents, are converted in place and correctly
+ * rounded; anything else, e.g. hex, "inf" or long mantissas, goes through
+ * strtod() on a copy.  Surrounding whitespace is ignored.
+ * @param str A string.
+ * @param value_out Where the parsed value will be stored.
+ * @return false if \p str isn't entirely a number.
+ */
+bool StrToDouble (boost::string_view str, double* value_out);
+
+/** Parses all of \p str as a base-10 integer, like strtoll() does, but
+ * without needing \p str to be NUL terminated.  Surrounding whitespace is
+ * ignored.
+ * @param str A string.
+ * @param value_out Where the parsed value will be stored.
+ * @return false if \p str isn't entirely an integer, or doesn't fit in an
+ * int64_t.
+ */
+bool StrToInt64 (boost::string_view str, int64_t* value_out);
+
+/** StrToNumber() for integral types: only integers that fit in one are
+ * accepted, e.g. neither "1.7" nor "3e9" parse as an int.
+ */
+template <typename NumericType>
+inline bool StrToNumber (boost::string_view str, NumericType* value_out,
+                         std::true_type /* is_integral */)
+{
+  typedef std::numeric_limits<NumericType> Limits;
+
+  int64_t value;
+  if (!StrToInt64(str, &value)) {
+    return false;
+  }
+  if (value < 0 ? (!Limits::is_signed ||
+                   value < static_cast<int64_t>(Limits::min()))
+                : (static_cast<uint64_t>(value) >
+                   static_cast<uint64_t>(Limits::max()))) {
+    return false;
+  }
+  *value_out = static_cast<NumericType>(value);
+  return true;
+}
+
+/** StrToNumber() for floating point types: any number StrToDouble() accepts
+ * that is within range, or infinite.
+ */
+template <typename NumericType>
+inline bool StrToNumber (boost::string_view str, NumericType* value_out,
+                         std::false_type /* is_integral */)
+{
+  double value;
+  if (!StrToDouble(str, &value)) {
+    return false;
+  }
+  if (std::isfinite(value) &&
+      std::fabs(value) > std::numeric_limits<NumericType>::max()) {
+    return false;
+  }
+  *value_out = static_cast<NumericType>(value);
+  return true;
+}
+
+/** Parses all of \p str as a \p NumericType, with StrToInt64() for integral
+ * types and StrToDouble() for floating point ones.
+ * @return false if \p str isn't entirely a number, or isn't one that a
+ * \p NumericType can hold exactly (for integral types) or at all.
+ */
+template <typename NumericType>
+inline bool StrToNumber (boost::string_view str, NumericType* value_out)
+{
+  static_assert(std::is_arithmetic<NumericType>::value,
+                "StrToNumber() needs an arithmetic type");
+  return StrToNumber(str, value_out, std::is_integral<NumericType>());
+}
+
+/** Splits a string on a specified delimeter like StrSplitView() and parses
+ * each of the string-parts with StrToNumber() straight into a caller-owned
+ * buffer, so that no memory is allocated.
+ * @param str A string.
+ * @param delim A delimeter that \p str will be split on.
+ * @param values_out A buffer of at least \p capacity values.
+ * @param capacity The size of \p values_out.
+ * @return The number of values stored in \p values_out, PARSE_FAILED if a
+ * string-part isn't a number that a \p NumericType can hold (see
+ * StrToNumber()), or INSUFFICIENT_SPACE if there are more than \p capacity
+ * string-parts.
+ */
+template <typename NumericType>
+inline evo::ResultOr<size_t> StrExplodeNum (boost::string_view str,
+                                            char delim,
+                                            NumericType* values_out,
+                                            size_t capacity)
+{
+  size_t n_values = 0;
+  for (boost::string_view token : StrSplitView(str, delim))
+  {
+    if (n_values == capacity) {
+      return std_results::INSUFFICIENT_SPACE.Prepend(
+          "More than " + std::to_string(capacity) + " values");
+    }
+    if (!StrToNumber(token, &values_out[n_values])) {
+      return std_results::PARSE_FAILED.Prepend(
+          "Value " + std::to_string(n_values) + " isn't a valid number: \"" +
+          token.to_string() + "\"");
+    }
+    ++n_values;
+  }
+  return n_values;
+}
+
 /** Counts the number of instances of \p ch in a string.
  * @param begin_iter An iterator pointing to the start of a string.
  * @param end_iter An iterator pointing to the end of a string.
@@ -558,29 +869,30 @@ std::string& TrimTrailingWhitespace (std::string* str_io,
  */
 std::string& TrimWhitespace (std::string* str_io);
 
-/** Attempt to convert given string to type T (typically a numeric type).
+/** Attempt to convert given string to type T (typically a numeric type),
+ e.g. ParseValue<int>("42").
  @param str String to be converted.
- @param value Output that receives the converted value.
- @return SUCCESS if the conversion was successful, PARSE_FAILED otherwise.
+ @return The converted value, or PARSE_FAILED.
  */
 template <class T>
-inline evo::Result ParseValue(const std::string &str, T *value)
+inline evo::ResultOr<T> ParseValue(const std::string &str)
 {
   std::stringstream stream(str);
+  T value;
 
-  stream >> *value;
+  stream >> value;
 
   if(stream.fail()) {
     return std_results::PARSE_FAILED;
   }
 
-  return std_results::SUCCESS;
+  return std::move(value);
 }
 
 /** Specialization of ParseValue for bool that recognizes "true" and "false".
  */
 template <>
-evo::Result ParseValue(const std::string &str, bool *value);
+evo::ResultOr<bool> ParseValue<bool>(const std::string &str);
 
 namespace regex {
 
@@ -589,62 +901,55 @@ namespace regex {
  @param pattern Regex pattern to be matched.
  @param value_capture_index The index of the capture within the match to be
      returned.  '0' is the entire match, '1' is the first parenthetical capture, etc.
- @param match_out The first match discovered, unmodified if no match is found.
- @return SUCCESS if all goes well, otherwise:
+ @return The first match discovered if all goes well, otherwise:
      INDEX_OUT_OF_RANGE if at least one match was found, but
          value_capture_index >= the total # captures;
-     PARSE_FAILED if there were no matches.
+     NOT_FOUND if there were no matches;
+     PARSE_FAILED if the pattern is invalid.
  */
-evo::Result GetMatch(const std::string &contents, const std::string &pattern,
-                      int value_capture_index, std::string *match_out);
+evo::ResultOr<std::string> GetMatch(const std::string &contents,
+                                    const Pattern &pattern,
+                                    int value_capture_index);
 
 /** A simpler version of GetMatch() that returns the entire match, i.e., the
  zeroth capture.
  */
-evo::Result GetMatch(const std::string &contents, const std::string &pattern,
-                      std::string *match_out);
+evo::ResultOr<std::string> GetMatch(const std::string &contents,
+                                    const Pattern &pattern);
 
-/** Convert first match of given regex pattern in given subject to given type.
+/** Convert first match of given regex pattern in given subject to given type,
+ e.g. GetValue<double>(line, "speed = ([0-9.]+)", 1).
  @param contents The subject within which to match the pattern.
  @param pattern The regex pattern to be matched.
  @param value_capture_index The index of the capture within the match on which
      the conversion is to be performed; '0' is the entire match, '1' is the
      first parenthetical capture, etc.
- @param value Output that receives the converted value.
- @return SUCCESS on success, or the error return of GetMatch() or ParseValue()
-     on failure.
+ @return The converted value on success, or the error return of GetMatch()
+     or ParseValue() on failure.
  */
 template <class T>
-inline evo::Result GetValue(const std::string &contents,
-                            const std::string &pattern,
-                            int value_capture_index,
-                            T *value)
+inline evo::ResultOr<T> GetValue(const std::string &contents,
+                                 const Pattern &pattern,
+                                 int value_capture_index)
 {
-  std::string str;
-  evo::Result res = GetMatch(contents, pattern, value_capture_index, &str);
+  evo::ResultOr<std::string> match =
+      GetMatch(contents, pattern, value_capture_index);
 
-  if(res.is_error()) {
-    return res;
+  if(!match.ok()) {
+    return match.result();
   }
 
-  res = ParseValue(str, value);
-
-  if(res.is_error()) {
-    return res;
-  }
-
-  return std_results::SUCCESS;
+  return ParseValue<T>(*match);
 }
 
 /** A simpler version of GetValue() that converts the entire match, i.e.,
  the zeroth capture.
  */
 template <class T>
-inline evo::Result GetValue(const std::string& contents,
-                            const std::string& pattern,
-                            T* value)
+inline evo::ResultOr<T> GetValue(const std::string& contents,
+                                 const Pattern& pattern)
 {
-  return GetValue(contents, pattern, 0, value);
+  return GetValue<T>(contents, pattern, 0);
 }
 
 }
@@ -0,0 +1,186 @@
+
+#include <algorithm>
+#include <limits>
+
+#include "common/sweep_and_prune.hpp"
+
+using namespace std;
+using namespace evo;
+using namespace std_results;
+
+static inline const float* AxisCoords (const ParticleStore& things, int axis)
+{
+  switch (axis) {
+    case 1:
+      return things.y();
+    case 2:
+      return things.z();
+    default:
+      return things.x();
+  }
+}
+
+/** Orders endpoints by value; at equal values, min endpoints sort before max
+ endpoints so that the sweep sees spheres whose extents merely touch.  The
+ narrow test then rejects them.
+ */
+static inline bool EndpointLess (float lhs_value, uint32_t lhs_kind,
+                                 float rhs_value, uint32_t rhs_kind)
+{
+  return (lhs_value < rhs_value ||
+          (lhs_value == rhs_value && (lhs_kind & 1) < (rhs_kind & 1)));
+}
+
+SweepAndPrune :: SweepAndPrune ()
+  : axis_(0),
+    always_rebuild_(false),
+    last_swap_count_(0)
+{
+}
+
+SweepAndPrune :: ~SweepAndPrune ()
+{
+}
+
+void SweepAndPrune :: set_axis (int val)
+{
+  if (val < 0 || val > 2) {
+    val = 0;
+  }
+  if (val != axis_) {
+    axis_ = val;
+    endpoints_.clear();
+  }
+}
+
+Result SweepAndPrune :: Update (const ParticleStore& things)
+{
+  const size_t n = things.size();
+
+  contacts_.clear();
+
+  if (n > static_cast<size_t>(numeric_limits<uint32_t>::max() / 2)) {
+    return INVALID_SIZE.Prepend("SweepAndPrune: too many bodies");
+  }
+
+  if (always_rebuild_ || endpoints_.size() != 2 * n) {
+    Rebuild(things);
+  }
+  else {
+    RefreshValues(things);
+    InsertionSort();
+  }
+
+  Sweep(things);
+
+  return SUCCESS;
+}
+
+void SweepAndPrune :: Rebuild (const ParticleStore& things)
+{
+  const size_t n = things.size();
+
+  endpoints_.resize(2 * n);
+  for (size_t i = 0; i < n; ++i) {
+    endpoints_[2*i].body_and_kind   = static_cast<uint32_t>(i << 1);
+    endpoints_[2*i+1].body_and_kind = static_cast<uint32_t>((i << 1) | 1);
+  }
+  RefreshValues(things);
+
+  sort(endpoints_.begin(), endpoints_.end(),
+       [] (const Endpoint& lhs, const Endpoint& rhs) {
+         return EndpointLess(lhs.value, lhs.body_and_kind,
+                             rhs.value, rhs.body_and_kind);
+       });
+
+  last_swap_count_ = 0;
+}
+
+void SweepAndPrune :: RefreshValues (const ParticleStore& things)
+{
+  const float* pos = AxisCoords(things, axis_);
+  const float* radius = things.radius();
+
+  for (Endpoint& ep : endpoints_)
+  {
+    const uint32_t body = ep.body_and_kind >> 1;
+    ep.value = (ep.body_and_kind & 1) ? pos[body] + radius[body]
+                                      : pos[body] - radius[body];
+  }
+}
+
+void SweepAndPrune :: InsertionSort ()
+{
+  size_t swaps = 0;
+  const size_t n = endpoints_.size();
+
+  for (size_t i = 1; i < n; ++i)
+  {
+    const Endpoint key = endpoints_[i];
+    size_t j = i;
+    while (j > 0 && EndpointLess(key.value, key.body_and_kind,
+                                 endpoints_[j-1].value,
+                                 endpoints_[j-1].body_and_kind))
+    {
+      endpoints_[j] = endpoints_[j-1];
+      --j;
+    }
+    if (j != i) {
+      endpoints_[j] = key;
+      swaps += i - j;
+    }
+  }
+
+  last_swap_count_ = swaps;
+}
+
+void SweepAndPrune :: Sweep (const ParticleStore& things)
+{
+  const float* x = things.x();
+  const float* y = things.y();
+  const float* z = things.z();
+  const float* radius = things.radius();
+
+  active_.clear();
+  active_slot_.resize(things.size());
+
+  for (const Endpoint& ep : endpoints_)
+  {
+    const uint32_t body = ep.body_and_kind >> 1;
+
+    if (ep.body_and_kind & 1)
+    {
+      // max endpoint: the body leaves the active list
+      const uint32_t slot = active_slot_[body];
+      active_[slot] = active_.back();
+      active_slot_[active_[slot].body] = slot;
+      active_.pop_back();
+    }
+    else
+    {
+      // min endpoint: the body overlaps every active body on this axis
+      ActiveBody entering;
+      entering.x = x[body];
+      entering.y = y[body];
+      entering.z = z[body];
+      entering.radius = radius[body];
+      entering.body = body;
+
+      for (const ActiveBody& other : active_)
+      {
+        const float dx = other.x - entering.x;
+        const float dy = other.y - entering.y;
+        const float dz = other.z - entering.z;
+        const float reach = other.radius + entering.radius;
+        if (dx*dx + dy*dy + dz*dz < reach * reach) {
+          ContactPair pair;
+          pair.a = min(body, other.body);
+          pair.b = max(body, other.body);
+          contacts_.push_back(pair);
+        }
+      }
+      active_slot_[body] = static_cast<uint32_t>(active_.size());
+      active_.push_back(entering);
+    }
+  }
+}
@@ -0,0 +1,111 @@
+#ifndef COMMON_SWEEP_AND_PRUNE_HPP
+#define COMMON_SWEEP_AND_PRUNE_HPP
+
+#include <cstdint>
+#include <vector>
+
+#include "common/i_broadphase.hpp"
+#include "common/particle_store.hpp"
+#include "common/result.hpp"
+
+namespace evo {
+
+/** Sweep-and-prune broadphase for sphere-sphere contacts.  Each body's
+ extent along one axis is represented by a min and a max endpoint; the
+ endpoints are kept sorted across ticks and re-sorted with insertion sort,
+ which is close to O(N) when bodies move only a little per tick.  A single
+ sweep over the sorted endpoints then yields every pair whose extents
+ overlap on that axis, and those are checked for actual sphere overlap.
+
+ Unlike SpatialHashGrid, the cost doesn't depend on the spread of radii.
+ The endpoint list is rebuilt from scratch whenever the number of bodies
+ changes.
+ */
+class SweepAndPrune : public IBroadphase
+{
+public:
+
+  SweepAndPrune ();
+
+  virtual ~SweepAndPrune ();
+
+  /** Axis the endpoints are sorted along: 0 = x, 1 = y, 2 = z.
+   */
+  int axis () const {
+    return axis_;
+  }
+
+  /** Changing the axis forces a full rebuild on the next Update().
+   */
+  void set_axis (int val);
+
+  /** If true, every Update() sorts the endpoints from scratch instead of
+   re-sorting the previous order; only useful for comparison.
+   */
+  bool always_rebuild () const {
+    return always_rebuild_;
+  }
+
+  void set_always_rebuild (bool val) {
+    always_rebuild_ = val;
+  }
+
+  /** Number of endpoint swaps performed by the most recent incremental
+   re-sort; a measure of how coherent the motion was.
+   */
+  size_t last_swap_count () const {
+    return last_swap_count_;
+  }
+
+  virtual Result Update (const ParticleStore& things) override;
+
+  virtual const std::vector<ContactPair>& contacts () const override {
+    return contacts_;
+  }
+
+private:
+
+  struct Endpoint
+  {
+    float value;
+
+    /** Body index << 1, with the low bit set for max endpoints
+     */
+    uint32_t body_and_kind;
+  };
+
+  /** Copy of an active body's sphere, so that the sweep's inner loop reads
+   contiguous memory instead of gathering from the ParticleStore
+   */
+  struct ActiveBody
+  {
+    float x, y, z, radius;
+    uint32_t body;
+  };
+
+  void Rebuild (const ParticleStore& things);
+
+  void RefreshValues (const ParticleStore& things);
+
+  void InsertionSort ();
+
+  void Sweep (const ParticleStore& things);
+
+  int axis_;
+  bool always_rebuild_;
+  size_t last_swap_count_;
+
+  std::vector<Endpoint> endpoints_;
+
+  /** Bodies whose extent contains the current sweep position, and each
+   body's slot in that list (for O(1) removal)
+   */
+  std::vector<ActiveBody> active_;
+  std::vector<uint32_t> active_slot_;
+
+  std::vector<ContactPair> contacts_;
+};
+
+}
+
+#endif
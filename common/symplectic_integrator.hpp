@@ -0,0 +1,226 @@
+#ifndef COMMON_SYMPLECTIC_INTEGRATOR_HPP
+#define COMMON_SYMPLECTIC_INTEGRATOR_HPP
+
+#include <cmath>
+#include <string>
+
+#include "common/result.hpp"
+#include "common/i_force_engine.hpp"
+#include "common/i_integrator.hpp"
+#include "common/particle_store.hpp"
+#include "common/task_pool.hpp"
+
+namespace evo {
+
+/** Kick-drift-kick leapfrog, i.e. velocity Verlet: second order, one force
+ evaluation per step.
+ */
+struct VelocityVerlet
+{
+  static const int kStages = 1;
+
+  static const char* Name () {
+    return "velocity Verlet";
+  }
+
+  /** Kick coefficients, kStages+1 of them
+   */
+  static double Kick (int /*stage*/) {
+    return 0.5;
+  }
+
+  /** Drift coefficients, kStages of them
+   */
+  static double Drift (int /*stage*/) {
+    return 1.0;
+  }
+};
+
+/** Yoshida's fourth-order symplectic composition of three leapfrog steps, in
+ kick-first form: three force evaluations per step, but the error shrinks with
+ dt^4 rather than dt^2, so much larger steps give the same accuracy.
+ */
+struct Yoshida4
+{
+  static const int kStages = 3;
+
+  static const char* Name () {
+    return "Yoshida 4th order";
+  }
+
+  static double W1 () {
+    return 1.0 / (2.0 - std::cbrt(2.0));
+  }
+
+  static double W0 () {
+    return -std::cbrt(2.0) * W1();
+  }
+
+  static double Kick (int stage) {
+    return (0 == stage || 3 == stage) ? 0.5 * W1() : 0.5 * (W0() + W1());
+  }
+
+  static double Drift (int stage) {
+    return (1 == stage) ? W0() : W1();
+  }
+};
+
+/** Symplectic splitting integrator, parameterized on a Policy that provides
+ the kick and drift coefficients of the scheme (see VelocityVerlet,
+ Yoshida4).  A step of an S-stage scheme is
+
+   kick(K0) drift(D0) force kick(K1) drift(D1) force ... kick(KS)
+
+ where each kick is v += K*dt*a and each drift is x += D*dt*v.  The
+ accelerations at the end of a step are those at the start of the next, so
+ the scheme costs S force evaluations per step once warmed up.
+
+ Each kick+drift pair is a single pass over the particle arrays, split
+ across the TaskPool (if any) in cache-line-aligned chunks.
+ */
+template <class Policy>
+class SymplecticIntegrator : public IIntegrator
+{
+public:
+
+  /** Kick/drift is memory-bound and cheap per body; smaller populations are
+   not worth waking the workers for.
+   */
+  static const size_t kMinBodiesPerChunk = 16384;
+
+  /** \p pool may be null, in which case everything runs on the calling thread;
+   the integrator doesn't take ownership.
+   */
+  explicit SymplecticIntegrator (TaskPool* pool = nullptr)
+    : pool_(pool),
+      accelerations_valid_(false),
+      n_things_(0)
+  {}
+
+  virtual ~SymplecticIntegrator ()
+  {}
+
+  virtual std::string name () const override {
+    return Policy::Name();
+  }
+
+  virtual int force_evaluations_per_step () const override {
+    return Policy::kStages;
+  }
+
+  virtual Result Step (float dt, double G, IForceEngine* force_engine,
+                       ParticleStore* things) override
+  {
+    Result res;
+
+    if (!accelerations_valid_ || things->size() != n_things_) {
+      if (std_results::SUCCESS != (res = ComputeAccelerations(G, force_engine,
+                                                              things))) {
+        return res;
+      }
+    }
+
+    for (int s = 0; s < Policy::kStages; ++s)
+    {
+      KickDrift(static_cast<float>(Policy::Kick(s) * dt),
+                static_cast<float>(Policy::Drift(s) * dt), things);
+      if (std_results::SUCCESS != (res = ComputeAccelerations(G, force_engine,
+                                                              things))) {
+        return res;
+      }
+    }
+    KickDrift(static_cast<float>(Policy::Kick(Policy::kStages) * dt), 0.0f,
+              things);
+
+    return std_results::SUCCESS;
+  }
+
+  virtual void InvalidateAccelerations () override {
+    accelerations_valid_ = false;
+  }
+
+private:
+
+  Result ComputeAccelerations (double G, IForceEngine* force_engine,
+                               ParticleStore* things)
+  {
+    accelerations_valid_ = false;
+    n_things_ = things->size();
+
+    if (force_engine) {
+      Result res = force_engine->ComputeAccelerations(G, things);
+      if (std_results::SUCCESS != res) {
+        return res.Prepend(std::string(Policy::Name()) +
+                           ": couldn't compute accelerations");
+      }
+    }
+    else {
+      things->ZeroAccelerations();
+    }
+
+    accelerations_valid_ = true;
+    return std_results::SUCCESS;
+  }
+
+  /** v += kick_dt * a, then x += drift_dt * v; drift_dt == 0 skips the
+   drift.
+   */
+  void KickDrift (float kick_dt, float drift_dt, ParticleStore* things)
+  {
+    auto range_func = [=] (size_t begin, size_t end) {
+      KickDriftRange(kick_dt, drift_dt, things, begin, end);
+    };
+
+    if (pool_) {
+      pool_->ParallelFor(things->size(), kMinBodiesPerChunk, range_func);
+    } else {
+      range_func(0, things->size());
+    }
+  }
+
+  static void KickDriftRange (float kick_dt, float drift_dt,
+                              ParticleStore* things, size_t begin, size_t end)
+  {
+    float* __restrict__ x  = things->x();
+    float* __restrict__ y  = things->y();
+    float* __restrict__ z  = things->z();
+    float* __restrict__ vx = things->vx();
+    float* __restrict__ vy = things->vy();
+    float* __restrict__ vz = things->vz();
+    const float* __restrict__ ax = things->ax();
+    const float* __restrict__ ay = things->ay();
+    const float* __restrict__ az = things->az();
+
+    if (0 == drift_dt)
+    {
+      for (size_t i = begin; i < end; ++i) {
+        vx[i] += ax[i] * kick_dt;
+        vy[i] += ay[i] * kick_dt;
+        vz[i] += az[i] * kick_dt;
+      }
+      return;
+    }
+
+    for (size_t i = begin; i < end; ++i)
+    {
+      vx[i] += ax[i] * kick_dt;
+      vy[i] += ay[i] * kick_dt;
+      vz[i] += az[i] * kick_dt;
+      x[i]  += vx[i] * drift_dt;
+      y[i]  += vy[i] * drift_dt;
+      z[i]  += vz[i] * drift_dt;
+    }
+  }
+
+  TaskPool* pool_;
+
+  /** Whether the ParticleStore's accelerations match its positions, and the
+   population size they were computed for
+   */
+  bool accelerations_valid_;
+  size_t n_things_;
+};
+
+}
+
+#endif
@@ -0,0 +1,436 @@
+
+#include <algorithm>
+#include <cassert>
+#include <string>
+#include <boost/thread.hpp>
+
+#include "common/util.hpp"
+#include "common/span_tracer.hpp"
+#include "common/task_pool.hpp"
+
+using namespace std;
+using namespace evo;
+using namespace std_results;
+
+/** Number of fruitless looks for work before an idle worker goes to sleep
+ */
+static const int kIdleSpins = 64;
+
+/** Pool and deque index of the calling thread, if it is a pool worker
+ */
+static thread_local const TaskPool* tls_pool = nullptr;
+static thread_local int tls_worker_index = -1;
+
+/** xorshift state for picking steal victims
+ */
+static thread_local uint32_t tls_steal_seed = 0;
+
+/** \p n_workers, or the default for a negative count
+ */
+static int WorkerCount (int n_workers)
+{
+  if (n_workers < 0) {
+    n_workers = static_cast<int>(boost::thread::hardware_concurrency()) - 1;
+  }
+  return max(n_workers, 0);
+}
+
+TaskPool :: TaskPool (int n_workers, PlacementPolicy placement)
+  : queues_(WorkerCount(n_workers)),
+    pinned_(new atomic<Task*> [WorkerCount(n_workers)]),
+    placement_(placement),
+    inject_head_(0),
+    n_injected_(0),
+    work_epoch_(0),
+    n_sleepers_(0),
+    shutting_down_(false)
+{
+  // queues_ is complete before the first worker starts stealing from it
+  const int n_queues = static_cast<int>(queues_.size());
+  for (int w = 0; w < n_queues; ++w) {
+    pinned_[w].store(nullptr, memory_order_relaxed);
+  }
+
+  const vector<int> cpus = CpuTopology::Get().PlaceWorkers(placement,
+                                                           n_queues);
+  for (int w = 0; w < n_queues; ++w)
+  {
+    unique_ptr<UThread> worker (new UThread("worker-" + to_string(w),
+        [this, w] (UThread* uthread) {
+          return WorkerMain(uthread, w);
+        }));
+
+    if (!cpus.empty())
+    {
+      // applied by the worker as it starts, before it touches any memory
+      Result res = worker->SetAffinity(vector<int>(1, cpus[w]));
+      if (SUCCESS != res) {
+        QLOG(WARNING) << "Couldn't pin pool worker " << w << " to CPU "
+                      << cpus[w] << ": " << res.ToString();
+      }
+    }
+
+    Result res = worker->Start();
+    if (SUCCESS == res) {
+      res = worker->Run(opt::Blocking::kOn);
+    }
+    if (SUCCESS != res) {
+      QLOG(ERROR) << "Couldn't start pool worker " << w << ": "
+                  << res.ToString();
+      break;
+    }
+    // the queues of workers that failed to start simply stay empty
+    workers_.push_back(std::move(worker));
+  }
+}
+
+TaskPool :: ~TaskPool ()
+{
+  shutting_down_.store(true);
+  {
+    lock_guard<mutex> lock (idle_mutex_);
+  }
+  idle_cond_.notify_all();
+
+  // each UThread's destructor requests kExiting and joins
+  workers_.clear();
+}
+
+void TaskPool :: Spawn (Task* task, TaskGroup* group)
+{
+  task->group_ = group;
+  group->pending_.fetch_add(1, memory_order_relaxed);
+
+  const int index = CurrentWorker();
+  const bool queued = (index >= 0 ? queues_[index].Push(task)
+                                  : Inject(task));
+  if (!queued) {
+    // queue full; there's plenty of parallelism already
+    Execute(task);
+    return;
+  }
+
+  NotifyWork();
+}
+
+void TaskPool :: Wait (TaskGroup* group)
+{
+  const int index = CurrentWorker();
+
+  while (!group->done())
+  {
+    Task* task = FindTask(index);
+    if (task) {
+      Execute(task);
+    } else {
+      // the group's remaining tasks are running on other threads
+      boost::this_thread::yield();
+    }
+  }
+}
+
+int TaskPool :: RunOnEachWorker (const function<void(int)>& func)
+{
+  assert (CurrentWorker() < 0);
+
+  if (0 == n_workers()) {
+    func(0);
+    return 1;
+  }
+
+  class PinnedTask : public Task
+  {
+  public:
+
+    PinnedTask (const function<void(int)>* func, int index)
+      : func_(func),
+        index_(index)
+    {}
+
+    virtual void Run () override {
+      (*func_)(index_);
+    }
+
+  private:
+
+    const function<void(int)>* func_;
+    int index_;
+  };
+
+  vector<PinnedTask> tasks;
+  tasks.reserve(n_workers());
+  TaskGroup group;
+  int n_skipped = 0;
+
+  for (int w = 0; w < n_workers(); ++w)
+  {
+    tasks.emplace_back(&func, w);
+    if (!workers_[w]->is_available()) {
+      ++n_skipped;
+      continue;
+    }
+    tasks.back().group_ = &group;
+    group.pending_.fetch_add(1, memory_order_relaxed);
+    pinned_[w].store(&tasks.back(), memory_order_release);
+  }
+  // every worker has to look, not just the first one to wake up
+  NotifyWork(true);
+
+  while (!group.done())
+  {
+    Task* task = FindTask(-1);
+    if (task) {
+      Execute(task);
+      continue;
+    }
+
+    // a worker that is exiting won't take its task; whichever of it and us
+    // empties the slot first owns the task
+    for (int w = 0; w < n_workers(); ++w)
+    {
+      if (!workers_[w]->is_available() &&
+          nullptr != pinned_[w].load(memory_order_relaxed) &&
+          nullptr != pinned_[w].exchange(nullptr, memory_order_acquire)) {
+        ++n_skipped;
+        group.pending_.fetch_sub(1, memory_order_release);
+      }
+    }
+    boost::this_thread::yield();
+  }
+
+  return n_workers() - n_skipped;
+}
+
+size_t TaskPool :: ChunkSize (size_t n, size_t min_chunk_size) const
+{
+  if (0 == n_workers()) {
+    return n;
+  }
+
+  const size_t target_chunks = (n_workers() + 1) * kChunksPerThread;
+  size_t chunk_size = max(max(min_chunk_size, static_cast<size_t>(1)),
+                          (n + target_chunks - 1) / target_chunks);
+  if (chunk_size >= n) {
+    return n;
+  }
+
+  // round the chunk size up to whole cache lines
+  return (chunk_size + kChunkAlignment - 1) / kChunkAlignment
+       * kChunkAlignment;
+}
+
+void TaskPool :: Run (const RangeJob& job)
+{
+  if (0 == job.n) {
+    return;
+  }
+
+  const size_t n_chunks = (job.n + job.chunk_size - 1) / job.chunk_size;
+  if (n_chunks <= 1 || 0 == n_workers()) {
+    job.call(job.func, 0, job.n);
+    return;
+  }
+
+  RunChunks(job, 0, n_chunks);
+}
+
+void TaskPool :: RunChunks (const RangeJob& job, size_t first, size_t last)
+{
+  if (last - first == 1)
+  {
+    const size_t begin = first * job.chunk_size;
+    job.call(job.func, begin, min(job.n, begin + job.chunk_size));
+    return;
+  }
+
+  // the upper half goes up for grabs; thieves take the biggest pieces, as
+  // the oldest tasks in a deque are the ones nearest the root of the split
+  const size_t mid = first + (last - first) / 2;
+  ChunkTask upper (this, &job, mid, last);
+  TaskGroup group;
+  Spawn(&upper, &group);
+
+  RunChunks(job, first, mid);
+
+  Wait(&group);
+}
+
+Result TaskPool :: WorkerMain (UThread* uthread, int index)
+{
+  tls_pool = this;
+  tls_worker_index = index;
+
+  while (UThread::ProcStateResult::kContinue == uthread->ProcState())
+  {
+    if (shutting_down_.load()) {
+      // the pool's destructor is about to request kExiting, which interrupts
+      // the sleep; the next ProcState() then tells us to return
+      uthread->Sleep(Duration::Min());
+      continue;
+    }
+
+    Task* task = FindTask(index);
+    if (task) {
+      Execute(task);
+    } else {
+      IdleWait(index);
+    }
+  }
+
+  tls_pool = nullptr;
+  tls_worker_index = -1;
+
+  return SUCCESS;
+}
+
+int TaskPool :: CurrentWorker () const
+{
+  return (this == tls_pool ? tls_worker_index : -1);
+}
+
+TaskPool::Task* TaskPool :: FindTask (int index)
+{
+  Task* task;
+
+  if (index >= 0)
+  {
+    if (nullptr != pinned_[index].load(memory_order_relaxed)) {
+      return pinned_[index].exchange(nullptr, memory_order_acquire);
+    }
+    if (nullptr != (task = queues_[index].Pop())) {
+      return task;
+    }
+  }
+
+  if (nullptr != (task = TakeInjected())) {
+    return task;
+  }
+
+  const int n_queues = static_cast<int>(queues_.size());
+  if (0 == n_queues) {
+    return nullptr;
+  }
+
+  // start at a random victim, so that thieves spread out
+  uint32_t seed = tls_steal_seed;
+  if (0 == seed) {
+    seed = static_cast<uint32_t>(reinterpret_cast<uintptr_t>(&tls_steal_seed))
+         | 1;
+  }
+  seed ^= seed << 13;
+  seed ^= seed >> 17;
+  seed ^= seed << 5;
+  tls_steal_seed = seed;
+
+  const int start = static_cast<int>(seed % n_queues);
+  for (int k = 0; k < n_queues; ++k)
+  {
+    const int victim = (start + k) % n_queues;
+    if (victim != index &&
+        nullptr != (task = queues_[victim].Steal())) {
+      return task;
+    }
+  }
+
+  return nullptr;
+}
+
+bool TaskPool :: HasWork (int index) const
+{
+  if (n_injected_.load(memory_order_relaxed) > 0 ||
+      nullptr != pinned_[index].load(memory_order_relaxed)) {
+    return true;
+  }
+  for (const WorkerQueue& queue : queues_) {
+    if (!queue.empty()) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void TaskPool :: Execute (Task* task)
+{
+  // the task may be destroyed as soon as its group is done, so no touching
+  // it after the decrement
+  TaskGroup* group = task->group_;
+  {
+    ScopedSpan span ("TaskPool.task");
+    task->Run();
+  }
+  group->pending_.fetch_sub(1, memory_order_release);
+}
+
+bool TaskPool :: Inject (Task* task)
+{
+  lock_guard<mutex> lock (inject_mutex_);
+
+  const size_t count = n_injected_.load(memory_order_relaxed);
+  if (count >= kQueueCapacity) {
+    return false;
+  }
+  inject_ring_[(inject_head_ + count) % kQueueCapacity] = task;
+  n_injected_.store(count + 1, memory_order_release);
+  return true;
+}
+
+TaskPool::Task* TaskPool :: TakeInjected ()
+{
+  // cheap check first; the queue is empty nearly all of the time
+  if (0 == n_injected_.load(memory_order_acquire)) {
+    return nullptr;
+  }
+
+  lock_guard<mutex> lock (inject_mutex_);
+
+  const size_t count = n_injected_.load(memory_order_relaxed);
+  if (0 == count) {
+    return nullptr;
+  }
+  Task* task = inject_ring_[inject_head_];
+  inject_head_ = (inject_head_ + 1) % kQueueCapacity;
+  n_injected_.store(count - 1, memory_order_relaxed);
+  return task;
+}
+
+void TaskPool :: NotifyWork (bool all)
+{
+  // pairs with IdleWait(): either the sleeper sees the new epoch before
+  // sleeping, or we see it counted in n_sleepers_ and wake it
+  work_epoch_.fetch_add(1);
+  if (n_sleepers_.load() > 0)
+  {
+    {
+      lock_guard<mutex> lock (idle_mutex_);
+    }
+    if (all) {
+      idle_cond_.notify_all();
+    } else {
+      idle_cond_.notify_one();
+    }
+  }
+}
+
+void TaskPool :: IdleWait (int index)
+{
+  for (int i = 0; i < kIdleSpins; ++i)
+  {
+    if (HasWork(index) || shutting_down_.load()) {
+      return;
+    }
+    boost::this_thread::yield();
+  }
+
+  n_sleepers_.fetch_add(1);
+  const uint64_t epoch = work_epoch_.load();
+
+  if (!HasWork(index))
+  {
+    unique_lock<mutex> lock (idle_mutex_);
+    while (epoch == work_epoch_.load() && !shutting_down_.load()) {
+      idle_cond_.wait(lock);
+    }
+  }
+
+  n_sleepers_.fetch_sub(1);
+}
@@ -0,0 +1,358 @@
+#ifndef COMMON_TASK_POOL_HPP
+#define COMMON_TASK_POOL_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <vector>
+
+#include "common/aligned_allocator.hpp"
+#include "common/cpu_topology.hpp"
+#include "common/result.hpp"
+#include "common/thread.hpp"
+#include "common/work_stealing_deque.hpp"
+
+namespace evo {
+
+/** A fixed set of UThread workers that run fork-join tasks with work
+ stealing.  Each worker owns a WorkStealingDeque: tasks it spawns go to the
+ bottom of its own deque, where it picks them up again newest first, and idle
+ workers steal the oldest tasks from the top of the others'.  Tasks spawned
+ by threads outside the pool go through a small shared queue instead.
+
+ Tasks are caller-owned objects (see Task and MakeTask()) that must stay
+ alive until the TaskGroup they were spawned into has been waited for, so
+ spawning never allocates.  Wait() doesn't block while there is work around:
+ the waiting thread runs queued tasks, its own or stolen, until the group is
+ done.  ParallelFor() is built on the same primitives and splits its range
+ recursively, with the halves' tasks living on the splitting threads' stacks.
+
+ The workers are ordinary UThreads, named "worker-<i>", kept in kGo.  They
+ call ProcState() between tasks, so Pause() / Unpause() and state change
+ listeners work on them as on any other UThread; the pool keeps going on
+ whichever threads are left, and RunOnEachWorker() skips those that are
+ gone.  Workers that run out of work spin briefly and then sleep until
+ something is spawned.
+
+ A PlacementPolicy other than kNone pins each worker to a single CPU picked
+ by CpuTopology::PlaceWorkers(); threads waiting on the pool stay where they
+ are.  RunOnEachWorker() then lets per-worker data be first touched, and so
+ allocated on the right NUMA node, by the worker that will use it.
+ */
+class TaskPool
+{
+public:
+
+  /** ParallelFor() chunk boundaries are multiples of this many elements; one
+   cache line of floats, so that when the ranges index cache-line-aligned
+   float arrays (e.g. ParticleStore's) no two threads ever write to the same
+   cache line.
+   */
+  static const size_t kChunkAlignment = kCacheLineSize / sizeof(float);
+
+  /** ParallelFor() aims for this many chunks per thread, so that threads
+   that finish early (or were busy elsewhere) can steal the stragglers' work.
+   */
+  static const size_t kChunksPerThread = 4;
+
+  /** Capacity of each worker's deque, and of the queue for tasks spawned from
+   outside the pool.  Tasks that don't fit are run by the spawning thread
+   right away.
+   */
+  static const size_t kQueueCapacity = 1024;
+
+  class TaskGroup;
+
+  /** Unit of work; derive from it and implement Run(), or use MakeTask().
+   */
+  class Task
+  {
+  public:
+
+    Task ()
+      : group_(nullptr)
+    {}
+
+    virtual ~Task () {}
+
+    virtual void Run () = 0;
+
+  private:
+
+    friend class TaskPool;
+
+    /** Set by Spawn()
+    */
+    TaskGroup* group_;
+  };
+
+  template <class F>
+  class FuncTask : public Task
+  {
+  public:
+
+    explicit FuncTask (const F& func)
+      : func_(func)
+    {}
+
+    virtual void Run () override {
+      func_();
+    }
+
+  private:
+
+    F func_;
+  };
+
+  /** Wraps a callable, e.g. a lambda, in a Task:
+       auto task = TaskPool::MakeTask([&] { ... });
+       pool.Spawn(&task, &group);
+   */
+  template <class F>
+  static FuncTask<F> MakeTask (const F& func) {
+    return FuncTask<F>(func);
+  }
+
+  /** Counts the tasks that have been spawned into it and have yet to finish.
+   A group may be reused once it is done.
+   */
+  class TaskGroup
+  {
+  public:
+
+    TaskGroup ()
+      : pending_(0)
+    {}
+
+    TaskGroup (const TaskGroup& copy_src) = delete;
+
+    TaskGroup& operator = (const TaskGroup& copy_src) = delete;
+
+    bool done () const {
+      return (0 == pending_.load(std::memory_order_acquire));
+    }
+
+  private:
+
+    friend class TaskPool;
+
+    std::atomic<int> pending_;
+  };
+
+  /** Starts \p n_workers worker threads; if \p n_workers is negative, one
+   fewer than the number of hardware threads is used, as threads waiting on
+   the pool do a share of the work themselves.  Workers are placed according
+   to \p placement; a worker that can't be pinned runs unpinned.
+   */
+  explicit TaskPool (int n_workers = -1,
+                     PlacementPolicy placement = PlacementPolicy::kNone);
+
+  TaskPool (const TaskPool& copy_src) = delete;
+
+  /** Stops and joins all of the workers.  Every group must have been waited
+   for.
+   */
+  ~TaskPool ();
+
+  TaskPool& operator = (const TaskPool& copy_src) = delete;
+
+  /** Number of worker threads, not counting threads waiting on the pool.
+   */
+  int n_workers () const {
+    return static_cast<int>(workers_.size());
+  }
+
+  /** Worker \p index, for Pause() / Unpause(), state change listeners and
+   the like; don't request states on it.  A worker that is sleeping for lack
+   of work notices a Pause() when next woken, before it takes another task.
+   */
+  UThread& worker (int index) {
+    return *workers_[index];
+  }
+
+  PlacementPolicy placement () const {
+    return placement_;
+  }
+
+  /** Queues \p task to be run by some thread of the pool, or by a thread in
+   Wait(), and counts it in \p group.  \p task must stay alive until \p group
+   has been waited for.  May be called from any thread, including from
+   within tasks.
+   */
+  void Spawn (Task* task, TaskGroup* group);
+
+  /** Returns once every task spawned into \p group has finished, running
+   queued tasks on the calling thread in the meantime.
+   */
+  void Wait (TaskGroup* group);
+
+  /** Calls \p func(begin, end) on disjoint sub-ranges covering [0, \p n), in
+   parallel, and returns once all of them have completed.  No chunk is
+   smaller than \p min_chunk_size unless it is the only one.  May be called
+   from any thread, including from within tasks, and by several threads at
+   once.
+   */
+  template <class F>
+  void ParallelFor (size_t n, size_t min_chunk_size, const F& func) {
+    RangeJob job;
+    job.func = &func;
+    job.call = &CallRange<F>;
+    job.n = n;
+    job.chunk_size = ChunkSize(n, min_chunk_size);
+    Run(job);
+  }
+
+  /** Calls \p func(i) for each i in [0, \p n), each as a task of its own,
+   and returns once all of them have completed; for a handful of coarse,
+   independent jobs.
+   */
+  template <class F>
+  void ParallelForEach (size_t n, const F& func) {
+    auto range_func = [&func] (size_t begin, size_t end) {
+      for (size_t i = begin; i < end; ++i) {
+        func(i);
+      }
+    };
+    RangeJob job;
+    job.func = &range_func;
+    job.call = &CallRange<decltype(range_func)>;
+    job.n = n;
+    job.chunk_size = 1;
+    Run(job);
+  }
+
+  /** Calls \p func(i) exactly once on each worker i, on that worker's own
+   thread, and returns once all of the calls have completed; for per-worker
+   setup such as NUMA first-touch of the data a worker will work on.  Calls
+   \p func(0) on the calling thread if there are no workers.  Workers that
+   have exited, or are exiting before they get to it, are skipped.  Must not
+   be called from within a task, and blocks while any worker is paused.
+   @return The number of calls made, i.e. n_workers() less those skipped.
+   */
+  int RunOnEachWorker (const std::function<void(int)>& func);
+
+private:
+
+  /** Type-erased ParallelFor() job; refers to the caller's functor rather
+   than copying it, unlike std::function, so it never allocates.
+   */
+  struct RangeJob
+  {
+    const void* func;
+    void (*call) (const void* func, size_t begin, size_t end);
+    size_t n;
+    size_t chunk_size;
+  };
+
+  template <class F>
+  static void CallRange (const void* func, size_t begin, size_t end) {
+    (*static_cast<const F*>(func))(begin, end);
+  }
+
+  /** Runs chunks [first, last) of a RangeJob
+   */
+  class ChunkTask : public Task
+  {
+  public:
+
+    ChunkTask (TaskPool* pool, const RangeJob* job, size_t first, size_t last)
+      : pool_(pool),
+        job_(job),
+        first_(first),
+        last_(last)
+    {}
+
+    virtual void Run () override {
+      pool_->RunChunks(*job_, first_, last_);
+    }
+
+  private:
+
+    TaskPool* pool_;
+    const RangeJob* job_;
+    size_t first_;
+    size_t last_;
+  };
+
+  typedef WorkStealingDeque<Task, kQueueCapacity> WorkerQueue;
+
+  size_t ChunkSize (size_t n, size_t min_chunk_size) const;
+
+  void Run (const RangeJob& job);
+
+  /** Splits chunks [first, last) in two, spawns the upper half and recurses
+   into the lower one
+   */
+  void RunChunks (const RangeJob& job, size_t first, size_t last);
+
+  Result WorkerMain (UThread* uthread, int index);
+
+  /** Index of the calling thread's own deque, or -1 if it isn't one of this
+   pool's workers
+   */
+  int CurrentWorker () const;
+
+  /** Next task for worker \p index (or -1 for an outside thread): one
+   pinned to it by RunOnEachWorker(), its own newest, then one spawned from
+   outside, then one stolen from another worker.
+   */
+  Task* FindTask (int index);
+
+  /** True if worker \p index might find a task
+   */
+  bool HasWork (int index) const;
+
+  void Execute (Task* task);
+
+  bool Inject (Task* task);
+
+  Task* TakeInjected ();
+
+  /** Wakes a sleeping worker, if any, after a task has been queued; all of
+   them if \p all is set
+   */
+  void NotifyWork (bool all = false);
+
+  /** Spins for a while, then sleeps until a task is queued or the pool is
+   shutting down; for worker \p index
+   */
+  void IdleWait (int index);
+
+  std::vector<std::unique_ptr<UThread>> workers_;
+
+  /** One per worker, indexed like workers_; allocated before any worker
+   starts and never resized.
+   */
+  std::vector<WorkerQueue, AlignedAllocator<WorkerQueue>> queues_;
+
+  /** One per worker: a task that only that worker may run, set by
+   RunOnEachWorker(), which takes it back if the worker exits first
+   */
+  std::unique_ptr<std::atomic<Task*>[]> pinned_;
+
+  PlacementPolicy placement_;
+
+  /** Tasks spawned by threads that aren't workers, FIFO
+   */
+  std::mutex inject_mutex_;
+  Task* inject_ring_ [kQueueCapacity];
+  size_t inject_head_;
+  std::atomic<size_t> n_injected_;
+
+  /** Incremented for every queued task; a worker about to sleep compares it
+   with the value it saw before its last look for work.
+   */
+  alignas(kCacheLineSize) std::atomic<uint64_t> work_epoch_;
+  std::atomic<int> n_sleepers_;
+  std::atomic<bool> shutting_down_;
+
+  std::mutex idle_mutex_;
+  std::condition_variable idle_cond_;
+};
+
+}
+
+#endif
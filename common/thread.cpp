@@ -1,4 +1,5 @@
 #include <unistd.h>
+#include <sched.h>
 #include <sys/time.h>
 #include <sys/resource.h>
 #include <cstdint>
@@ -19,6 +20,7 @@
 #include "common/result.hpp"
 #include "common/i_stringable.hpp"
 #include "common/thread.hpp"
+#include "common/cpu_topology.hpp"
 
 using boost::thread;
 using namespace std;
@@ -32,8 +34,26 @@ using namespace evo::opt;
 const ThreadId UThread::kInvalidThreadId = ThreadId();
 
 
-static unordered_map <ThreadId, UThread*, ThreadIdHash> g_uthread_registry;
-static mutex g_uthread_registry_mutex;
+/** Looked up by id for other threads, which is rare next to the lookups a
+ thread does of its own UThread, so those skip the registry entirely.
+ Allocated on first use and never freed, as a detached UThread may still be
+ unregistering while static destructors run at exit.
+ */
+struct UThreadRegistry
+{
+  unordered_map <ThreadId, UThread*, ThreadIdHash> uthreads;
+  boost::shared_mutex uthreads_mutex;
+};
+
+static UThreadRegistry& Registry ()
+{
+  static UThreadRegistry* registry = new UThreadRegistry;
+  return *registry;
+}
+
+/** The UThread running on the calling thread, if any
+ */
+static thread_local UThread* tls_uthread = nullptr;
 
 /** Facilitates RAII-style global UThread registration
  */
@@ -42,26 +62,34 @@ class UThreadRegistration
 public:
 
   UThreadRegistration (UThread* uthread) {
-    unique_lock<mutex> lock (g_uthread_registry_mutex);
-    g_uthread_registry [GetThisThreadId()] = uthread;
+    tls_uthread = uthread;
+    UThreadRegistry& registry = Registry();
+    boost::unique_lock<boost::shared_mutex> lock (registry.uthreads_mutex);
+    registry.uthreads [GetThisThreadId()] = uthread;
   }
   ~UThreadRegistration () {
-    unique_lock<mutex> lock (g_uthread_registry_mutex);
-    g_uthread_registry.erase(GetThisThreadId());
+    UnregisterThread(GetThisThreadId());
+    {
+      UThreadRegistry& registry = Registry();
+      boost::unique_lock<boost::shared_mutex> lock (registry.uthreads_mutex);
+      registry.uthreads.erase(GetThisThreadId());
+    }
+    tls_uthread = nullptr;
   }
 };
 
-UThread* evo::GetUThread (ThreadId id, bool acquire_state_lock)
+ResultOr<UThread*> evo::GetUThread (ThreadId id, bool acquire_state_lock)
 {
-  unique_lock<mutex> lock (g_uthread_registry_mutex);
+  UThreadRegistry& registry = Registry();
+  boost::shared_lock<boost::shared_mutex> lock (registry.uthreads_mutex);
 
-  auto iter = g_uthread_registry.find(id);
-  if (g_uthread_registry.end() == iter) {
-    return nullptr;
+  auto iter = registry.uthreads.find(id);
+  if (registry.uthreads.end() == iter) {
+    return NOT_FOUND.Prepend("No UThread is running as that thread");
   }
 
   // if the UThread exists in the registry, then it hasn't been freed, and
-  // won't be unregistered as long as we control the registry mutex
+  // won't be unregistered as long as we hold the registry lock
 
   UThread* uthread = iter->second;
 
@@ -75,7 +103,7 @@ UThread* evo::GetUThread (ThreadId id, bool acquire_state_lock)
 UThread* evo::GetThisUThread ()
 {
   // not acquiring state lock, as the returned UThread represents THIS thread
-  return GetUThread(GetThisThreadId(), false);
+  return tls_uthread;
 }
 
 
@@ -146,8 +174,14 @@ UThread :: UThread (const string& thread_name, ThreadExecFunc thread_func)
 void UThread :: Init ()
 {
   lwpid_ = 0;
+  numa_node_ = -1;
 
   cycle_count_ = 0;
+  fast_path_ = false;
+
+  cycle_histogram_ = nullptr;
+  sleep_overshoot_histogram_ = nullptr;
+  cycle_end_ns_ = 0;
 
   state_           = State::kInvalid;
   requested_state_ = State::kInvalid;
@@ -344,6 +378,7 @@ Result UThread :: RequestState (State newstate, Duration timeout)
     if (Duration(0) == timeout) // don't block
     {
       requested_state_ = newstate;
+      DisableFastPath_locked();
       // wake thread regardless of state since State::kGo threads may still
       // enter into an interruptible sleep to satisfy the cycle wait period
       go_cond_.notify_one();
@@ -390,6 +425,7 @@ Result UThread :: RequestState (State newstate, Duration timeout)
         }
 
         requested_state_ = newstate;
+        DisableFastPath_locked();
 
         // wake thread regardless of state since State::kGo threads enter into
         // an interruptible sleep for UThread::cycle_wait_usec at the top of
@@ -453,23 +489,22 @@ Result UThread :: RequestStateMultiple (const vector<UThread*>& in_threads,
                                          State newstate,
                                          vector<StateChangeFail>* failures_out)
 {
-  // TODO: Should really have a debug-only assertion that verfies there are
-  // no other active calls to this function whose <threads> array intersects
-  // with the <threads> array to this call, because should this race condition
-  // ever arise, it could manifest as bizarre symptoms that are difficult to
-  // diagnose.
-
   Result res;
+  Result first_error;
+  int n_failures = 0;
 
-  int go_state_pending_count = 0;
-  condition_variable go_state_ready_cond;
-  mutex go_state_ready_mutex;
-
-  mutex failures_mutex;
+  auto add_failure = [&] (UThread* thread, const Result& error) {
+    if (0 == n_failures++) {
+      first_error = error;
+    }
+    if (failures_out) {
+      failures_out->push_back(StateChangeFail(thread, error));
+    }
+  };
 
-  // subset of in_threads excluding those UThreads whose state cannot be
-  // changed for whatever reason (indicated in failures_out)
-  vector<UThread*> threads;
+  // kExited can't be requested directly; request kExiting and then wait
+  const State request_state = (State::kExited == newstate ? State::kExiting
+                                                          : newstate);
 
   // synchronously activating multiple UThreads is a little more complicated
   // than activating a single UThread.  The idea here is to make sure that
@@ -479,85 +514,89 @@ Result UThread :: RequestStateMultiple (const vector<UThread*>& in_threads,
   // UThread in <uthreads> will not resume until all <uthreads> have reached
   // a checkpoint in ProcState() strategically positioned beyond the
   // point at which UThread::state changes.
-  if (State::kGo == newstate)
+  StateBarrier barrier;
+
+  // targets whose new state has been requested, but not yet awaited
+  vector<UThread*> requested;
+  requested.reserve(in_threads.size());
+
   {
-    go_state_ready_mutex.lock();
+    // held while enrolling targets, so that none of them can pass the
+    // barrier before all have been enrolled
+    unique_lock<mutex> barrier_lock (barrier.mutex);
 
-    for (auto& thread : in_threads)
+    // every request is non-blocking, so all of the targets change state in
+    // parallel; no waiting until all have been asked
+    for (UThread* thread : in_threads)
     {
+      if (!thread->thread_exists()) {
+        add_failure(thread, NOT_INIT.Prepend(
+            "[RequestStateMultiple] UThread has not been started"));
+        continue;
+      }
+
       thread->LockState();
-      if (thread->is_available()) {
-        threads.push_back(thread);
-        thread->RequestStateMultiple_Prepare( &go_state_pending_count,
-                                              &go_state_ready_mutex,
-                                              &go_state_ready_cond );
+
+      if (State::kExited == newstate && State::kExited == thread->state_) {
+        // already where the caller wants it
+        res = SUCCESS;
       }
-      else { // !thread.is_available(), i.e. thread has exiting or has exited.
-        // Skip threads that are exiting or have already exited;
-        // it's thread-safe to decrement this repeatedly in this loop even
-        // though multiple UThreads are pointing to it since we haven't
-        // unlocked the go_state_ready_mutex yet.
-        --go_state_pending_count;
-        stringstream strm;
-        strm << "[RequestStateMultiple] Cannot set target thread state to '"
-             << StateToString(newstate) << "', thread is exiting or has exited.";
-        if (failures_out) {
-          failures_out->push_back( StateChangeFail(thread,
-              SHUTTING_DOWN.Prepend(strm.str())) );
+      else if (SUCCESS == (res = thread->RequestState(request_state,
+                                                      Blocking::kOff)))
+      {
+        if (State::kGo == request_state) {
+          // a target that was already running has nothing to synchronize
+          if (State::kGo == thread->requested_state_) {
+            thread->RequestStateMultiple_Prepare(&barrier);
+          }
+        } else {
+          requested.push_back(thread);
         }
       }
-      thread->UnlockState();
-    }
-    go_state_pending_count = threads.size();
-  }
 
-  vector<unique_ptr<RequestStateMultipleHelper>> helpers;
+      thread->UnlockState();
 
-  // first start one temporary thread for each UThread entering <newstate>
-  for (auto& thread : threads)
-  {
-    RequestStateMultipleHelper* helper = new RequestStateMultipleHelper(
-        thread, newstate, &failures_mutex, failures_out );
-    if (SUCCESS != (res = helper->Start()))
-    {
-      if (failures_out) {
+      if (SUCCESS != res) {
         stringstream strm;
-        strm << "[RequestStateMultiple] Couldn't start helper for thread [LWPID "
-             << thread->lwpid() << "]";
-        failures_out->push_back(StateChangeFail(thread, res.Prepend(strm.str())));
+        strm << "[RequestStateMultiple] Couldn't request new state '"
+             << StateToString(newstate) << "' for thread '" << thread->name()
+             << "'";
+        add_failure(thread, res.Prepend(strm.str()));
       }
-      delete helper;
-      continue;
     }
-    helpers.push_back(unique_ptr<RequestStateMultipleHelper>(helper));
-  }
 
-  if (State::kGo == newstate)
-  {
-    if (go_state_pending_count > 0) {
-      // wait for all target UThreads to activate, i.e., enter the GO state
-      unique_lock<mutex> go_state_ready_lock (go_state_ready_mutex,
-                                              defer_lock_t());
-      go_state_ready_cond.wait(go_state_ready_lock);
-      go_state_ready_lock.release();
+    // the last target to leave the barrier wakes us
+    while (barrier.n_leaving > 0) {
+      barrier.cond.wait(barrier_lock);
     }
-    go_state_ready_mutex.unlock();
-    // Bug check: ensure that this actually worked (# threads not in GO state == 0)
-    assert (0 == go_state_pending_count);
   }
 
-  // now wait for all of the helpers to complete
-  for (auto& helper : helpers)
+  // the other states have no barrier; every target is already on its way,
+  // so waiting for them one by one takes as long as the slowest
+  for (UThread* thread : requested)
   {
-    if (SUCCESS != (res = helper->Join()))
-    {
-      if (failures_out) {
-        failures_out->push_back( StateChangeFail(helper->uthread(),
-            res.Prepend("[RequestStateMultiple] Couldn't join with helper thread")) );
-      }
+    if (State::kExited == newstate) {
+      res = thread->StateWait(State::kExited);
+    } else {
+      // re-requests if someone else's request got in the way
+      res = thread->RequestState(newstate, Blocking::kOn);
+    }
+    if (SUCCESS != res) {
+      stringstream strm;
+      strm << "[RequestStateMultiple] Thread '" << thread->name()
+           << "' didn't assume state '" << StateToString(newstate) << "'";
+      add_failure(thread, res.Prepend(strm.str()));
     }
   }
 
+  if (n_failures > 0) {
+    stringstream strm;
+    strm << "[RequestStateMultiple] " << n_failures << " of "
+         << in_threads.size() << " threads failed to assume state '"
+         << StateToString(newstate) << "'";
+    return first_error.Prepend(strm.str());
+  }
+
   return SUCCESS;
 }
 
@@ -680,6 +719,7 @@ Result UThread :: RunNCycles (int n_cycles, Blocking block)
       cycle_wait_skip_count_ = n_cycles;
     }
     cycle_wait_skip_orig_state_ = state_;
+    DisableFastPath_locked();
     if (State::kIdle == state_) {
       res = RequestState(State::kGo, opt::Blocking::kOff);
     }
@@ -849,6 +889,7 @@ Result UThread :: Pause ()
   }
 
   is_pause_pending_ = true;
+  DisableFastPath_locked();
 
   // if we're between cycles and were able to acquire the state_ready_lock,
   // it's safe to assume that we're either State::kIdle or waiting for a
@@ -1022,6 +1063,94 @@ Result UThread :: SetRelativePriority (int priority)
   return NOT_IMPLEMENTED.Prepend("UThread::SetRelativePriority()");
 }
 
+Result UThread :: SetAffinity (const vector<int>& cpus)
+{
+  if (cpus.empty()) {
+    return INVALID_ARGUMENT.Prepend("UThread::SetAffinity(): no CPUs given");
+  }
+  for (int cpu : cpus) {
+    if (cpu < 0 || cpu >= CPU_SETSIZE) {
+      return INVALID_ARGUMENT.Prepend("UThread::SetAffinity(): bad CPU " +
+                                      to_string(cpu));
+    }
+  }
+
+  Result res = SUCCESS;
+  bool use_lock = !have_state_lock();
+
+  if (use_lock) LockState();
+
+  affinity_ = cpus;
+  numa_node_ = -1;
+  // otherwise _mainThreadFunc() applies it once the thread is up
+  if (0 != lwpid_ && thread_exists()) {
+    res = ApplyAffinity_locked();
+  }
+
+  if (use_lock) UnlockState();
+
+  return res;
+}
+
+Result UThread :: SetNumaNode (int node)
+{
+  vector<int> cpus = CpuTopology::Get().NodeCpus(node);
+  if (cpus.empty()) {
+    return INVALID_ARGUMENT.Prepend("UThread::SetNumaNode(): no usable CPUs on"
+                                    " node " + to_string(node));
+  }
+
+  bool use_lock = !have_state_lock();
+
+  if (use_lock) LockState();
+
+  Result res = SetAffinity(cpus);
+  if (SUCCESS == res) {
+    numa_node_ = node;
+  }
+
+  if (use_lock) UnlockState();
+
+  return res;
+}
+
+vector<int> UThread :: affinity () const
+{
+  bool use_lock = !have_state_lock();
+
+  if (use_lock) LockState();
+  vector<int> cpus = affinity_;
+  if (use_lock) UnlockState();
+
+  return cpus;
+}
+
+int UThread :: numa_node () const
+{
+  bool use_lock = !have_state_lock();
+
+  if (use_lock) LockState();
+  int node = numa_node_;
+  if (use_lock) UnlockState();
+
+  return node;
+}
+
+Result UThread :: ApplyAffinity_locked ()
+{
+  cpu_set_t mask;
+  CPU_ZERO(&mask);
+  for (int cpu : affinity_) {
+    CPU_SET(cpu, &mask);
+  }
+
+  if (0 != sched_setaffinity(lwpid_, sizeof(mask), &mask)) {
+    return Result().FromErrno("sched_setaffinity() failed for thread \"" +
+                              name_ + "\"");
+  }
+  return SUCCESS;
+}
+
 Result UThread :: SetSelfExiting ()
 {
   Result res;
@@ -1090,12 +1219,100 @@ Result UThread :: Sleep (Duration max_duration)
 }
 
 UThread::ProcStateResult UThread :: ProcState ()
+{
+  // nothing pending: skip the state lock altogether.  Requests made after
+  // this load are picked up by the next call.
+  if (fast_path_.load(memory_order_acquire))
+  {
+    LatencyHistogram* cycle_histogram =
+        cycle_histogram_.load(memory_order_relaxed);
+    if (cycle_histogram)
+    {
+      // the fast path takes next to no time, so the cycle ends as it starts
+      const int64_t now = SteadyTimePoint::Now().since_epoch().Nanoseconds();
+      if (0 != cycle_end_ns_) {
+        cycle_histogram->RecordNanoseconds(now - cycle_end_ns_);
+      }
+      cycle_end_ns_ = now;
+    }
+
+    // only this thread ever writes cycle_count_, so no read-modify-write
+    cycle_count_.store(cycle_count_.load(memory_order_relaxed) + 1,
+                       memory_order_relaxed);
+    return ProcStateResult::kContinue;
+  }
+
+  bool use_lock = !have_state_lock();
+
+  if (use_lock) LockState();
+
+  LatencyHistogram* cycle_histogram =
+      cycle_histogram_.load(memory_order_relaxed);
+  if (cycle_histogram && 0 != cycle_end_ns_) {
+    cycle_histogram->RecordNanoseconds(
+        SteadyTimePoint::Now().since_epoch().Nanoseconds() - cycle_end_ns_);
+  }
+
+  ProcStateResult procstate_res = ProcStateSlow_locked();
+  UpdateFastPath_locked();
+
+  // re-read, as the slow path may have slept for a long time
+  cycle_histogram = cycle_histogram_.load(memory_order_relaxed);
+  cycle_end_ns_ = (cycle_histogram
+                   ? SteadyTimePoint::Now().since_epoch().Nanoseconds()
+                   : 0);
+
+  if (use_lock) UnlockState();
+
+  return procstate_res;
+}
+
+void UThread :: set_cycle_stats_enabled (bool enable)
+{
+  bool use_lock = !have_state_lock();
+
+  if (use_lock) LockState();
+
+  // the next ProcState() takes the slow path, which (re)starts or forgets
+  // cycle_end_ns_
+  DisableFastPath_locked();
+
+  if (enable) {
+    sleep_overshoot_histogram_ =
+        GetLatencyHistogram("UThread." + name_ + ".sleep_overshoot");
+    cycle_histogram_.store(GetLatencyHistogram("UThread." + name_ + ".cycle"),
+                           memory_order_relaxed);
+  } else {
+    sleep_overshoot_histogram_ = nullptr;
+    cycle_histogram_.store(nullptr, memory_order_relaxed);
+  }
+
+  if (use_lock) UnlockState();
+}
+
+void UThread :: UpdateFastPath_locked ()
+{
+  // MUST have state lock
+  assert (have_state_lock());
+
+  const bool nothing_pending =
+      State::kGo      == state_ &&
+      State::kInvalid == requested_state_ &&
+      State::kInvalid == cycle_wait_skip_orig_state_ &&
+      !is_pause_pending_ &&
+      !set_state_multiple_info_.in_progress &&
+      CycleWait::kIndefinite != cycle_wait_type_ &&
+      cycle_wait_period_ <= Duration(0);
+
+  fast_path_.store(nothing_pending, memory_order_release);
+}
+
+UThread::ProcStateResult UThread :: ProcStateSlow_locked ()
 {
   Result res;
   ProcStateResult procstate_res = ProcStateResult::kContinue;
   bool handle_state_changed = false;
   bool cond_signalled = false;
-  bool use_lock = false;
   const ThreadId self_thread_id = boost::this_thread::get_id();
 
   // as this method should only be invoked by the thread function, arriving
@@ -1114,9 +1331,8 @@ UThread::ProcStateResult UThread :: ProcState ()
   // (kExited is only set by the thread wrapper function (that called the
   // custom thread func) after the custom thread function returns)
 
-  use_lock = !have_state_lock();
-
-  if (use_lock) LockState();
+  // MUST have state lock
+  assert (have_state_lock());
 
   ++cycle_count_;
 
@@ -1129,7 +1345,6 @@ UThread::ProcStateResult UThread :: ProcState ()
     // but I guess it's not awful if we end up here again, so we'll just deal
     // with it.
     ConsiderPause_locked();
-    if (use_lock) UnlockState();
     return ProcStateResult::kExit;
   }
 
@@ -1155,7 +1370,6 @@ UThread::ProcStateResult UThread :: ProcState ()
         // remaining and continue
         ConsiderPause_locked();
         --cycle_wait_skip_count_;
-        if (use_lock) UnlockState();
         return ProcStateResult::kContinue;
       }
       else
@@ -1222,10 +1436,16 @@ UThread::ProcStateResult UThread :: ProcState ()
             cond_signalled = true;
           }
           else {
+            const SteadyTimePoint sleep_start = SteadyTimePoint::Now();
             res = StateCondWaitFor(go_cond_, sleep_period);
             // the StateCond*() functions should all return SUCCESS or TIMED_OUT
             assert (res.is_success() || TIMED_OUT == res);
             cond_signalled = res.is_success();
+
+            if (!cond_signalled && sleep_overshoot_histogram_) {
+              sleep_overshoot_histogram_->Record(
+                  SteadyTimePoint::Now() - sleep_start - sleep_period);
+            }
           }
 
           cycle_wait_mutex_.lock();
@@ -1286,7 +1506,6 @@ UThread::ProcStateResult UThread :: ProcState ()
             prev_cycle_time_point_ = TimePoint::Now();
             is_between_cycles_ = false;
             ConsiderPause_locked();
-            if (use_lock) UnlockState();
             return ProcStateResult::kContinue;
           }
         }
@@ -1306,7 +1525,6 @@ UThread::ProcStateResult UThread :: ProcState ()
       cycle_wait_mutex_.unlock();
       is_between_cycles_ = false;
       ConsiderPause_locked();
-      if (use_lock) UnlockState();
       return ProcStateResult::kContinue;
     }
   }
@@ -1411,25 +1629,31 @@ UThread::ProcStateResult UThread :: ProcState ()
   {
     // Note that, in this context, State::kGo, kExiting, and kExited states
     // are valid
-    set_state_multiple_info_.go_mutex_p->lock();
-
-    --(*set_state_multiple_info_.pending_count_p);
-
-    if (*set_state_multiple_info_.pending_count_p) {
-      // this assertion happens if we decrement too many times (which would
-      // amount to one yucky bug.)
-      assert (*set_state_multiple_info_.pending_count_p > 0);
-      unique_lock<mutex> unique_state_ready_lock (
-          *set_state_multiple_info_.go_mutex_p, defer_lock_t() );
-      set_state_multiple_info_.go_cond_p->wait(unique_state_ready_lock);
-      unique_state_ready_lock.release();
+    StateBarrier* barrier = set_state_multiple_info_.barrier;
+    set_state_multiple_info_.Clear();
+
+    unique_lock<mutex> barrier_lock (barrier->mutex);
+
+    // this assertion happens if we decrement too many times (which would
+    // amount to one yucky bug.)
+    assert (barrier->n_arriving > 0);
+
+    if (0 == --barrier->n_arriving) {
+      // this is the last UThread to reach this State::kGo checkpoint; one
+      // broadcast releases every other target
+      barrier->cond.notify_all();
     }
     else {
-      // this is the last UThread to reach this State::kGo checkpoint
-      set_state_multiple_info_.go_cond_p->notify_all();
+      while (barrier->n_arriving > 0) {
+        barrier->cond.wait(barrier_lock);
+      }
+    }
+
+    // the barrier lives on the stack of RequestStateMultiple(), which
+    // returns once every target has left
+    if (0 == --barrier->n_leaving) {
+      barrier->cond.notify_all();
     }
-    set_state_multiple_info_.go_mutex_p->unlock();
-    set_state_multiple_info_.Clear();
   }
 
   // this is here so it won't happen more than is necessary
@@ -1448,7 +1672,6 @@ UThread::ProcStateResult UThread :: ProcState ()
 
   ConsiderPause_locked();
 
-  if (use_lock) UnlockState();
 
   return procstate_res;
 }
@@ -1537,12 +1760,13 @@ void UThread :: ConsiderPause_locked ()
   }
 }
 
-void UThread :: RequestStateMultiple_Prepare (int* pending_count_p,
-                                               std::mutex* go_mutex_p,
-                                               std::condition_variable* go_cond_p)
+void UThread :: RequestStateMultiple_Prepare (StateBarrier* barrier)
 {
   assert (have_state_lock());
-  set_state_multiple_info_.Activate(pending_count_p, go_mutex_p, go_cond_p);
+  set_state_multiple_info_.Activate(barrier);
+  ++barrier->n_arriving;
+  ++barrier->n_leaving;
+  DisableFastPath_locked();
 }
 
 void UThread :: SetStateInternal (State new_state)
@@ -1580,6 +1804,14 @@ void UThread :: _mainThreadFunc ()
 
   lwpid_ = GetCurrentThreadLwpid();
 
+  if (!affinity_.empty())
+  {
+    Result res = ApplyAffinity_locked();
+    if (SUCCESS != res) {
+      QLOG(WARNING) << res.ToString();
+    }
+  }
+
   if (enable_thread_wrapper_log_messages_) {
     QLOG(INFO) << "New thread: " << ToString();
   }
@@ -1627,72 +1859,3 @@ void UThread :: _mainThreadFunc ()
 
   UnlockState();
 }
-
-
-UThread::RequestStateMultipleHelper :: RequestStateMultipleHelper (
-    UThread* uthread, State newstate, std::mutex* failures_mutex,
-    std::vector<StateChangeFail>* failures_out )
-{
-  uthread_ = uthread;
-  newstate_ = newstate;
-  failures_mutex_ = failures_mutex;
-  failures_out_   = failures_out;
-  helper_thread_  = nullptr;
-}
-
-Result UThread::RequestStateMultipleHelper :: Start ()
-{
-  if (helper_thread_) {
-    return STATE_ALREADY_EFFECTIVE;
-  }
-  helper_thread_.reset(
-      new boost::thread(&UThread::RequestStateMultipleHelper::_threadFunc, this) );
-
-  return SUCCESS;
-}
-
-Result UThread::RequestStateMultipleHelper :: Join ()
-{
-  helper_thread_->join();
-  helper_thread_.reset();
-
-  return SUCCESS;
-}
-
-void UThread::RequestStateMultipleHelper :: _threadFunc ()
-{
-  Result res;
-
-  if (State::kExited == newstate_)
-  {
-    // handle State::kExited separately; the caller wants to block until the
-    // thread is no longer running
-    if (SUCCESS != (res = uthread_->RequestState(State::kExiting,
-                                                  opt::Blocking::kOff))) {
-      res.Prepend("Couldn't request 'exiting' state for thread");
-    }
-    else if (SUCCESS != (res = uthread_->StateWait(State::kExited))) {
-      res.Prepend("Failed while waiting for thread to exit");
-    }
-  }
-  else
-  {
-    if (SUCCESS != (res = uthread_->RequestState(newstate_,
-                                                  opt::Blocking::kOn))) {
-      stringstream strm;
-      strm << "Couldn't request new state '" << StateToString(newstate_)
-           << "' for thread";
-      res.Prepend(strm.str());
-    }
-  }
-
-  if (res.is_error())
-  {
-    if (failures_out_) {
-      failures_mutex_->lock();
-      failures_out_->push_back(StateChangeFail(uthread_, res));
-      failures_mutex_->unlock();
-    }
-  }
-}
-
@@ -2,6 +2,7 @@
 #define COMMON_THREAD_HPP
 
 #include <cstdint>
+#include <atomic>
 #include <memory>
 #include <boost/thread.hpp>
 #include <functional>
@@ -13,6 +14,7 @@
 #include "common/result.hpp"
 #include "common/time_measures.hpp"
 #include "common/i_stringable.hpp"
+#include "common/latency_histogram.hpp"
 //#include "pscommon2/general.hpp"
 //#include "pscommon2/result.hpp"
 //#include "pscommon2/interfaces/i_stringable.hpp"
@@ -108,6 +110,24 @@ public:
    */
   typedef std::function <void (const UThread&, State, State)> StateChangeListenerFunc;
 
+  /** Countdown barrier shared by the caller of RequestStateMultiple(kGo)
+      and its target UThreads; lives on the caller's stack.  Each target
+      holds in ProcState() once it has assumed kGo, and the last one to get
+      there releases all of them with a single broadcast.  The caller waits
+      for every target to have left before the barrier goes away.
+   */
+  struct StateBarrier
+  {
+    StateBarrier ()
+      : n_arriving(0),
+        n_leaving(0)
+    {}
+    std::mutex mutex;
+    std::condition_variable cond;
+    int n_arriving; ///< Targets that have yet to assume kGo
+    int n_leaving;  ///< Targets that have yet to leave the barrier
+  };
+
   struct RequestStateMultipleInfo
   {
     RequestStateMultipleInfo () {
@@ -115,21 +135,14 @@ public:
     }
     void Clear () {
       in_progress = false;
-      pending_count_p = nullptr;
-      go_mutex_p = nullptr;
-      go_cond_p = nullptr;
+      barrier = nullptr;
     }
-    void Activate (int* _pending_count_p, std::mutex* _go_mutex_p,
-                   std::condition_variable* _go_cond_p) {
+    void Activate (StateBarrier* _barrier) {
       in_progress = true;
-      pending_count_p = _pending_count_p;
-      go_mutex_p = _go_mutex_p;
-      go_cond_p = _go_cond_p;
+      barrier = _barrier;
     }
     bool in_progress;
-    int* pending_count_p;
-    std::mutex* go_mutex_p;
-    std::condition_variable* go_cond_p;
+    StateBarrier* barrier;
   };
 
   /** Used exclusively by RequestStateMultiple()
@@ -282,6 +295,15 @@ public:
     enable_thread_wrapper_log_messages_ = enable;
   }
 
+  /** When enabled, ProcState() records the time the thread spends between
+   cycles, i.e. from one ProcState() returning to the next being called, in
+   the histogram "UThread.<name>.cycle", and how far each cycle wait sleep
+   overran its period in "UThread.<name>.sleep_overshoot" (see
+   GetLatencyHistogram()).  Costs a clock read or two per cycle, so it is off
+   by default.
+   */
+  void set_cycle_stats_enabled (bool enable);
+
   /** Starts the thread and blocks until it has assumed the 'Idle' state.
    */
   evo::Result Start ();
@@ -324,6 +346,12 @@ public:
       This happens in parallel, and while the times at which the threads actually
       assume \p newstate should be very nearly equal, the order in which
       \p newstate is assumed by the threads is arbitrary.
+      All of the requests are issued from the calling thread; for kGo, the
+      targets then hold in ProcState() until the last of them has assumed
+      kGo (see StateBarrier), so none of them resumes its work early.  Targets
+      already in kGo are left running.  kExited may be requested, meaning
+      kExiting followed by waiting for kExited.
+      A UThread must not appear in \p threads more than once.
       The purpose of this function is to minimize the average time required to
       simultaneously apply a given state to multiple UThreads, and also to
       standardize the procedure by which this is accomplished.
@@ -514,6 +542,36 @@ public:
   */
   evo::Result SetRelativePriority (int priority);
 
+  /** Restricts the thread to the logical CPUs in \p cpus, via
+      sched_setaffinity().  If the thread hasn't been started yet, the mask is
+      applied by the thread itself as it starts, before the thread function
+      is called, so that memory it touches first is placed accordingly.
+  \returns Result; fails if:
+      * \p cpus is empty or names a CPU beyond CPU_SETSIZE; or
+      * The sched_setaffinity syscall fails (e.g. none of \p cpus is online
+        or allowed to this process).
+  */
+  evo::Result SetAffinity (const std::vector<int>& cpus);
+
+  /** Restricts the thread to the CPUs of NUMA node \p node, as read from
+      sysfs by CpuTopology; memory the thread touches first is then allocated
+      on that node by the kernel's default policy.
+  \returns Result; fails if:
+      * There is no node \p node with CPUs available to this process; or
+      * SetAffinity() fails.
+  */
+  evo::Result SetNumaNode (int node);
+
+  /** CPUs passed to the most recent SetAffinity(), or empty if it was never
+      called.
+  */
+  std::vector<int> affinity () const;
+
+  /** Node passed to the most recent SetNumaNode(), or -1 if the affinity
+      wasn't set by node.
+  */
+  int numa_node () const;
+
   /** The only way for a UThread to manually set its own state to kExiting.
       Typically, kExiting is explicitly requested by another thread when
       necessary, but in certain circumstances a thread may decide to abort
@@ -558,6 +616,9 @@ public:
       type before the call returns.  If a new state is requested while
       waiting, then the thread is woken and the new state is processed
       before ProcState() returns.
+      In the common case -- kGo, no cycle wait period, and no state change,
+      pause or RunNCycles() pending -- it returns without taking the state
+      lock, so it is cheap enough to call between small units of work.
       \returns true if the thread should continue normally, or false if the
           UThread state is kExiting, and as such the thread should return
           from its function ASAP.
@@ -581,39 +642,16 @@ protected:
 
 private:
 
-  class RequestStateMultipleHelper
-  {
-  public:
-
-    RequestStateMultipleHelper ( UThread* uthread, State newstate,
-        std::mutex* failures_mutex, std::vector<StateChangeFail>* failures_out );
-
-    UThread* uthread () {
-      return uthread_;
-    }
-    evo::Result Start ();
-    evo::Result Join ();
-
-  private:
-
-    void _threadFunc ();
-
-    UThread* uthread_;
-    State newstate_;
-    std::mutex* failures_mutex_;
-    std::vector<StateChangeFail>* failures_out_;
-    std::unique_ptr<boost::thread> helper_thread_;
-  };
-
   void Init ();
 
   void InitThread (evo::opt::Blocking block);
 
   void ConsiderPause_locked ();
 
-  void RequestStateMultiple_Prepare (int* pending_count,
-                                     std::mutex* go_mutex,
-                                     std::condition_variable* go_cond);
+  /** Enrolls the UThread in \p barrier; must have the state lock and the
+   barrier's mutex.
+   */
+  void RequestStateMultiple_Prepare (StateBarrier* barrier);
 
   void SetStateInternal (State new_state);
 
@@ -630,9 +668,32 @@ private:
     bool use_lock = !have_state_lock();
     if (use_lock) LockState();
     *internal_var_p = new_val;
+    DisableFastPath_locked();
     if (use_lock) UnlockState();
   }
 
+  /** Sends the next call to ProcState() down the locked path; invoked, with
+   the state lock held, by anything that changes what ProcState() has to do.
+   */
+  void DisableFastPath_locked () {
+    fast_path_.store(false, std::memory_order_release);
+  }
+
+  /** Re-enables the ProcState() fast path if nothing remains for it to do.
+   Must have the state lock.
+   */
+  void UpdateFastPath_locked ();
+
+  /** Body of ProcState() for when the fast path is disabled.  Must have the
+   state lock.
+   */
+  ProcStateResult ProcStateSlow_locked ();
+
+  /** Hands affinity_ to sched_setaffinity() for the running thread.  Must
+   have the state lock.
+   */
+  evo::Result ApplyAffinity_locked ();
+
   /** boost::thread doesn't require this to be static!  Awesome.
    Special naming because this method is only indirectly invoked by the new thread.
    */
@@ -658,10 +719,35 @@ private:
   */
   pid_t lwpid_;
 
+  /** \see SetAffinity(), SetNumaNode()
+  */
+  std::vector<int> affinity_;
+  int numa_node_;
+
   /** Thread cycle counter, incremented for each call to ProcState().  This is
       typically the # iterations of the thread's outermost loop.
+      Only the UThread's own thread writes it, outside the state lock on the
+      fast path.
+  */
+  std::atomic<int64_t> cycle_count_;
+
+  /** True while ProcState() may return kContinue without taking the state
+      lock, i.e. the thread is in kGo with no state change, pause, cycle skip
+      or cycle wait period pending.  Cleared by whoever sets one of those
+      (DisableFastPath_locked()), set again by the locked path of ProcState().
+  */
+  std::atomic<bool> fast_path_;
+
+  /** \see set_cycle_stats_enabled(); null when disabled.  The former is read
+      on the fast path, the latter under the state lock.
+  */
+  std::atomic<LatencyHistogram*> cycle_histogram_;
+  LatencyHistogram* sleep_overshoot_histogram_;
+
+  /** When ProcState() last returned, for cycle_histogram_; written only by
+      the UThread's own thread, zero if unknown.
   */
-  int64_t cycle_count_;
+  int64_t cycle_end_ns_;
 
   /** Current, effective state of the UThread.
    */
@@ -777,11 +863,12 @@ private:
   */
 };
 
-/** WARNING: Retrieving an unlocked UThread is generally a bad idea, as it
+/** The UThread running as thread \p id, or NOT_FOUND if there is none.
+ WARNING: Retrieving an unlocked UThread is generally a bad idea, as it
  could become freed before the caller has a chance to access it, except of
  course when the returned UThread is associated with the CURRENT thread.
  */
-UThread* GetUThread (ThreadId id, bool acquire_state_lock);
+ResultOr<UThread*> GetUThread (ThreadId id, bool acquire_state_lock);
 
 UThread* GetThisUThread ();
 
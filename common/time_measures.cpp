@@ -1,6 +1,13 @@
 #include <ctime>
+#include <cmath>
+#include <fstream>
+#include <mutex>
 #include <sstream>
 #include <iomanip>
+#include <thread>
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#endif
 
 #include "common/time_measures.hpp"
 
@@ -233,3 +240,109 @@ TimePoint TimePoint::AverageTimePoints(TimePoint first, TimePoint second) {
   return TimePoint(first_ticks + second_ticks);
 }
 
+
+
+SteadyTimePoint::SteadyTimePoint()
+    : std_time_point_(time_point_cast<Duration::StdDuration>(StdClock::now())) { }
+
+SteadyTimePoint::SteadyTimePoint(Duration since_epoch)
+    : std_time_point_(since_epoch.std_duration()) { }
+
+SteadyTimePoint::SteadyTimePoint(StdTimePoint std_time_point)
+    : std_time_point_(std_time_point) { }
+
+string SteadyTimePoint::ToString() const {
+  return since_epoch().ToStringPretty();
+}
+
+SteadyTimePoint SteadyTimePoint::Now() {
+  return SteadyTimePoint();
+}
+
+
+
+/** Simultaneous readings of FastClock and CLOCK_MONOTONIC: the monotonic
+ reading is bracketed by two FastClock ones, and the tightest of a few tries
+ is kept, so that neither a preemption nor a cold first call skews it.
+ */
+struct FastClockSample
+{
+  FastClockSample () {
+    Ticks best_gap = -1;
+    for (int i = 0; i < 5; ++i) {
+      const Ticks before = FastClock::Now();
+      const int64_t mono = FastClock::MonotonicNanoseconds();
+      const Ticks after = FastClock::Now();
+      if (best_gap < 0 || after - before < best_gap) {
+        best_gap = after - before;
+        ticks = before + (after - before) / 2;
+        ns = mono;
+      }
+    }
+  }
+
+  typedef FastClock::Ticks Ticks;
+
+  Ticks ticks;
+  int64_t ns;
+};
+
+/** Taken at static initialization, i.e. about when the program started; the
+ far end of the calibration interval
+ */
+static const FastClockSample g_fast_clock_start;
+
+static once_flag g_fast_clock_calibrated;
+static double g_fast_clock_ticks_per_ns = 1;
+
+bool FastClock::DetectUsableTsc() {
+#if defined(__x86_64__) || defined(__i386__)
+  // the kernel only picks the TSC when it has checked that it is invariant
+  // and synchronized, which is more than CPUID alone tells (e.g. in VMs)
+  ifstream file ("/sys/devices/system/clocksource/clocksource0/"
+                 "current_clocksource");
+  string clocksource;
+  if (file >> clocksource) {
+    return ("tsc" == clocksource);
+  }
+
+  // no sysfs; fall back to CPUID's invariant TSC bit
+  unsigned eax, ebx, ecx, edx;
+  if (__get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx)) {
+    return (0 != (edx & (1u << 8)));
+  }
+#endif
+  return false;
+}
+
+void FastClock::Calibrate() {
+  if (!uses_tsc()) {
+    return;
+  }
+
+  call_once(g_fast_clock_calibrated, [] {
+    const int64_t elapsed_ns = MonotonicNanoseconds() - g_fast_clock_start.ns;
+    if (elapsed_ns < kMinCalibrationPeriodNs) {
+      this_thread::sleep_for(
+          chrono::nanoseconds(kMinCalibrationPeriodNs - elapsed_ns));
+    }
+
+    const FastClockSample end;
+    g_fast_clock_ticks_per_ns =
+        static_cast<double>(end.ticks - g_fast_clock_start.ticks) /
+        (end.ns - g_fast_clock_start.ns);
+  });
+}
+
+double FastClock::ticks_per_ns() {
+  if (!uses_tsc()) {
+    return 1;
+  }
+
+  Calibrate();
+  return g_fast_clock_ticks_per_ns;
+}
+
+Duration FastClock::ToDuration(Ticks ticks) {
+  return Duration(static_cast<int64_t>(llround(ticks / ticks_per_ns())));
+}
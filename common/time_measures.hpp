@@ -1,6 +1,7 @@
 #ifndef LIB_TIME_MEASURES_HPP
 #define LIB_TIME_MEASURES_HPP
 
+#include <time.h>
 #include <chrono>
 #include <ratio>
 #include <string>
@@ -341,6 +342,155 @@ private:
   StdTimePoint std_time_point_;
 };
 
+/** A point on the monotonic clock (std::chrono::steady_clock, i.e.
+ CLOCK_MONOTONIC on Linux), which unlike TimePoint's system clock never
+ jumps when the wall clock is set or slewed by NTP.  Its epoch is arbitrary
+ (typically boot), so it is only good for measuring intervals and scheduling
+ deadlines, never for display.
+ */
+class SteadyTimePoint : public IStringable
+{
+public:
+
+  typedef std::chrono::steady_clock StdClock;
+
+  typedef std::chrono::time_point<StdClock, Duration::StdDuration> StdTimePoint;
+
+  /** The current time, as with TimePoint
+   */
+  SteadyTimePoint();
+
+  /** @param since_epoch Time since the clock's (arbitrary) epoch.
+   */
+  explicit SteadyTimePoint(Duration since_epoch);
+
+  explicit SteadyTimePoint(StdTimePoint time_point);
+
+  StdTimePoint std_time_point() const {
+    return std_time_point_;
+  }
+
+  /** Time since the clock's epoch, e.g. for clock_nanosleep(CLOCK_MONOTONIC)
+   */
+  Duration since_epoch() const {
+    return Duration(std_time_point_.time_since_epoch());
+  }
+
+  /** Time since the clock's epoch, pretty printed
+   */
+  virtual std::string ToString() const override;
+
+  static SteadyTimePoint Now();
+
+  inline SteadyTimePoint &operator+=(const Duration &rhs) {
+    std_time_point_ += rhs.std_duration();
+    return *this;
+  }
+
+  inline SteadyTimePoint &operator-=(const Duration &rhs) {
+    std_time_point_ -= rhs.std_duration();
+    return *this;
+  }
+
+  inline SteadyTimePoint operator+(const Duration &rhs) const {
+    return SteadyTimePoint(std_time_point_ + rhs.std_duration());
+  }
+
+  inline SteadyTimePoint operator-(const Duration &rhs) const {
+    return SteadyTimePoint(std_time_point_ - rhs.std_duration());
+  }
+
+  inline Duration operator-(const SteadyTimePoint &rhs) const {
+    return Duration(std_time_point_ - rhs.std_time_point_);
+  }
+
+  inline bool operator==(const SteadyTimePoint &rhs) const {
+    return std_time_point_ == rhs.std_time_point_;
+  }
+
+  inline bool operator!=(const SteadyTimePoint &rhs) const {
+    return std_time_point_ != rhs.std_time_point_;
+  }
+
+  inline bool operator<(const SteadyTimePoint &rhs) const {
+    return std_time_point_ < rhs.std_time_point_;
+  }
+
+  inline bool operator<=(const SteadyTimePoint &rhs) const {
+    return std_time_point_ <= rhs.std_time_point_;
+  }
+
+  inline bool operator>(const SteadyTimePoint &rhs) const {
+    return std_time_point_ > rhs.std_time_point_;
+  }
+
+  inline bool operator>=(const SteadyTimePoint &rhs) const {
+    return std_time_point_ >= rhs.std_time_point_;
+  }
+
+private:
+
+  StdTimePoint std_time_point_;
+};
+
+/** The cheapest monotonic timestamp there is, for instrumenting tight loops
+ where even SteadyTimePoint::Now() is too slow: on x86 with a TSC the kernel
+ trusts (constant rate, in sync across cores), a bare rdtsc; elsewhere
+ clock_gettime(CLOCK_MONOTONIC).  Readings are raw ticks that only mean
+ something as differences; convert those with ToDuration() when reporting.
+
+ The tick rate is calibrated against CLOCK_MONOTONIC over the time since
+ the program started, which takes at least kMinCalibrationPeriodNs.  Programs
+ should call Calibrate() at startup; otherwise the first conversion does it,
+ and may sleep for that long in the middle of whatever it was timing.
+ */
+class FastClock
+{
+public:
+
+  typedef int64_t Ticks;
+
+  static const int64_t kMinCalibrationPeriodNs = 20 * 1000 * 1000;
+
+  static Ticks Now() {
+#if defined(__x86_64__) || defined(__i386__)
+    if (uses_tsc()) {
+      // the builtin rather than __rdtsc(), which would need <x86intrin.h>
+      // in every file that includes this one
+      return static_cast<Ticks>(__builtin_ia32_rdtsc());
+    }
+#endif
+    return MonotonicNanoseconds();
+  }
+
+  static Duration ToDuration(Ticks ticks);
+
+  /** Calibrates the tick rate, if that hasn't been done yet, sleeping until
+   kMinCalibrationPeriodNs have passed since the program started
+   */
+  static void Calibrate();
+
+  /** 1 unless uses_tsc()
+   */
+  static double ticks_per_ns();
+
+  static bool uses_tsc() {
+    // decided once, so that all readings share a unit
+    static const bool use_tsc = DetectUsableTsc();
+    return use_tsc;
+  }
+
+  static Ticks MonotonicNanoseconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<Ticks>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+  }
+
+private:
+
+  static bool DetectUsableTsc();
+};
+
 inline Duration operator*(int64_t lhs, const Duration &rhs) {
   return rhs * lhs;
 }
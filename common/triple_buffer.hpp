@@ -0,0 +1,91 @@
+#ifndef COMMON_TRIPLE_BUFFER_HPP
+#define COMMON_TRIPLE_BUFFER_HPP
+
+#include <atomic>
+#include <cstdint>
+
+#include "common/aligned_allocator.hpp"
+
+namespace evo {
+
+/** Wait-free single-producer, single-consumer triple buffer.  The producer
+ fills write_buffer() and calls Publish(); the consumer calls Latest() and
+ gets the most recently published value.  Three slots are rotated with atomic
+ index exchanges: one owned by the producer, one by the consumer, and one in
+ the middle holding the latest published value.  Neither side ever blocks
+ or waits for the other, and a value is never modified while the consumer
+ can see it.
+
+ Values that the consumer never gets around to reading are simply
+ overwritten.  Slots are reused, so a T that holds its data in containers
+ stops allocating once the containers have grown to size.
+ */
+template <class T>
+class TripleBuffer
+{
+public:
+
+  TripleBuffer ()
+    : write_index_(0),
+      middle_(1),
+      read_index_(2)
+  {}
+
+  TripleBuffer (const TripleBuffer& copy_src) = delete;
+
+  TripleBuffer& operator = (const TripleBuffer& copy_src) = delete;
+
+  /** Producer only: the slot to fill before the next Publish().  Its previous
+   contents are an older value, not necessarily the last one published.
+   */
+  T& write_buffer () {
+    return slots_[write_index_];
+  }
+
+  /** Producer only: makes write_buffer() the latest value and hands the
+   producer a different slot to fill.
+   */
+  void Publish () {
+    write_index_ = middle_.exchange(write_index_ | kFreshBit,
+                                    std::memory_order_acq_rel) & kIndexMask;
+  }
+
+  /** Consumer only: the most recently published value, or a
+   default-constructed T if nothing has been published yet.  The reference
+   stays valid and unchanged until the consumer's next call to Latest().
+   */
+  const T& Latest () {
+    if (middle_.load(std::memory_order_acquire) & kFreshBit) {
+      read_index_ = middle_.exchange(read_index_,
+                                     std::memory_order_acq_rel) & kIndexMask;
+    }
+    return slots_[read_index_];
+  }
+
+  /** Consumer only: true if something has been published since the last call
+   to Latest().
+   */
+  bool has_fresh () const {
+    return (0 != (middle_.load(std::memory_order_acquire) & kFreshBit));
+  }
+
+private:
+
+  static const uint8_t kIndexMask = 0x3;
+
+  /** Set in middle_ by Publish() and cleared by Latest()
+   */
+  static const uint8_t kFreshBit = 0x4;
+
+  T slots_ [3];
+
+  // each index on its own cache line, so that the producer and consumer only
+  // ever share the one they exchange through
+  alignas(kCacheLineSize) uint8_t write_index_;
+  alignas(kCacheLineSize) std::atomic<uint8_t> middle_;
+  alignas(kCacheLineSize) uint8_t read_index_;
+};
+
+}
+
+#endif
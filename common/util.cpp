@@ -0,0 +1,124 @@
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <unordered_map>
+#include <unordered_set>
+#include <mutex>
+#include <string>
+#include <boost/thread.hpp>
+
+#include "common/util.hpp"
+
+using namespace std;
+using namespace evo;
+
+/** Thread-name bookkeeping.  Allocated on first use and never freed:
+ UThreads detach from their boost::thread, so one may still be
+ unregistering its name while static destructors run at exit.
+ */
+struct ThreadNameRegistry
+{
+  /** Every name ever given to a thread.  Entries are never removed, so
+   pointers into the set remain valid for the life of the process and can
+   be cached by the threads carrying the names.
+   */
+  unordered_set<string> interned_names;
+  mutex interned_names_mutex;
+
+  /** Names of other threads, looked up by id.  Only written when a thread
+   registers or unregisters, hence the reader-writer lock.
+   */
+  unordered_map<ThreadId, const string*, ThreadIdHash> names;
+  boost::shared_mutex names_mutex;
+
+  const string no_name;
+};
+
+static ThreadNameRegistry& Registry ()
+{
+  static ThreadNameRegistry* registry = new ThreadNameRegistry;
+  return *registry;
+}
+
+/** The calling thread's interned name, or null if it has none; read by
+ every QLOG line
+ */
+static thread_local const string* tls_thread_name = nullptr;
+
+static const string* InternThreadName (const string& name)
+{
+  ThreadNameRegistry& registry = Registry();
+  lock_guard<mutex> lock (registry.interned_names_mutex);
+  return &*registry.interned_names.insert(name).first;
+}
+
+void evo::RegisterCurrentThreadName (const string& name)
+{
+  const string* interned = InternThreadName(name);
+  tls_thread_name = interned;
+
+  ThreadNameRegistry& registry = Registry();
+  boost::unique_lock<boost::shared_mutex> lock (registry.names_mutex);
+  registry.names[GetThisThreadId()] = interned;
+}
+
+void evo::UnregisterThread (ThreadId id)
+{
+  if (GetThisThreadId() == id) {
+    tls_thread_name = nullptr;
+  }
+
+  ThreadNameRegistry& registry = Registry();
+  boost::unique_lock<boost::shared_mutex> lock (registry.names_mutex);
+  registry.names.erase(id);
+}
+
+const string& evo::GetCurrentThreadName ()
+{
+  return (tls_thread_name ? *tls_thread_name : Registry().no_name);
+}
+
+string evo::GetThreadName (ThreadId id)
+{
+  ThreadNameRegistry& registry = Registry();
+  boost::shared_lock<boost::shared_mutex> lock (registry.names_mutex);
+
+  auto iter = registry.names.find(id);
+  return (registry.names.end() == iter ? string() : *iter->second);
+}
+
+bool evo::IsThreadNameRegistered (ThreadId thread_id)
+{
+  ThreadNameRegistry& registry = Registry();
+  boost::shared_lock<boost::shared_mutex> lock (registry.names_mutex);
+  return (registry.names.end() != registry.names.find(thread_id));
+}
+
+ThreadId evo::GetThisThreadId ()
+{
+  return boost::this_thread::get_id();
+}
+
+pid_t evo::GetCurrentThreadLwpid ()
+{
+  return static_cast<pid_t>(syscall(SYS_gettid));
+}
+
+string evo::SystemTimeToString (
+    const chrono::system_clock::time_point& tp )
+{
+  const time_t t = chrono::system_clock::to_time_t(tp);
+  struct tm tm_buf;
+  char buf [64];
+
+  localtime_r(&t, &tm_buf);
+  if (0 == strftime(buf, sizeof(buf), "%Y-%m-%d %H:%M:%S", &tm_buf)) {
+    return "";
+  }
+  return buf;
+}
+
+string evo::CurrentSystemTimeToString ()
+{
+  return SystemTimeToString(chrono::system_clock::now());
+}
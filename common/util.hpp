@@ -9,6 +9,7 @@
 #include <sstream>
 #include <glog/logging.h>
 #include <boost/thread.hpp>
+#include <boost/functional/hash.hpp>
 
 #include "common/compat.hpp"
 #include "common/string.hpp"
@@ -47,33 +48,53 @@ static const int INVAL_FD = -1;
 
 /** Necessary since std::*map does not natively support boost::thread::id as
  * the key type.
- * This approach was recommended by
- * http://stackoverflow.com/questions/2850142/how-can-i-use-boostthreadid-as-key-to-an-unordered-map
+ * Hashes the id's underlying thread data pointer (via the hash_value() that
+ * boost provides for thread::id), so nothing is allocated or formatted.
  */
 struct ThreadIdHash
 {
   size_t operator () (const ThreadId& id) const {
-    std::ostringstream os;
-    os << id;
-    return std::hash<std::string>()(os.str());
+    return boost::hash<ThreadId>()(id);
   }
 };
 
+/** Lowercases ASCII letters only; any other byte, e.g. one of a UTF-8
+ * sequence, is returned as it is.
+ */
+inline char AsciiToLower (char ch) {
+  return (static_cast<unsigned char>(ch - 'A') < 26
+          ? static_cast<char>(ch | 0x20) : ch);
+}
+
 /**
- * A string hash functor that ignores case.
+ * A string hash functor that ignores ASCII case.  FNV-1a over the bytes,
+ * each lowercased as it is read, so that no lowercase copy is allocated.
  */
 struct CaseInsensitiveStringHash {
   size_t operator () (const std::string& str) const {
-    return std::hash<std::string>()(StrToLower(str));
+    uint64_t hash = 14695981039346656037ULL;
+    for (char ch : str) {
+      hash ^= static_cast<unsigned char>(AsciiToLower(ch));
+      hash *= 1099511628211ULL;
+    }
+    return static_cast<size_t>(hash);
   }
 };
 
 /**
- * A string comparer functor that ignores case.
+ * A string comparer functor that ignores ASCII case, comparing in place.
  */
 struct CaseInsensitiveStringComparer {
   bool operator () (const std::string &lhs, const std::string &rhs) const {
-    return StrToLower(rhs) == StrToLower(lhs);
+    if (lhs.size() != rhs.size()) {
+      return false;
+    }
+    for (size_t i = 0; i < lhs.size(); ++i) {
+      if (lhs[i] != rhs[i] && AsciiToLower(lhs[i]) != AsciiToLower(rhs[i])) {
+        return false;
+      }
+    }
+    return true;
   }
 };
 
@@ -125,14 +146,19 @@ T BoolToBooleanEnum (bool val) {
  */
 void RegisterCurrentThreadName (const std::string& name);
 
+/**
+ * Removes \p id from the name map; a no-op if it isn't registered.
+ */
 void UnregisterThread (ThreadId id);
 
 /**
- * Retrieves the name of the calling thread.
- * @return The calling thread's name. If this thread's id was not registered
- * by calling RegisterCurrentThreadName, an empty string is returned.
+ * Retrieves the name of the calling thread.  The name is cached in thread
+ * local storage, so this neither locks nor allocates.
+ * @return The calling thread's name, which remains valid for the life of the
+ * process. If this thread's id was not registered by calling
+ * RegisterCurrentThreadName, an empty string is returned.
  */
-std::string GetCurrentThreadName ();
+const std::string& GetCurrentThreadName ();
 
 /**
  * Retrieves the name of a thread with a particular thread id.
@@ -0,0 +1,125 @@
+#ifndef COMMON_WORK_STEALING_DEQUE_HPP
+#define COMMON_WORK_STEALING_DEQUE_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+#include "common/aligned_allocator.hpp"
+
+namespace evo {
+
+/** Fixed-capacity Chase-Lev work-stealing deque of pointers (Chase & Lev
+ 2005, with the C11 memory orderings of Le et al. 2013).  The owning thread
+ pushes and pops at the bottom, LIFO; any other thread may steal from the
+ top, FIFO, so thieves take the oldest (and, in divide-and-conquer code,
+ largest) items while the owner keeps working on the newest.
+
+ The ring never grows: Push() fails when it is full, and the caller is
+ expected to run the item itself instead.  Nothing is ever allocated after
+ construction.
+ */
+template <class T, size_t kCapacity>
+class WorkStealingDeque
+{
+  static_assert(0 == (kCapacity & (kCapacity - 1)),
+                "WorkStealingDeque capacity must be a power of two");
+
+public:
+
+  WorkStealingDeque ()
+    : top_(0),
+      bottom_(0)
+  {
+    for (size_t i = 0; i < kCapacity; ++i) {
+      slots_[i].store(nullptr, std::memory_order_relaxed);
+    }
+  }
+
+  WorkStealingDeque (const WorkStealingDeque& copy_src) = delete;
+
+  WorkStealingDeque& operator = (const WorkStealingDeque& copy_src) = delete;
+
+  /** Owner only.  Returns false, leaving the deque unchanged, if it is full.
+   */
+  bool Push (T* item) {
+    const int64_t b = bottom_.load(std::memory_order_relaxed);
+    const int64_t t = top_.load(std::memory_order_acquire);
+    if (b - t >= static_cast<int64_t>(kCapacity)) {
+      return false;
+    }
+    slots_[b & kMask].store(item, std::memory_order_relaxed);
+    // publishes the item to thieves, which acquire bottom_
+    bottom_.store(b + 1, std::memory_order_release);
+    return true;
+  }
+
+  /** Owner only: the most recently pushed item, or null if the deque is
+   empty or a thief took the last item first.
+   */
+  T* Pop () {
+    const int64_t b = bottom_.load(std::memory_order_relaxed) - 1;
+    bottom_.store(b, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t t = top_.load(std::memory_order_relaxed);
+
+    if (t > b) {
+      // empty
+      bottom_.store(b + 1, std::memory_order_relaxed);
+      return nullptr;
+    }
+
+    T* item = slots_[b & kMask].load(std::memory_order_relaxed);
+    if (t == b)
+    {
+      // last item; race the thieves for it
+      if (!top_.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst,
+                                        std::memory_order_relaxed)) {
+        item = nullptr;
+      }
+      bottom_.store(b + 1, std::memory_order_relaxed);
+    }
+    return item;
+  }
+
+  /** Any thread: the least recently pushed item, or null if the deque is
+   empty or another thread got to it first.
+   */
+  T* Steal () {
+    int64_t t = top_.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    const int64_t b = bottom_.load(std::memory_order_acquire);
+
+    if (t >= b) {
+      return nullptr;
+    }
+
+    T* item = slots_[t & kMask].load(std::memory_order_relaxed);
+    if (!top_.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst,
+                                      std::memory_order_relaxed)) {
+      return nullptr;
+    }
+    return item;
+  }
+
+  /** Approximate when called by anyone but the owner
+   */
+  bool empty () const {
+    return (bottom_.load(std::memory_order_relaxed) <=
+            top_.load(std::memory_order_relaxed));
+  }
+
+private:
+
+  static const size_t kMask = kCapacity - 1;
+
+  // thieves hammer top_, the owner bottom_
+  alignas(kCacheLineSize) std::atomic<int64_t> top_;
+  alignas(kCacheLineSize) std::atomic<int64_t> bottom_;
+
+  std::atomic<T*> slots_ [kCapacity];
+};
+
+}
+
+#endif
@@ -0,0 +1,147 @@
+#include <string>
+#include <sstream>
+#include <cstring>
+
+#include "common/result.hpp"
+#include "common/barnes_hut.hpp"
+#include "common/spatial_hash_grid.hpp"
+#include "common/span_tracer.hpp"
+#include "common/symplectic_integrator.hpp"
+#include "wiztest/src/EvoUniverse.hpp"
+
+using namespace std;
+using namespace evo;
+using namespace std_results;
+
+static const double kDefaultG = 6.67408e-11;
+
+/** Times every force evaluation of another engine, so that the forces phase
+ can be told apart from the rest of an integrator step
+ */
+class TimedForceEngine : public IForceEngine
+{
+public:
+
+  TimedForceEngine (IForceEngine* engine, LatencyHistogram* histogram)
+    : engine_(engine),
+      histogram_(histogram)
+  {}
+
+  virtual Result ComputeAccelerations (double G,
+                                       ParticleStore* things) override {
+    ScopedLatencyTimer timer (histogram_);
+    ScopedSpan span ("EvoUniverse.forces");
+    return engine_->ComputeAccelerations(G, things);
+  }
+
+  virtual Result ComputeAccelerationsFor (double G, ParticleStore* things,
+                                          const uint32_t* targets,
+                                          size_t n_targets) override {
+    ScopedLatencyTimer timer (histogram_);
+    ScopedSpan span ("EvoUniverse.forces");
+    return engine_->ComputeAccelerationsFor(G, things, targets, n_targets);
+  }
+
+private:
+
+  IForceEngine* engine_;
+  LatencyHistogram* histogram_;
+};
+
+EvoUniverse :: EvoUniverse (PlacementPolicy placement)
+  : G_(kDefaultG),
+    prev_virtual_time_(0),
+    task_pool_(-1, placement),
+    force_engine_(new BarnesHutGravity()),
+    integrator_(new SymplecticIntegrator<VelocityVerlet>(&task_pool_)),
+    forces_phase_(DeclarePhase("forces")),
+    integrate_phase_(DeclarePhase("integrate")),
+    collide_phase_(DeclarePhase("collide")),
+    snapshot_phase_(DeclarePhase("snapshot"))
+{
+  SpatialHashGrid* grid = new SpatialHashGrid();
+  grid->set_task_pool(&task_pool_);
+  broadphase_.reset(grid);
+}
+
+EvoUniverse :: ~EvoUniverse ()
+{
+}
+
+size_t EvoUniverse :: AddThing (const SphericalThing& thing)
+{
+  integrator_->InvalidateAccelerations();
+  return things_.Add(thing);
+}
+
+Result EvoUniverse :: TickHandler (int tick_index, Duration virtual_time,
+                                   Duration /*real_time*/)
+{
+  Result res;
+
+  float dt = static_cast<float>((virtual_time - prev_virtual_time_).Seconds());
+  prev_virtual_time_ = virtual_time;
+
+  if (dt > 0)
+  {
+    // a null engine means ballistic motion, so it mustn't be wrapped
+    TimedForceEngine timed_forces (force_engine_.get(), forces_phase_);
+    IForceEngine* engine = (force_engine_ ? &timed_forces : nullptr);
+
+    ScopedLatencyTimer timer (integrate_phase_);
+    ScopedSpan span ("EvoUniverse.integrate");
+    if (SUCCESS != (res = integrator_->Step(dt, G_, engine, &things_))) {
+      return res.Prepend("Couldn't advance the universe");
+    }
+  }
+
+  if (broadphase_)
+  {
+    ScopedLatencyTimer timer (collide_phase_);
+    ScopedSpan span ("EvoUniverse.collide");
+    if (SUCCESS != (res = broadphase_->Update(things_))) {
+      return res.Prepend("Couldn't find contacts");
+    }
+  }
+
+  {
+    ScopedLatencyTimer timer (snapshot_phase_);
+    ScopedSpan span ("EvoUniverse.snapshot");
+    PublishSnapshot(tick_index, virtual_time);
+  }
+
+  return SUCCESS;
+}
+
+void EvoUniverse :: PublishInitialSnapshot ()
+{
+  PublishSnapshot(-1, prev_virtual_time_);
+}
+
+void EvoUniverse :: PublishSnapshot (int tick_index, Duration virtual_time)
+{
+  UniverseSnapshot& snapshot = snapshots_.write_buffer();
+  const size_t n = things_.size();
+
+  snapshot.tick_index = tick_index;
+  snapshot.virtual_time = virtual_time;
+  // assign() reuses the slot's storage once it has grown to size
+  snapshot.x.assign(things_.x(), things_.x() + n);
+  snapshot.y.assign(things_.y(), things_.y() + n);
+  snapshot.z.assign(things_.z(), things_.z() + n);
+  snapshot.radius.assign(things_.radius(), things_.radius() + n);
+
+  snapshots_.Publish();
+}
+
+LatencyHistogram* EvoUniverse :: DeclarePhase (const string& name)
+{
+  return GetLatencyHistogram("EvoUniverse." + name);
+}
+
+string EvoUniverse :: ToString () const
+{
+  std::stringstream strm;
+  strm << "G = " << G_ << ", # things = " << things_.size();
+  return strm.str();
+}
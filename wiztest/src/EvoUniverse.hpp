@@ -1,33 +1,194 @@
-#ifndef WIZTEST_SRC_WIZ_HPP
-#define WIZTEST_SRC_WIZ_HPP
+#ifndef WIZTEST_SRC_EVO_UNIVERSE_HPP
+#define WIZTEST_SRC_EVO_UNIVERSE_HPP
 
 #include <string>
 #include <sstream>
+#include <memory>
 
+#include "common/result.hpp"
+#include "common/time_measures.hpp"
+#include "common/spherical_thing.hpp"
+#include "common/i_broadphase.hpp"
+#include "common/i_force_engine.hpp"
+#include "common/i_integrator.hpp"
+#include "common/latency_histogram.hpp"
+#include "common/particle_store.hpp"
+#include "common/task_pool.hpp"
+#include "common/triple_buffer.hpp"
 #include "common/util.hpp"
 
 namespace evo {
 
+/** Copy of the bodies' state as of the end of one tick, published for
+ readers on other threads (e.g. the renderer).  Never modified while a reader
+ holds it.
+ */
+struct UniverseSnapshot
+{
+  UniverseSnapshot ()
+    : tick_index(-1),
+      virtual_time(0)
+  {}
+
+  size_t size () const {
+    return x.size();
+  }
+
+  /** -1 until the first tick has been published
+  */
+  int tick_index;
+  Duration virtual_time;
+
+  AlignedFloatVector x;
+  AlignedFloatVector y;
+  AlignedFloatVector z;
+  AlignedFloatVector radius;
+};
+
 class EvoUniverse
 {
 public:
 
-  EvoUniverse ();
+  /** \p placement is the policy for the universe's TaskPool workers
+   */
+  explicit EvoUniverse (PlacementPolicy placement = PlacementPolicy::kNone);
 
   ~EvoUniverse ();
 
+  double G () const {
+    return G_;
+  }
+
+  const ParticleStore& things () const {
+    return things_;
+  }
+
+  ParticleStore& things () {
+    return things_;
+  }
+
+  IForceEngine* force_engine () const {
+    return force_engine_.get();
+  }
+
+  /** Replaces the gravity solver; the universe takes ownership of \p engine.
+   Defaults to a BarnesHutGravity with the default opening angle; a
+   DirectGravity is exact and faster for populations below about 20k, and
+   ParticleMeshGravity suits very large, roughly uniform periodic universes.
+   */
+  void set_force_engine (IForceEngine* engine) {
+    force_engine_.reset(engine);
+    integrator_->InvalidateAccelerations();
+  }
+
+  IIntegrator* integrator () const {
+    return integrator_.get();
+  }
+
+  /** Replaces the time integrator; the universe takes ownership of
+   \p integrator.  Defaults to a SymplecticIntegrator<VelocityVerlet> running
+   on task_pool(); a SymplecticIntegrator<Yoshida4> costs three force
+   evaluations per tick but stays accurate at much longer ticks, and a
+   BlockTimestepIntegrator gives bodies in close encounters short timesteps
+   without imposing them on the rest of the universe.
+   */
+  void set_integrator (IIntegrator* integrator) {
+    integrator_.reset(integrator);
+  }
+
+  /** Workers shared by the universe's parallel stages, i.e. the default
+   integrator and broadphase.
+   */
+  TaskPool& task_pool () {
+    return task_pool_;
+  }
+
+  /** Collision broadphase; after each tick, iterating over it yields the
+   pairs of bodies that currently overlap.
+   */
+  const IBroadphase* broadphase () const {
+    return broadphase_.get();
+  }
+
+  /** Replaces the collision broadphase; the universe takes ownership of
+   \p broadphase.  Defaults to a SpatialHashGrid running on task_pool().
+   */
+  void set_broadphase (IBroadphase* broadphase) {
+    broadphase_.reset(broadphase);
+  }
+
+  /** Adds a copy of \p thing to the universe.
+   @return The index of the new body within things().
+   */
+  size_t AddThing (const SphericalThing& thing);
+
+  /** The snapshot published by the most recent tick.  Never blocks, nor
+   blocks the ticking thread; the returned snapshot stays valid and unchanged
+   until the next call.  Only one thread may read snapshots.
+   */
+  const UniverseSnapshot& LatestSnapshot () {
+    return snapshots_.Latest();
+  }
+
+  /** Publishes a snapshot of the bodies as they are now, with a tick_index
+   of -1, so that readers have something to show before the first tick.
+   Like TickHandler(), only to be called from the ticking thread, or before
+   the ticker is started.
+   */
+  void PublishInitialSnapshot ();
+
+  /** Advances the universe by one Planck tick and publishes a snapshot of
+   the result; intended to be bound to a PlanckTicker.
+
+   Each phase of a tick is timed into the histogram
+   "EvoUniverse.<phase>" (see DumpStats()): "integrate" is the whole
+   integrator step, "forces" the force evaluations within it, "collide" the
+   broadphase update and "snapshot" publishing the snapshot.  While a
+   SpanTracer is running, each phase is traced as a span of the same name.
+   */
+  Result TickHandler (int tick_index, Duration virtual_time,
+                      Duration real_time);
+
   std::string ToString () const;
 
 private:
 
+  void PublishSnapshot (int tick_index, Duration virtual_time);
+
+  /** The histogram that times tick phase \p name
+   */
+  static LatencyHistogram* DeclarePhase (const std::string& name);
+
   /** Gravitational constant
   */
   double G_;
 
-  std::vector<SphericalThing> things_;
+  /** Virtual time at which the previous tick was handled
+  */
+  Duration prev_virtual_time_;
+
+  ParticleStore things_;
+
+  /** Declared before integrator_ and broadphase_, which may refer to it
+  */
+  TaskPool task_pool_;
+
+  std::unique_ptr<IForceEngine> force_engine_;
+
+  std::unique_ptr<IIntegrator> integrator_;
+
+  std::unique_ptr<IBroadphase> broadphase_;
+
+  TripleBuffer<UniverseSnapshot> snapshots_;
+
+  /** \see TickHandler()
+  */
+  LatencyHistogram* forces_phase_;
+  LatencyHistogram* integrate_phase_;
+  LatencyHistogram* collide_phase_;
+  LatencyHistogram* snapshot_phase_;
 };
 
 }
 
 #endif
-
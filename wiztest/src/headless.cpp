@@ -0,0 +1,422 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <errno.h>
+#include <limits.h>
+#include <signal.h>
+#include <getopt.h>
+#include <math.h>
+
+#include <string>
+#include <random>
+#include <thread>
+
+#include "common/util.hpp"
+#include "common/result.hpp"
+#include "common/time_measures.hpp"
+#include "common/cpu_topology.hpp"
+#include "common/latency_histogram.hpp"
+#include "common/span_tracer.hpp"
+#include "common/barnes_hut.hpp"
+#include "common/direct_gravity.hpp"
+#include "common/particle_mesh.hpp"
+#include "common/block_timestep_integrator.hpp"
+#include "common/symplectic_integrator.hpp"
+#include "wiztest/src/EvoUniverse.hpp"
+
+using namespace std;
+using namespace evo;
+using namespace std_results;
+
+/** Runs an EvoUniverse without a window: ticks are driven from this thread,
+ either back to back or paced at a multiple of real time, and the achieved
+ throughput and the per-phase tick latencies are reported on exit (including
+ on SIGINT / SIGTERM).
+ */
+
+static volatile sig_atomic_t g_stop_requested = 0;
+
+static void sighandler (int /*signum*/)
+{
+  g_stop_requested = 1;
+}
+
+struct Options
+{
+  Options ()
+    : n_bodies(10000),
+      n_ticks(1000),
+      tick_interval(Duration::FromMilliseconds(100)),
+      speed(0),
+      engine("bh"),
+      integrator("verlet"),
+      seed(1),
+      placement(PlacementPolicy::kNone),
+      stats_period(0)
+  {}
+
+  size_t n_bodies;
+
+  /** 0 runs until interrupted
+  */
+  int64_t n_ticks;
+
+  /** Virtual time per tick
+  */
+  Duration tick_interval;
+
+  /** Multiple of real time; 0 runs as fast as possible
+  */
+  double speed;
+
+  string engine;
+  string integrator;
+  unsigned seed;
+  PlacementPolicy placement;
+
+  /** How often to log the latency histograms while running; 0 = never
+  */
+  Duration stats_period;
+
+  /** Chrome trace file to write; empty = no tracing
+  */
+  string trace_path;
+};
+
+static void PrintUsage (const char* argv0)
+{
+  printf("Usage: %s [options]\n"
+         "  -n, --bodies N        number of bodies (default 10000)\n"
+         "  -t, --ticks N         ticks to run, 0 = until interrupted"
+         " (default 1000)\n"
+         "  -i, --tick-ms MS      virtual time per tick (default 100)\n"
+         "  -s, --speed X         run at X times real time, 0 = as fast as"
+         " possible (default 0)\n"
+         "  -e, --engine NAME     bh, direct or pm (default bh)\n"
+         "  -g, --integrator NAME verlet, yoshida or block (default verlet)\n"
+         "  -r, --seed N          random seed for the initial bodies"
+         " (default 1)\n"
+         "  -p, --placement NAME  worker placement: none, compact, scatter or"
+         " core (default none)\n"
+         "  -S, --stats-every SEC log the latency histograms every SEC"
+         " seconds (default never)\n"
+         "  -T, --trace FILE      write a Chrome trace of the run to FILE\n"
+         "  -h, --help\n", argv0);
+}
+
+/** Whole of \p str as a base-10 integer in [\p min_val, \p max_val]
+ */
+static Result ParseIntOption (const char* name, const char* str,
+                              int64_t min_val, int64_t max_val,
+                              int64_t* val_out)
+{
+  char* end = nullptr;
+  errno = 0;
+  const long long val = strtoll(str, &end, 10);
+  if (end == str || '\0' != *end) {
+    return INVALID_ARGUMENT.Prepend(string(name) + ": \"" + str +
+                                    "\" is not an integer");
+  }
+  if (ERANGE == errno || val < min_val || val > max_val) {
+    return INVALID_ARGUMENT.Prepend(string(name) + ": " + str +
+                                    " is out of range");
+  }
+  *val_out = val;
+  return SUCCESS;
+}
+
+/** Whole of \p str as a finite number
+ */
+static Result ParseDoubleOption (const char* name, const char* str,
+                                 double* val_out)
+{
+  char* end = nullptr;
+  errno = 0;
+  const double val = strtod(str, &end);
+  if (end == str || '\0' != *end) {
+    return INVALID_ARGUMENT.Prepend(string(name) + ": \"" + str +
+                                    "\" is not a number");
+  }
+  if (ERANGE == errno || !isfinite(val)) {
+    return INVALID_ARGUMENT.Prepend(string(name) + ": " + str +
+                                    " is out of range");
+  }
+  *val_out = val;
+  return SUCCESS;
+}
+
+static Result ParseOptions (int argc, char** argv, Options* opts)
+{
+  static const struct option long_options [] = {
+    { "bodies",      required_argument, nullptr, 'n' },
+    { "ticks",       required_argument, nullptr, 't' },
+    { "tick-ms",     required_argument, nullptr, 'i' },
+    { "speed",       required_argument, nullptr, 's' },
+    { "engine",      required_argument, nullptr, 'e' },
+    { "integrator",  required_argument, nullptr, 'g' },
+    { "seed",        required_argument, nullptr, 'r' },
+    { "placement",   required_argument, nullptr, 'p' },
+    { "stats-every", required_argument, nullptr, 'S' },
+    { "trace",       required_argument, nullptr, 'T' },
+    { "help",        no_argument,       nullptr, 'h' },
+    { nullptr,       0,                 nullptr, 0 }
+  };
+
+  int c;
+  while (-1 != (c = getopt_long(argc, argv, "n:t:i:s:e:g:r:p:S:T:h", long_options,
+                                nullptr)))
+  {
+    switch (c)
+    {
+    case 'n':
+    {
+      int64_t n_bodies;
+      Result res = ParseIntOption("--bodies", optarg, 0, INT64_MAX, &n_bodies);
+      if (SUCCESS != res) {
+        return res;
+      }
+      opts->n_bodies = static_cast<size_t>(n_bodies);
+      break;
+    }
+    case 't':
+    {
+      Result res = ParseIntOption("--ticks", optarg, 0, INT64_MAX,
+                                  &opts->n_ticks);
+      if (SUCCESS != res) {
+        return res;
+      }
+      break;
+    }
+    case 'i':
+    {
+      double tick_ms;
+      Result res = ParseDoubleOption("--tick-ms", optarg, &tick_ms);
+      if (SUCCESS != res) {
+        return res;
+      }
+      opts->tick_interval = Duration::FromMilliseconds(tick_ms);
+      break;
+    }
+    case 's':
+    {
+      Result res = ParseDoubleOption("--speed", optarg, &opts->speed);
+      if (SUCCESS != res) {
+        return res;
+      }
+      break;
+    }
+    case 'e':
+      opts->engine = optarg;
+      break;
+    case 'g':
+      opts->integrator = optarg;
+      break;
+    case 'r':
+    {
+      int64_t seed;
+      Result res = ParseIntOption("--seed", optarg, 0, UINT_MAX, &seed);
+      if (SUCCESS != res) {
+        return res;
+      }
+      opts->seed = static_cast<unsigned>(seed);
+      break;
+    }
+    case 'p':
+    {
+      Result res = CpuTopology::ParsePolicy(optarg, &opts->placement);
+      if (SUCCESS != res) {
+        return res.Prepend("--placement");
+      }
+      break;
+    }
+    case 'S':
+    {
+      double stats_sec;
+      Result res = ParseDoubleOption("--stats-every", optarg, &stats_sec);
+      if (SUCCESS != res) {
+        return res;
+      }
+      opts->stats_period = Duration::FromSeconds(stats_sec);
+      break;
+    }
+    case 'T':
+      opts->trace_path = optarg;
+      break;
+    case 'h':
+      PrintUsage(argv[0]);
+      exit(0);
+    default:
+      PrintUsage(argv[0]);
+      return INVALID_ARGUMENT.Prepend("Unrecognized option");
+    }
+  }
+
+  if (opts->tick_interval <= Duration(0)) {
+    return INVALID_ARGUMENT.Prepend("--tick-ms must be positive");
+  }
+  if (opts->speed < 0) {
+    return INVALID_ARGUMENT.Prepend("--speed must not be negative");
+  }
+
+  return SUCCESS;
+}
+
+static Result ConfigureUniverse (const Options& opts, EvoUniverse* universe)
+{
+  // a uniform, slowly collapsing cloud of asteroid-sized bodies
+  const float cloud_radius = 1000.0f * cbrtf(static_cast<float>(opts.n_bodies));
+
+  if ("bh" == opts.engine) {
+    universe->set_force_engine(new BarnesHutGravity());
+  } else if ("direct" == opts.engine) {
+    universe->set_force_engine(new DirectGravity());
+  } else if ("pm" == opts.engine) {
+    // periodic box with plenty of room around the cloud
+    universe->set_force_engine(new ParticleMeshGravity(
+        ParticleMeshGravity::kDefaultGridSize, 4 * cloud_radius,
+        Coords3(-2 * cloud_radius, -2 * cloud_radius, -2 * cloud_radius)));
+  } else {
+    return INVALID_ARGUMENT.Prepend("Unknown force engine \"" + opts.engine +
+                                    "\"");
+  }
+
+  TaskPool* pool = &universe->task_pool();
+  if ("verlet" == opts.integrator) {
+    universe->set_integrator(new SymplecticIntegrator<VelocityVerlet>(pool));
+  } else if ("yoshida" == opts.integrator) {
+    universe->set_integrator(new SymplecticIntegrator<Yoshida4>(pool));
+  } else if ("block" == opts.integrator) {
+    universe->set_integrator(new BlockTimestepIntegrator(pool));
+  } else {
+    return INVALID_ARGUMENT.Prepend("Unknown integrator \"" +
+                                    opts.integrator + "\"");
+  }
+
+  mt19937 rng (opts.seed);
+  uniform_real_distribution<float> uni (-1.0f, 1.0f);
+
+  universe->things().Reserve(opts.n_bodies, pool);
+  for (size_t i = 0; i < opts.n_bodies; ++i)
+  {
+    Coords3 pos;
+    do {
+      pos = Coords3(uni(rng), uni(rng), uni(rng));
+    } while (pos.x * pos.x + pos.y * pos.y + pos.z * pos.z > 1.0f);
+    pos.x *= cloud_radius;
+    pos.y *= cloud_radius;
+    pos.z *= cloud_radius;
+    universe->things().Add(1e12f /* mass */, 5.0f /* radius */, pos,
+                           Coords3(uni(rng), uni(rng), uni(rng)));
+  }
+
+  return SUCCESS;
+}
+
+int main (int argc, char** argv)
+{
+  google::InitGoogleLogging(argv[0]);
+
+  Options opts;
+  Result res = ParseOptions(argc, argv, &opts);
+  if (SUCCESS != res) {
+    fprintf(stderr, "%s\n", res.ToString().c_str());
+    return 1;
+  }
+
+  signal(SIGINT,  sighandler);
+  signal(SIGTERM, sighandler);
+
+  // now rather than in the first timed tick
+  FastClock::Calibrate();
+
+  EvoUniverse universe (opts.placement);
+  if (SUCCESS != (res = ConfigureUniverse(opts, &universe))) {
+    fprintf(stderr, "%s\n", res.ToString().c_str());
+    return 1;
+  }
+
+  char pace [64] = "max speed";
+  if (opts.speed > 0) {
+    snprintf(pace, sizeof(pace), "%gx real time", opts.speed);
+  }
+  printf("%zu bodies, %s ticks of %s, %s, engine %s, integrator %s\n",
+         universe.things().size(),
+         (opts.n_ticks > 0 ? to_string(opts.n_ticks).c_str() : "unlimited"),
+         opts.tick_interval.ToStringPretty().c_str(), pace,
+         opts.engine.c_str(), universe.integrator()->name().c_str());
+  if (PlacementPolicy::kNone != opts.placement) {
+    printf("%d workers, placement %s; %s\n", universe.task_pool().n_workers(),
+           CpuTopology::PolicyToString(opts.placement).c_str(),
+           CpuTopology::Get().ToString().c_str());
+  }
+
+  if (!opts.trace_path.empty() &&
+      SUCCESS != (res = SpanTracer::Start(opts.trace_path))) {
+    fprintf(stderr, "%s\n", res.ToString().c_str());
+    return 1;
+  }
+
+  // in paced mode, tick k is due at start + k * tick_interval / speed
+  const Duration real_tick_interval = (opts.speed > 0)
+      ? Duration::FromSeconds(opts.tick_interval.Seconds() / opts.speed)
+      : Duration(0);
+
+  const SteadyTimePoint start_time = SteadyTimePoint::Now();
+  int64_t tick_index = 0;
+
+  while (!g_stop_requested && (opts.n_ticks <= 0 || tick_index < opts.n_ticks))
+  {
+    if (opts.speed > 0)
+    {
+      const SteadyTimePoint deadline =
+          start_time + real_tick_interval * tick_index;
+      const Duration wait = deadline - SteadyTimePoint::Now();
+      if (wait > Duration(0)) {
+        this_thread::sleep_for(wait.std_duration());
+      }
+    }
+
+    // each tick advances the universe to the end of its interval; tick k
+    // at k * tick_interval would make tick 0 a no-op, since dt would be 0
+    const Duration virtual_time = opts.tick_interval * (tick_index + 1);
+    const Duration real_time = SteadyTimePoint::Now() - start_time;
+    {
+      ScopedSpan span ("tick");
+      res = universe.TickHandler(static_cast<int>(tick_index), virtual_time,
+                                 real_time);
+    }
+    if (SUCCESS != res) {
+      fprintf(stderr, "Tick %lld failed: %s\n",
+              static_cast<long long>(tick_index), res.ToString().c_str());
+      break;
+    }
+
+    ++tick_index;
+
+    if (opts.stats_period > Duration(0)) {
+      LogStatsPeriodically(opts.stats_period);
+    }
+  }
+
+  const double secs = (SteadyTimePoint::Now() - start_time).Seconds();
+  const double ticks_per_sec = (secs > 0 ? tick_index / secs : 0);
+
+  printf("%lld ticks in %.3f s: %.1f ticks/s, %.3g body-updates/s,"
+         " %.1fx real time\n",
+         static_cast<long long>(tick_index), secs, ticks_per_sec,
+         ticks_per_sec * universe.things().size(),
+         ticks_per_sec * opts.tick_interval.Seconds());
+  printf("%s", DumpStats().c_str());
+
+  if (!opts.trace_path.empty())
+  {
+    Result trace_res = SpanTracer::Stop();
+    if (SUCCESS != trace_res) {
+      fprintf(stderr, "%s\n", trace_res.ToString().c_str());
+    } else {
+      printf("Trace written to %s\n", opts.trace_path.c_str());
+    }
+  }
+
+  return (SUCCESS == res ? 0 : 1);
+}
@@ -14,8 +14,10 @@
 
 #include "common/util.hpp"
 #include "common/PlanckTicker.hpp"
+#include "common/span_tracer.hpp"
 #include "common/open_gl_renderable.hpp"
 #include "wiztest/src/wiz.hpp"
+#include "wiztest/src/EvoUniverse.hpp"
 
 using namespace std;
 using namespace evo;
@@ -43,11 +45,16 @@ int g_win_1 = -1;
 
 float g_thetime = 0.0;
 
-vector<Wiz> g_wizzes;
+/** Owned by main(); display() only ever reads its published snapshots, so
+ rendering never waits on the ticker thread or vice versa.
+ */
+EvoUniverse* g_universe = nullptr;
 
 
 void display ()
 {
+  ScopedSpan span ("display");
+
   static int count = 0;
   ++count;
 
@@ -57,21 +64,17 @@ void display ()
   char* timestr = ctime(&timestart);
   timestr[strlen(timestr)-1] = '\0';
 
-  g_wizzes.emplace_back(Coords3(0, 0, 5));
-  g_wizzes.emplace_back(Coords3(0, 5, 15));
-  g_wizzes.emplace_back(Coords3(20, 9, 16));
+  const UniverseSnapshot& snapshot = g_universe->LatestSnapshot();
 
   glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-  for (int i = 0; i < g_wizzes.size(); ++i)
+  for (size_t i = 0; i < snapshot.size(); ++i)
   {
-    Wiz& wiz = g_wizzes[i];
-
     glPushMatrix();
 
-    glTranslatef(wiz.pos().x, wiz.pos().y, wiz.pos().z);
+    glTranslatef(snapshot.x[i], snapshot.y[i], snapshot.z[i]);
     gluSphere(qobj,
-              wiz.radius(), // radius
+              snapshot.radius[i], // radius
               kWizNGlSphereSlices,  // slices
               kWizNGlSphereStacks); // stacks
 
@@ -87,7 +90,8 @@ void display ()
   //}
   glutSwapBuffers();
 
-  printf("%s _ display() # %d\n", timestr, (int)count);
+  printf("%s _ display() # %d, tick %d\n", timestr, (int)count,
+         snapshot.tick_index);
 }
 
 void init ()
@@ -130,7 +134,33 @@ int main (int argc, char** argv)
   signal(SIGINT,  sighandler);
   signal(SIGTERM, sighandler);
 
-  EvoUniverse universe ();
+  // now rather than in the first timed tick
+  FastClock::Calibrate();
+
+  // glutMainLoop() never returns, so the trace is never Stop()ped; the file
+  // is still readable without its closing bracket
+  const char* trace_path = getenv("EVO_TRACE");
+  if (trace_path) {
+    Result res = SpanTracer::Start(trace_path);
+    if (std_results::SUCCESS != res) {
+      cerr << res.ToString() << "\n";
+    }
+  }
+
+  EvoUniverse universe;
+  g_universe = &universe;
+
+  const Coords3 initial_wiz_positions [] = {
+    Coords3(0, 0, 5),
+    Coords3(0, 5, 15),
+    Coords3(20, 9, 16)
+  };
+  for (const Coords3& pos : initial_wiz_positions) {
+    universe.things().Add(1.0f /* mass */, 1.0f /* radius */, pos);
+  }
+  // nothing is published until the first tick otherwise, and display()
+  // only draws snapshots
+  universe.PublishInitialSnapshot();
 
   PlanckTicker uclock ( real_time_per_evo_tick,
       std::bind(&EvoUniverse::TickHandler, &universe,